@@ -92,7 +92,7 @@ do_chghost(struct Client *source_p, struct Client *target_p,
 		return FALSE;
 	}
 
-	rb_strlcpy(target_p->host, newhost, sizeof(target_p->host));
+	set_client_host(target_p, newhost);
 
 	if (MyClient(target_p))
 		sendto_one_notice(target_p, ":%s is now your hidden host (set by %s)", target_p->host, source_p->name);
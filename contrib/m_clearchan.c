@@ -96,6 +96,7 @@ mo_clearchan(struct Client *client_p, struct Client *source_p, int parc, const c
 		msptr = ptr->data;
 		msptr->flags &= ~CHFL_CHANOP | CHFL_VOICE;
 	}
+	invalidate_names_cache(chptr);
 
 	sendto_wallops_flags(UMODE_WALLOP, &me,
 			     "CLEARCHAN called for [%s] by %s!%s@%s",
@@ -50,7 +50,6 @@
 
 static int mo_oaccept(struct Client *client_p, struct Client *source_p,
 			int parc, const char *parv[]);
-static void add_accept(struct Client *, struct Client *);
 
 struct Message oaccept_msgtab = {
 	"OACCEPT", 0, 0, 0, MFLG_SLOW,
@@ -103,10 +102,3 @@ mo_oaccept(struct Client *client_p, struct Client *source_p, int parc, const cha
 
 	return 0;
 }
-
-static void
-add_accept(struct Client *source_p, struct Client *target_p)
-{
-	rb_dlinkAddAlloc(target_p, &source_p->localClient->allow_list);
-	rb_dlinkAddAlloc(source_p, &target_p->on_allow_list);
-}
@@ -124,11 +124,11 @@ mr_webirc(struct Client *client_p, struct Client *source_p, int parc, const char
 		return 0;
 	}
 
-	rb_strlcpy(source_p->sockhost, parv[4], sizeof(source_p->sockhost));
+	set_client_sockhost(source_p, parv[4]);
 	if(strlen(parv[3]) <= HOSTLEN)
-		rb_strlcpy(source_p->host, parv[3], sizeof(source_p->host));
+		set_client_host(source_p, parv[3]);
 	else
-		rb_strlcpy(source_p->host, source_p->sockhost, sizeof(source_p->host));
+		set_client_host(source_p, source_p->sockhost);
 
 	rb_inet_pton_sock(parv[4], (struct sockaddr *)&source_p->localClient->ip);
 
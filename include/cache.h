@@ -10,6 +10,8 @@
 #define HELP_USER	0x001
 #define HELP_OPER	0x002
 
+struct Client;
+
 struct cachefile
 {
 	rb_dlink_list contents;
@@ -20,6 +22,7 @@ struct cachefile
 struct cacheline
 {
 	rb_dlink_node linenode;
+	size_t len;
 	char data[CACHELINELEN];
 };
 
@@ -31,6 +34,7 @@ void send_links_cache(struct Client *source_p);
 
 
 void free_cachefile(struct cachefile *);
+void send_cache_lines(struct Client *, int, const char *, rb_dlink_node *);
 const char *cache_user_motd_updated(void);
 
 
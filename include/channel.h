@@ -80,6 +80,23 @@ struct Channel
 	uint32_t ban_serial;
 	time_t channelts;
 	char *chname;
+
+	struct names_cache *names;	/* NAMES_VARIANTS prebuilt member lists */
+};
+
+/*
+ * The member list part of RPL_NAMREPLY, as "@nick +nick nick ", kept for
+ * each combination of the flags below and built on first use.
+ */
+#define NAMES_STACK	0x1	/* multi-prefix client */
+#define NAMES_MEMBER	0x2	/* asked by a member, so +i users are shown */
+#define NAMES_VARIANTS	4
+
+struct names_cache
+{
+	char *buf;		/* NULL until built */
+	size_t len;
+	size_t size;
 };
 
 struct membership
@@ -92,15 +109,18 @@ struct membership
 	struct Client *client_p;
 	int flags;
 	uint32_t ban_serial;
+	unsigned int slot;	/* LocalSlot() of a local member */
 };
 
 #define BANLEN NICKLEN+USERLEN+HOSTLEN+6
 struct Ban
 {
 	char *banstr;
+	struct compiled_mask *mask;	/* banstr, ready for match_compiled() */
 	char *who;
 	time_t when;
 	rb_dlink_node node;
+	struct _hash_node *hnode;	/* in HASH_BAN while on a list */
 };
 
 struct ChModeChange
@@ -181,10 +201,26 @@ struct ChCapCombo
 extern rb_dlink_list global_channel_list;
 void init_channels(void);
 
+/* a place in global_channel_list that outlives the channels around it,
+ * destroy_channel() steps any cursor off the channel being freed
+ */
+struct channel_cursor
+{
+	rb_dlink_node node;
+	rb_dlink_node *next;
+};
+
+void add_channel_cursor(struct channel_cursor *cursor);
+void del_channel_cursor(struct channel_cursor *cursor);
+struct Channel *channel_cursor_next(struct channel_cursor *cursor);
+
 struct Channel *find_channel(const char *name);
 
 struct Ban *allocate_ban(const char *, const char *);
 void free_ban(struct Ban *bptr);
+struct Ban *find_channel_ban(rb_dlink_list *list, const char *banstr);
+void add_channel_ban(rb_dlink_list *list, struct Ban *bptr);
+void del_channel_ban(rb_dlink_list *list, struct Ban *bptr);
 
 
 void destroy_channel(struct Channel *);
@@ -206,6 +242,8 @@ void free_channel_list(rb_dlink_list *);
 int check_channel_name(const char *name);
 
 void channel_member_names(struct Channel *chptr, struct Client *, int show_eon);
+void invalidate_names_cache(struct Channel *chptr);
+void invalidate_names_cache_user(struct Client *);
 
 void del_invite(struct Channel *chptr, struct Client *who);
 
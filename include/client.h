@@ -310,6 +310,78 @@ enum {
 #define ClearCork(x)		(MyConnect(x) ? (x)->localClient->cork_count-- : (x)->from->localClient->cork_count--)
 
 
+/*
+ * The state looked at once a second by flood_recalc(), check_pings() and
+ * check_banned_lines() for every local connection.  It is kept in arrays
+ * indexed by localClient->slot so the sweeps walk contiguous memory rather
+ * than pulling each struct LocalUser into cache.
+ */
+struct LocalSweep
+{
+	struct Client **client;
+	time_t *lasttime;	/* last time we parsed something */
+	time_t *firsttime;	/* time client was created */
+	int *sent_parsed;	/* how many messages we've parsed in this second */
+	int *actually_read;	/* how many we've actually read in this second */
+	unsigned int *allow_read;	/* how many we're allowed to read in this second */
+	uint8_t *queued;	/* lines left in the receive queue */
+	unsigned int count;
+	unsigned int size;
+};
+
+extern struct LocalSweep local_sweep;
+
+#define LocalSlot(x)		((x)->localClient->slot)
+#define LocalLastTime(x)	(local_sweep.lasttime[LocalSlot(x)])
+#define LocalFirstTime(x)	(local_sweep.firsttime[LocalSlot(x)])
+#define LocalSentParsed(x)	(local_sweep.sent_parsed[LocalSlot(x)])
+#define LocalActuallyRead(x)	(local_sweep.actually_read[LocalSlot(x)])
+#define LocalAllowRead(x)	(local_sweep.allow_read[LocalSlot(x)])
+#define LocalQueued(x)		(local_sweep.queued[LocalSlot(x)])
+
+void add_local_sweep(struct Client *client_p);
+void del_local_sweep(struct Client *client_p);
+
+/*
+ * The first and last WHO_KEYLEN characters of every client's nick,
+ * username, host and gecos, folded to upper case and packed into dense
+ * arrays indexed by client->whoslot.  A global WHO checks the literal
+ * prefix and suffix of its mask against these and only calls match() on
+ * the clients that survive.  Slots are never moved, a freed one is simply
+ * handed to the next client, so a who_query can be resumed later.
+ */
+#define WHO_KEYLEN	4
+
+enum
+{
+	WHO_NAME,
+	WHO_USERNAME,
+	WHO_HOST,
+	WHO_INFO,
+	WHO_FIELDS
+};
+
+struct who_key
+{
+	uint32_t prefix[WHO_FIELDS];
+	uint32_t suffix[WHO_FIELDS];
+};
+
+struct who_query
+{
+	uint32_t prefix, prefix_mask;
+	uint32_t suffix, suffix_mask;
+	unsigned int pos;	/* slots below this are still to be looked at */
+};
+
+struct compiled_mask;
+
+void who_index_add(struct Client *client_p);
+void who_index_del(struct Client *client_p);
+void who_index_update(struct Client *client_p);
+void who_query_init(struct who_query *query, const struct compiled_mask *cmask);
+struct Client *who_query_next(struct who_query *query);
+
 /*
  * definitions for get_client_name
  */
@@ -337,6 +409,12 @@ const char *log_client_name(struct Client *, int);
 void init_client(void);
 struct Client *make_client(struct Client *from);
 void free_client(struct Client *client);
+void init_client_strings(struct Client *client);
+void free_client_strings(struct Client *client);
+void set_client_username(struct Client *client, const char *username);
+void set_client_host(struct Client *client, const char *host);
+void set_client_sockhost(struct Client *client, const char *sockhost);
+void set_client_info(struct Client *client, const char *info);
 
 int exit_client(struct Client *, struct Client *, struct Client *, const char *);
 
@@ -355,8 +433,12 @@ void notify_banned_client(struct Client *client_p, struct ConfItem *aconf, int b
 
 void del_from_accept(struct Client *source, struct Client *target);
 
-#define accept_message(s, t) ((s) == (t) || (rb_dlinkFind((s), &((t)->localClient->allow_list))))
+#define accept_message(s, t) ((s) == (t) || find_accept((t), (s)))
+void add_accept(struct Client *target_p, struct Client *source_p);
+bool find_accept(struct Client *target_p, struct Client *source_p);
+void del_accept(struct Client *target_p, struct Client *source_p);
 void del_all_accepts(struct Client *client_p);
+void del_on_accepts(struct Client *client_p);
 
 void dead_link(struct Client *client_p, bool sendqex);
 int show_ip(struct Client *source_p, struct Client *target_p);
@@ -376,6 +458,7 @@ struct Client *find_client(const char *name);
 struct Client *find_named_client(const char *name);
 struct Client *find_server(struct Client *source_p, const char *name);
 struct Client *find_id(const char *name);
+struct Client *find_connid(uint32_t connid);
 
 
 
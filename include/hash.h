@@ -37,56 +37,55 @@ typedef struct _hash_function hash_f;
 #include <s_newconf.h>
 
 
-#define HELP_MAX_BITS 7
-#define HELP_MAX (1<<HELP_MAX_BITS)
+/*
+ * Initial, and smallest, sizes of the hash tables.  The tables grow and
+ * shrink with the number of entries, these just stop small tables from
+ * resizing all the time.
+ */
+#define HELP_MIN_BITS 7
 
-/* Client hash table size, used in hash.c/s_debug.c */
-#define U_MAX_BITS 17
-#define U_MAX (1<<U_MAX_BITS)
+/* Client hash table size, used in hash.c */
+#define U_MIN_BITS 12
 
 /* Client connid hash table size, used in hash.c */
-#define CLI_CONNID_MAX_BITS 12
-#define CLI_CONNID_MAX (1<<CLI_CONNID_MAX_BITS)
-
-#define CLI_ZCONNID_MAX_BITS 7
-#define CLI_ZCONNID_MAX (1<<CLI_ZCONNID_MAX_BITS)
+#define CLI_CONNID_MIN_BITS 8
+#define CLI_ZCONNID_MIN_BITS 4
 
-/* Channel hash table size, hash.c/s_debug.c */
-#define CH_MAX_BITS 16
-#define CH_MAX (1<<CH_MAX_BITS)	/* 2^16 */
+/* Channel hash table size, hash.c */
+#define CH_MIN_BITS 10
 
 /* hostname hash table size */
-#define HOST_MAX_BITS 17
-#define HOST_MAX (1<<HOST_MAX_BITS)	/* 2^17 */
+#define HOST_MIN_BITS 12
 
 /* RESV/XLINE hash table size, used in hash.c */
-#define R_MAX_BITS 10
-#define R_MAX (1<<R_MAX_BITS)	/* 2^10 */
+#define R_MIN_BITS 6
 
 /* operhash */
-#define OPERHASH_MAX_BITS 10
-#define OPERHASH_MAX (1<<OPERHASH_MAX_BITS)
+#define OPERHASH_MIN_BITS 6
 
 /* scache hash */
-#define SCACHE_MAX_BITS 8
-#define SCACHE_MAX (1<<SCACHE_MAX_BITS)
+#define SCACHE_MIN_BITS 6
 
-/* whowas hash */
-#define WHOWAS_MAX_BITS 17
-#define WHOWAS_MAX (1<<WHOWAS_MAX_BITS)
+/* interned string hash */
+#define INTERN_MIN_BITS 12
 
 /* monitor hash */
-#define MONITOR_MAX_BITS 16
-#define MONITOR_MAX (1<<MONITOR_MAX_BITS)
+#define MONITOR_MIN_BITS 10
+
+/* accept and monitor membership hashes, keyed by (owner, member) */
+#define ACCEPT_MIN_BITS 8
+#define MONLINK_MIN_BITS 10
 
 /* command hash */
-#define COMMAND_MAX_BITS 9
-#define COMMAND_MAX (1<<COMMAND_MAX_BITS)
+#define COMMAND_MIN_BITS 9
+
+/* channel ban/except/invex hash, keyed by (list, folded mask) */
+#define BAN_MIN_BITS 10
 
+/* reject and throttle caches, keyed by raw address */
+#define REJECT_MIN_BITS 10
+#define THROTTLE_MIN_BITS 10
 
-#define HASH_WALK(i, max, ptr, table) for (i = 0; i < max; i++) { RB_DLINK_FOREACH(ptr, table[i].head)
-#define HASH_WALK_SAFE(i, max, ptr, nptr, table) for (i = 0; i < max; i++) { RB_DLINK_FOREACH_SAFE(ptr, nptr, table[i].head)
-#define HASH_WALK_END }
 
 typedef enum
 {
@@ -111,6 +110,12 @@ extern hash_f *hash_connid;
 extern hash_f *hash_zconnid;
 extern hash_f *hash_monitor;
 extern hash_f *hash_command;
+extern hash_f *hash_intern;
+extern hash_f *hash_accept;
+extern hash_f *hash_monlink;
+extern hash_f *hash_ban;
+extern hash_f *hash_reject;
+extern hash_f *hash_throttle;
 
 #define	HASH_CLIENT hash_client
 #define	HASH_ID hash_id
@@ -126,14 +131,20 @@ extern hash_f *hash_command;
 #define	HASH_ZCONNID hash_zconnid
 #define	HASH_MONITOR hash_monitor
 #define	HASH_COMMAND hash_command
+#define	HASH_INTERN hash_intern
+#define	HASH_ACCEPT hash_accept
+#define	HASH_MONLINK hash_monlink
+#define	HASH_BAN hash_ban
+#define	HASH_REJECT hash_reject
+#define	HASH_THROTTLE hash_throttle
 
 
 struct _hash_node
 {
-	rb_dlink_node node;
 	void *key;
 	size_t keylen;
 	void *data;
+	hash_node *next;	/* other entries with the same key */
 	uint32_t hashv;
 };
 
@@ -165,13 +176,13 @@ void *hash_find_data_len(hash_f * type, const void *hashindex, size_t len);
 
 void hash_del_hnode(hash_f * type, hash_node *node);
 
+uint32_t hash_irccase(const char *s);
+
 void hash_stats(struct Client *);
-void hash_get_memusage(hash_f * type, size_t *memusage, size_t *entries);
+void hash_get_memusage(hash_f * type, size_t *entries, size_t *memusage);
 
 rb_dlink_list hash_get_channel_block(int i);
 
-rb_dlink_list *hash_get_tablelist(hash_f *type);  
-void hash_free_tablelist(rb_dlink_list *tables);
 void hash_destroyall(hash_f * type, hash_destroy_cb *destroy_cb);
 
 #endif /* INCLUDED_hash_h */
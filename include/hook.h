@@ -7,13 +7,23 @@
 #ifndef INCLUDED_HOOK_H
 #define INCLUDED_HOOK_H
 
+struct Client;
+
+typedef void (*hookfn) (void *data);
+
 typedef struct
 {
 	char *name;
-	rb_dlink_list hooks;
+	hookfn *fns;		/* subscribers, in the order they are called */
+	int nfns;
+	unsigned long calls;	/* calls made with subscribers present */
+	uint64_t usec;		/* time spent in those calls */
 } hook;
 
-typedef void (*hookfn) (void *data);
+extern hook *hooks;
+
+/* lets callers skip building hook data nobody will look at */
+#define hook_has_subscribers(id)	(hooks[(id)].nfns > 0)
 
 extern int h_iosend_id;
 extern int h_iorecv_id;
@@ -37,6 +47,7 @@ int register_hook(const char *name);
 void add_hook(const char *name, hookfn fn);
 void remove_hook(const char *name, hookfn fn);
 void call_hook(int id, void *arg);
+void hook_stats(struct Client *source_p);
 
 typedef struct
 {
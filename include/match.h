@@ -42,6 +42,23 @@ int match_esc(const char *mask, const char *name);
 int match_cidr(const char *mask, const char *name);
 int match_ips(const char *mask, const char *addr);
 
+/*
+ * compile_mask - precompile a mask for match_compiled(), which gives
+ * the same answers as match(), or match_esc() with MASK_ESC, without
+ * parsing the mask again every call.  Masks are split on '*' into runs
+ * that are searched for directly rather than by backtracking.
+ */
+#define MASK_ESC	0x1
+
+struct compiled_mask;
+
+struct compiled_mask *compile_mask(const char *mask, int flags);
+void free_compiled_mask(struct compiled_mask *cmask);
+int match_compiled(const struct compiled_mask *cmask, const char *name);
+size_t compiled_mask_prefix(const struct compiled_mask *cmask, const char **literal);
+size_t compiled_mask_suffix(const struct compiled_mask *cmask, const char **literal);
+bool compiled_mask_literal(const struct compiled_mask *cmask);
+
 
 /*
  * comp_with_mask - compares to IP address
@@ -129,8 +146,88 @@ extern const unsigned int CharAttrs[];
 #define IsEol(c) (CharAttrs[(unsigned char)(c)] & EOL_C)
 
 
+/*
+ * word at a time case folding
+ *
+ * ToUpperTab only touches 'a' - '~' (0x61 - 0x7e), moving each down by
+ * 0x20, so eight bytes can be folded at once: work out which bytes are
+ * in that range with a couple of adds that cannot carry between bytes,
+ * and subtract 0x20 from just those.  Bytes with the top bit set are
+ * left alone, exactly as the table does.
+ */
+#define IRC_WORD_ONES	0x0101010101010101ULL
+#define IRC_WORD_HIGH	0x8080808080808080ULL
+
+static inline uint64_t
+irc_load_word(const unsigned char *s)
+{
+	uint64_t w;
+	memcpy(&w, s, sizeof(w));
+	return w;
+}
+
+static inline uint64_t
+irc_toupper_word(uint64_t w)
+{
+	uint64_t x = w & ~IRC_WORD_HIGH;
+	uint64_t ge61 = x + IRC_WORD_ONES * (0x80 - 0x61);
+	uint64_t ge7f = x + IRC_WORD_ONES * (0x80 - 0x7f);
+
+	return w - (((ge61 & ~ge7f & ~w) & IRC_WORD_HIGH) >> 2);
+}
+
+/*
+ * irc_memcaseeq - case insensitive equality of the first len bytes of
+ * s1 and s2, a word at a time.  Short tails are done with loads that
+ * overlap rather than a byte loop.
+ */
+static inline bool
+irc_memcaseeq(const void *s1, const void *s2, size_t len)
+{
+	const unsigned char *str1 = s1;
+	const unsigned char *str2 = s2;
+	uint32_t h1, t1, h2, t2;
+	size_t i;
+
+	if(len >= sizeof(uint64_t))
+	{
+		for(i = 0; i + sizeof(uint64_t) < len; i += sizeof(uint64_t))
+		{
+			if(irc_toupper_word(irc_load_word(str1 + i)) !=
+			   irc_toupper_word(irc_load_word(str2 + i)))
+				return false;
+		}
+		i = len - sizeof(uint64_t);
+		return irc_toupper_word(irc_load_word(str1 + i)) ==
+			irc_toupper_word(irc_load_word(str2 + i));
+	}
+
+	if(len >= sizeof(uint32_t))
+	{
+		i = len - sizeof(uint32_t);
+		memcpy(&h1, str1, sizeof(h1));
+		memcpy(&t1, str1 + i, sizeof(t1));
+		memcpy(&h2, str2, sizeof(h2));
+		memcpy(&t2, str2 + i, sizeof(t2));
+		return irc_toupper_word(h1 | (uint64_t)t1 << 32) ==
+			irc_toupper_word(h2 | (uint64_t)t2 << 32);
+	}
+
+	if(len == 0)
+		return true;
+
+	return ToUpper(str1[0]) == ToUpper(str2[0]) &&
+		ToUpper(str1[len >> 1]) == ToUpper(str2[len >> 1]) &&
+		ToUpper(str1[len - 1]) == ToUpper(str2[len - 1]);
+}
+
 /*
  * irccmp - case insensitive comparison of s1 and s2
+ *
+ * without the lengths to hand a word at a time version needs two
+ * strlen()s first, which costs more than it saves on nick sized
+ * strings, so this stays a byte at a time.  Callers that know their
+ * lengths should use irc_memcaseeq().
  */
 
 /* inline versions */
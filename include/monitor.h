@@ -12,16 +12,24 @@
 
 #include <hash.h>
 
+struct Client;
+
 struct monitor
 {
 	hash_node *hnode;
 	rb_dlink_list users;
 	char *name;
+	rb_dlink_node pnode;	/* on the list of nicks waiting for monitor_flush() */
+	bool pending;
 };
 
 struct monitor *find_monitor(const char *name, bool add);
 void free_monitor(struct monitor *);
 
+bool add_monitor_client(struct monitor *, struct Client *);
+void del_monitor_client(struct monitor *, struct Client *);
+void monitor_reported(struct monitor *, struct Client *, struct Client *);
+
 void clear_monitor(struct Client *);
 
 void monitor_signon(struct Client *);
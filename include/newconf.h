@@ -98,6 +98,8 @@ int check_valid_blocks(void);
 int check_valid_entries(void);
 
 int read_config_file(const char *);
+void conf_add_source(const char *, FILE *);
+void clear_changed_confs(void);
 int conf_start_block(char *, char *);
 int conf_end_block(void);
 int conf_call_set(char *, conf_parm_t *, int);
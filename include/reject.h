@@ -29,6 +29,12 @@
 /* amount of time to delay a rejected clients exit */
 #define DEFAULT_DELAYED_EXIT_TIME	15
 
+/* most addresses the reject and throttle caches hold, past this the
+ * least recently seen entry is dropped to make room
+ */
+#define REJECT_CACHE_MAX	65536
+#define THROTTLE_CACHE_MAX	65536
+
 void init_reject(void);
 int check_reject(rb_fde_t *F, struct sockaddr *addr);
 void add_reject(struct Client *);
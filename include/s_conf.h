@@ -52,6 +52,9 @@ struct ConfItem
 	time_t hold;		/* Hold action until this time (calendar time) */
 	struct Class *c_class;	/* Class of connection */
 	rb_patricia_node_t *pnode;
+	struct compiled_mask *host_mask;	/* compiled host, or gecos for xlines */
+	struct compiled_mask *user_mask;
+	struct mask_entry *mask_entry;	/* index entry for xlines and nick resvs */
 };
 
 #define CONF_ILLEGAL		0x80000000
@@ -135,6 +138,9 @@ struct config_file_entry
 	char *fname_klinelog;
 	char *fname_operspylog;
 	char *fname_ioerrorlog;
+	int log_threaded;
+	int log_buffer_lines;
+	int log_overflow_block;
 	char *motd_path;
 	char *oper_motd_path;
 	unsigned char compression_level;
@@ -341,6 +347,7 @@ void add_temp_dline(struct ConfItem *);
 void report_temp_klines(struct Client *);
 void show_temp_klines(struct Client *, rb_dlink_list *);
 
+unsigned long conf_lap_usec(struct timeval *);
 void rehash(int);
 void rehash_bans(int);
 
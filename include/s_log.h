@@ -54,8 +54,10 @@ typedef enum ilogfile
 void init_main_logfile(const char *filename);
 void open_logfiles(const char *filename);
 void close_logfiles(void);
+void flush_logfiles(void);
 void
 ilog(ilogfile dest, const char *fmt, ...) AFP(2, 3);
+void log_buffer_usage(size_t *, size_t *, size_t *, unsigned long *, unsigned long *);
 void report_operspy(struct Client *, const char *, const char *);
 const char *smalldate(time_t);
 
@@ -238,6 +238,10 @@ struct ConfItem *find_xline(const char *, int);
 struct ConfItem *find_nick_resv(const char *name);
 struct ConfItem *find_xline_mask(const char *);
 struct ConfItem *find_nick_resv_mask(const char *name);
+void add_xline_conf(struct ConfItem *);
+void del_xline_conf(rb_dlink_node *);
+void add_nick_resv(struct ConfItem *);
+void del_nick_resv(rb_dlink_node *);
 
 
 
@@ -1,6 +1,6 @@
 /*
  *  ircd-ratbox: A slightly useful ircd.
- *  scache.h: A header for the servername cache functions.
+ *  scache.h: A header for the servername and string cache functions.
  *
  *  Copyright (C) 1990 Jarkko Oikarinen and University of Oulu, Co Center
  *  Copyright (C) 1996-2002 Hybrid Development Team
@@ -29,4 +29,8 @@
 
 const char *scache_add(const char *name);
 void count_scache(size_t *, size_t *);
+
+const char *intern_add(const char *str, size_t maxlen);
+void intern_del(const char *str);
+void count_intern(size_t *number, size_t *refs, size_t *mem);
 #endif
@@ -40,11 +40,14 @@ typedef enum _loglevel {
 void send_pop_queue(struct Client *);
 void sendto_one(struct Client *target_p, const char *, ...) AFP(2, 3);
 void sendto_one_buffer(struct Client *target_p, const char *buffer);
+void sendto_one_linebuf(struct Client *target_p, rb_buf_head_t * linebuf);
 void sendto_one_notice(struct Client *target_p, const char *, ...) AFP(2, 3);
 void sendto_one_prefix(struct Client *target_p, struct Client *source_p,
 			    const char *command, const char *, ...) AFP(4, 5);
 void sendto_one_numeric(struct Client *target_p, int numeric, const char *, ...) AFP(3, 4);
 
+void add_serv_capgroup(struct Client *);
+void del_serv_capgroup(struct Client *);
 void sendto_server(struct Client *one, struct Channel *chptr,
 			unsigned long caps, unsigned long nocaps,
 			const char *format, ...) AFP(5, 6);
@@ -52,11 +55,13 @@ void sendto_channel_flags(struct Client *one, int type, struct Client *source_p,
 			       struct Channel *chptr, const char *, ...) AFP(5, 6);
 void sendto_channel_local(int type, struct Channel *, const char *, ...) AFP(3, 4);
 void sendto_common_channels_local(struct Client *, const char *, ...) AFP(2, 3);
+void sendto_common_channels_quits(struct Client **, size_t, const char *);
+void cork_channel_local(struct Channel *);
+void uncork_channel_local(struct Channel *);
 void sendto_match_butone(struct Client *, struct Client *,
 			      const char *, int, const char *, ...) AFP(5, 6);
 void sendto_match_servs(struct Client *source_p, const char *mask,
 			     int capab, int, const char *, ...) AFP(5, 6);
-void sendto_monitor(struct monitor *monptr, const char *, ...) AFP(2, 3);
 
 void sendto_anywhere(struct Client *, struct Client *, const char *,
 		  const char *, ...) AFP(4, 5);
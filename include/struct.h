@@ -63,60 +63,69 @@ struct ZipStats
 
 struct Client
 {
-	rb_dlink_node node;
-	rb_dlink_node lnode;
-	struct User *user;	/* ...defined, if this is a User */
-	struct Server *serv;	/* ...defined, if this is a server */
-	struct Client *servptr;	/* Points to server this Client is on */
+	/* the fields looked at for nearly every message come first, so
+	 * they share a cache line
+	 */
 	struct Client *from;	/* == self, if Local Client, *NEVER* NULL! */
-
-	rb_dlink_list whowas_clist;
-	time_t tsinfo;		/* TS on the nick, SVINFO on server */
+	struct Client *servptr;	/* Points to server this Client is on */
+	struct User *user;	/* ...defined, if this is a User */
+	struct LocalUser *localClient;
+	/* client->name is the unique name for a client nick or host */
+	const char *name;
 	uint32_t umodes;	/* opers, normal users subset */
 	uint32_t flags;		/* client flags */
 	uint32_t operflags;	/* ugh. overflow */
-
 	uint8_t hopcount;	/* number of servers to this 0 = local */
 	uint8_t status;		/* Client type */
 	uint8_t handler;	/* Handler index */
+	time_t tsinfo;		/* TS on the nick, SVINFO on server */
+
+	rb_dlink_node node;
+	rb_dlink_node lnode;
+	struct Server *serv;	/* ...defined, if this is a server */
+
+	rb_dlink_list whowas_clist;
 
-	/* client->name is the unique name for a client nick or host */
-	const char *name;
 	char *certfp;
-	/* 
+	/*
+	 * The strings below are shared between clients through intern_add(),
+	 * so they must only be changed with the set_client_*() functions.
+	 *
 	 * client->username is the username from ident or the USER message, 
 	 * If the client is idented the USER message is ignored, otherwise 
 	 * the username part of the USER message is put here prefixed with a 
 	 * tilde depending on the I:line, Once a client has registered, this
 	 * field should be considered read-only.
 	 */
-	char username[USERLEN + 1];	/* client's username */
+	const char *username;	/* client's username */
 	/*
 	 * client->host contains the resolved name or ip address
 	 * as a string for the user, it may be fiddled with for oper spoofing etc.
 	 * once it's changed the *real* address goes away. This should be
 	 * considered a read-only field after the client has registered.
 	 */
-	char host[HOSTLEN + 1];	/* client's hostname */
-	char sockhost[HOSTIPLEN + 1];	/* clients ip */
-	char info[REALLEN + 1];	/* Free form additional client info */
+	const char *host;	/* client's hostname */
+	const char *sockhost;	/* clients ip */
+	const char *info;	/* Free form additional client info */
 
 	char id[IDLEN + 1];	/* UID/SID, unique on the network */
+	unsigned int whoslot;	/* index into the who index + 1, 0 if none */
 
 	/* list of who has this client on their allow list, its counterpart
 	 * is in LocalUser
 	 */
 	rb_dlink_list on_allow_list;
-
-
-	struct LocalUser *localClient;
 };
 
 struct _ssl_ctl;
+struct serv_capgroup;
 
 struct LocalUser
 {
 	rb_dlink_node tnode;	/* This is the node for the local list type the client is on */
+	rb_dlink_node capnode;	/* node in capgroup->servers, servers only */
+	struct serv_capgroup *capgroup;	/* servers linked with our capabs, see send.c */
+	unsigned int slot;	/* index into local_sweep, see client.h */
 	rb_fde_t *F;
 	uint32_t connid;
 	uint32_t caps;
@@ -141,9 +150,6 @@ struct LocalUser
 	unsigned int number_of_nick_changes;
 	unsigned int cork_count;
 
-	time_t lasttime;	/* last time we parsed something */
-	time_t firsttime;	/* time client was created */
-
 	unsigned long serial;	/* used to enforce 1 send per nick */
 
 
@@ -167,20 +173,16 @@ struct LocalUser
 
 	/* nicknames theyre monitoring */
 	rb_dlink_list monitor_list;
+	struct monitor_batch *monitor_batch;	/* replies being built by monitor_flush() */
 
 	rb_dlink_list invited;	/* chain of invite pointer blocks */
 
 
 
 	/*
-	 * Anti-flood stuff. We track how many messages were parsed and how
-	 * many we were allowed in the current second, and apply a simple decay
-	 * to avoid flooding.
-	 *   -- adrian
+	 * Anti-flood counters and the last/first activity times live in
+	 * local_sweep, indexed by slot above.
 	 */
-	unsigned int allow_read;/* how many we're allowed to read in this second */
-	int actually_read;	/* how many we've actually read in this second */
-	int sent_parsed;	/* how many messages we've parsed in this second */
 
 	int join_leave_count;	/* count of JOIN/LEAVE in less than 
 				   MIN_JOIN_LEAVE_TIME seconds */
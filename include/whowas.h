@@ -26,23 +26,21 @@
 #ifndef INCLUDED_whowas_h
 #define INCLUDED_whowas_h
 
-struct whowas_top;
-
 typedef struct _whowas
 {
-        struct whowas_top *wtop;
-        rb_dlink_node wnode;		/* for the wtop linked list */
 	rb_dlink_node cnode;		/* node for online clients */
-	rb_dlink_node whowas_node;	/* node for the whowas linked list */
-	char name[NICKLEN+1];
-        char username[USERLEN + 1];
-        char hostname[HOSTLEN + 1];
-        const char *servername;
-        char realname[REALLEN + 1];
-        char sockhost[HOSTIPLEN + 1];
-        bool spoof;
-        time_t logoff;
-        struct Client *online; 	
+	struct Client *online;
+	const char *username;		/* interned, see intern_add() */
+	const char *hostname;
+	const char *realname;
+	const char *sockhost;
+	const char *servername;
+	time_t logoff;
+	uint32_t hashv;			/* hash_irccase() of name */
+	uint32_t older;			/* ring positions of the records either */
+	uint32_t newer;			/* side of this one for the same nick */
+	bool spoof;
+	char name[NICKLEN + 1];
 } whowas_t;
 
 
@@ -78,7 +76,13 @@ void whowas_off_history(struct Client *);
 struct Client *whowas_get_history(const char *, time_t);
 					/* Nick name */
 					/* Time limit in seconds */
-rb_dlink_list *whowas_get_list(const char *name);
+
+/*
+** whowas_get_first, whowas_get_next
+**	Walk the history of a nickname, newest first.
+*/
+whowas_t *whowas_get_first(const char *name);
+whowas_t *whowas_get_next(whowas_t *);
 
 
 void whowas_set_size(int whowas_length);
@@ -483,12 +483,20 @@ ms_sjoin(struct Client *client_p, struct Client *source_p, int parc, const char
 	int len;
 	int joins = 0;
 	const char *s;
+	const char *id;
 	char *ptr_nick;
 	char *ptr_uid;
 	char *p;
 	int i;
 	static char empty[] = "";
 	int pargs;
+	static struct
+	{
+		struct Client *client_p;
+		int flags;
+	} members[IRCD_BUFSIZE / 2];
+	int nmembers = 0;
+	int k;
 
 	/* I dont trust servers *not* to end up sending us a blank sjoin, so
 	 * its better not to make a big deal about it. --fl
@@ -566,6 +574,8 @@ ms_sjoin(struct Client *client_p, struct Client *source_p, int parc, const char
 	if((chptr = get_or_create_channel(source_p, parv[2], &isnew)) == NULL)
 		return 0;	/* channel name too long? */
 
+	/* everything our members see from here on goes out in one write */
+	cork_channel_local(chptr);
 
 	oldts = chptr->channelts;
 	oldmode = &chptr->mode;
@@ -644,17 +654,15 @@ ms_sjoin(struct Client *client_p, struct Client *source_p, int parc, const char
 
 	*mbuf++ = '+';
 
-	/* if theres a space, theres going to be more than one nick, change the
-	 * first space to \0, so s is just the first nick, and point p to the
-	 * second nick
+	/* resolve the whole member list first.  a nick we don't know or
+	 * that comes from the wrong direction is skipped, an empty one
+	 * (a trailing or double space) ends the list.
 	 */
-	if((p = strchr(s, ' ')) != NULL)
+	while(s != NULL && *s != '\0')
 	{
-		*p++ = '\0';
-	}
+		if((p = strchr(s, ' ')) != NULL)
+			*p++ = '\0';
 
-	while(s)
-	{
 		fl = 0;
 
 		for(i = 0; i < 2; i++)
@@ -671,12 +679,22 @@ ms_sjoin(struct Client *client_p, struct Client *source_p, int parc, const char
 			}
 		}
 
-		/* if the client doesnt exist or is fake direction, skip. */
-		if(!(target_p = find_client(s)) ||
-		   (target_p->from != client_p) || !IsClient(target_p))
-			goto nextnick;
+		if((target_p = find_client(s)) != NULL &&
+		   target_p->from == client_p && IsClient(target_p))
+		{
+			members[nmembers].client_p = target_p;
+			members[nmembers].flags = fl;
+			nmembers++;
+		}
 
-		/* we assume for these we can fit at least one nick/uid in.. */
+		s = p;
+	}
+
+	/* then join them all, building the SJOINs to pass on as we go */
+	for(k = 0; k < nmembers; k++)
+	{
+		target_p = members[k].client_p;
+		fl = members[k].flags;
 
 		/* check we can fit another status+nick+space into a buffer */
 		if((mlen_nick + len_nick + NICKLEN + 3) > (IRCD_BUFSIZE - 3))
@@ -714,10 +732,16 @@ ms_sjoin(struct Client *client_p, struct Client *source_p, int parc, const char
 		}
 
 		/* copy the nick to the two buffers */
-		len = sprintf(ptr_nick, "%s ", target_p->name);
+		len = strlen(target_p->name);
+		memcpy(ptr_nick, target_p->name, len);
+		ptr_nick[len++] = ' ';
 		ptr_nick += len;
 		len_nick += len;
-		len = sprintf(ptr_uid, "%s ", use_id(target_p));
+
+		id = use_id(target_p);
+		len = strlen(id);
+		memcpy(ptr_uid, id, len);
+		ptr_uid[len++] = ' ';
 		ptr_uid += len;
 		len_uid += len;
 
@@ -727,6 +751,7 @@ ms_sjoin(struct Client *client_p, struct Client *source_p, int parc, const char
 				fl = CHFL_DEOPPED;
 			else
 				fl = 0;
+			members[k].flags = fl;
 		}
 
 		if(!IsMember(target_p, chptr))
@@ -737,6 +762,13 @@ ms_sjoin(struct Client *client_p, struct Client *source_p, int parc, const char
 					     target_p->username, target_p->host, parv[2]);
 			joins++;
 		}
+	}
+
+	/* and last, the modes they came with */
+	for(k = 0; k < nmembers; k++)
+	{
+		target_p = members[k].client_p;
+		fl = members[k].flags;
 
 		if(fl & CHFL_CHANOP)
 		{
@@ -786,26 +818,6 @@ ms_sjoin(struct Client *client_p, struct Client *source_p, int parc, const char
 			para[0] = para[1] = para[2] = para[3] = NULL;
 			pargs = 0;
 		}
-
-	      nextnick:
-		/* p points to the next nick */
-		s = p;
-
-		/* if there was a trailing space and p was pointing to it, then we
-		 * need to exit.. this has the side effect of breaking double spaces
-		 * in an sjoin.. but that shouldnt happen anyway
-		 */
-		if(s && (*s == '\0'))
-			s = p = NULL;
-
-		/* if p was NULL due to no spaces, s wont exist due to the above, so
-		 * we cant check it for spaces.. if there are no spaces, then when
-		 * we next get here, s will be NULL
-		 */
-		if(s && ((p = strchr(s, ' ')) != NULL))
-		{
-			*p++ = '\0';
-		}
 	}
 
 	*mbuf = '\0';
@@ -820,6 +832,8 @@ ms_sjoin(struct Client *client_p, struct Client *source_p, int parc, const char
 
 	if(!joins)
 	{
+		uncork_channel_local(chptr);
+
 		if(isnew)
 			destroy_channel(chptr);
 
@@ -852,6 +866,7 @@ ms_sjoin(struct Client *client_p, struct Client *source_p, int parc, const char
 		chptr->ban_serial++;
 	}
 
+	uncork_channel_local(chptr);
 
 	return 0;
 }
@@ -957,8 +972,8 @@ can_join(struct Client *source_p, struct Channel *chptr, char *key)
 			RB_DLINK_FOREACH(ptr, chptr->invexlist.head)
 			{
 				invex = ptr->data;
-				if(match(invex->banstr, src_host)
-				   || match(invex->banstr, src_iphost)
+				if(match_compiled(invex->mask, src_host)
+				   || match_compiled(invex->mask, src_iphost)
 				   || match_cidr(invex->banstr, src_iphost))
 					break;
 			}
@@ -1132,6 +1147,8 @@ remove_our_modes(struct Channel *chptr)
 	mbuf = lmodebuf;
 	*mbuf++ = '-';
 
+	invalidate_names_cache(chptr);
+
 	for(i = 0; i < MAXMODEPARAMS; i++)
 		lpara[i] = NULL;
 
@@ -1262,7 +1279,9 @@ remove_ban_list(struct Channel *chptr, struct Client *source_p,
 
 		*mbuf++ = c;
 		cur_len += plen;
-		pbuf += sprintf(pbuf, "%s ", banptr->banstr);
+		memcpy(pbuf, banptr->banstr, plen - 2);
+		pbuf += plen - 2;
+		*pbuf++ = ' ';
 		count++;
 
 		free_ban(banptr);
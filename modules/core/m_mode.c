@@ -357,7 +357,9 @@ ms_bmask(struct Client *client_p, struct Client *source_p, int parc, const char
 			}
 
 			*mbuf++ = parv[3][0];
-			arglen = sprintf(pbuf, "%s ", s);
+			memcpy(pbuf, s, tlen);
+			pbuf[tlen] = ' ';
+			arglen = tlen + 1;
 			pbuf += arglen;
 			plen += arglen;
 			modecount++;
@@ -430,15 +432,8 @@ add_id(struct Client *source_p, struct Channel *chptr, const char *banid,
 		}
 	}
 	/* dont let remotes set duplicates */
-	else
-	{
-		RB_DLINK_FOREACH(ptr, list->head)
-		{
-			actualBan = ptr->data;
-			if(!irccmp(actualBan->banstr, realban))
-				return 0;
-		}
-	}
+	else if(find_channel_ban(list, realban) != NULL)
+		return 0;
 
 
 	if(IsClient(source_p))
@@ -449,7 +444,7 @@ add_id(struct Client *source_p, struct Channel *chptr, const char *banid,
 	actualBan = allocate_ban(realban, who);
 	actualBan->when = rb_current_time();
 
-	rb_dlinkAdd(actualBan, &actualBan->node, list);
+	add_channel_ban(list, actualBan);
 
 	/* invalidate the can_send() cache */
 	if(mode_type == CHFL_BAN || mode_type == CHFL_EXCEPTION)
@@ -467,29 +462,21 @@ add_id(struct Client *source_p, struct Channel *chptr, const char *banid,
 static int
 del_id(struct Channel *chptr, const char *banid, rb_dlink_list * list, long mode_type)
 {
-	rb_dlink_node *ptr;
+	struct Ban *banptr;
 
 	if(EmptyString(banid))
 		return 0;
 
-	RB_DLINK_FOREACH(ptr, list->head)
-	{
-		struct Ban *banptr = ptr->data;
-
-		if(irccmp(banid, banptr->banstr) == 0)
-		{
-			rb_dlinkDelete(&banptr->node, list);
-			free_ban(banptr);
+	if((banptr = find_channel_ban(list, banid)) == NULL)
+		return 0;
 
-			/* invalidate the can_send() cache */
-			if(mode_type == CHFL_BAN || mode_type == CHFL_EXCEPTION)
-				chptr->ban_serial++;
+	del_channel_ban(list, banptr);
 
-			return 1;
-		}
-	}
+	/* invalidate the can_send() cache */
+	if(mode_type == CHFL_BAN || mode_type == CHFL_EXCEPTION)
+		chptr->ban_serial++;
 
-	return 0;
+	return 1;
 }
 
 /* check_string()
@@ -997,6 +984,7 @@ chm_op(struct Client *source_p, struct Channel *chptr,
 
 		mstptr->flags |= CHFL_CHANOP;
 		mstptr->flags &= ~CHFL_DEOPPED;
+		invalidate_names_cache(chptr);
 	}
 	else
 	{
@@ -1021,6 +1009,7 @@ chm_op(struct Client *source_p, struct Channel *chptr,
 		if(mstptr->flags & CHFL_CHANOP)
 		          rb_dlinkMoveNode(&mstptr->channode, &chptr->members[MEMBER_OP], &chptr->members[MEMBER_NOOP]);      
 		mstptr->flags &= ~CHFL_CHANOP;
+		invalidate_names_cache(chptr);
 	}
 }
 
@@ -1085,6 +1074,7 @@ chm_voice(struct Client *source_p, struct Channel *chptr,
 		mode_changes[mode_count++].client = targ_p;
 
 		mstptr->flags |= CHFL_VOICE;
+		invalidate_names_cache(chptr);
 	}
 	else
 	{
@@ -1098,6 +1088,7 @@ chm_voice(struct Client *source_p, struct Channel *chptr,
 		mode_changes[mode_count++].client = targ_p;
 
 		mstptr->flags &= ~CHFL_VOICE;
+		invalidate_names_cache(chptr);
 	}
 }
 
@@ -166,7 +166,10 @@ mr_nick(struct Client *client_p, struct Client *source_p, int parc, const char *
 	if((target_p = find_client(nick)) == NULL)
 		set_initial_nick(client_p, source_p, nick);
 	else if(source_p == target_p)
+	{
 		strcpy(source_p->user->name, nick);
+		who_index_update(source_p);
+	}
 	else
 		sendto_one_numeric(source_p, s_RPL(ERR_NICKNAMEINUSE), nick);
 
@@ -636,6 +639,7 @@ set_initial_nick(struct Client *client_p, struct Client *source_p, char *nick)
 	strcpy(source_p->user->name, nick);
 	source_p->name = source_p->user->name;
 	hash_add(HASH_CLIENT, nick, source_p);
+	who_index_update(source_p);
 
 	snprintf(note, sizeof(note), "Nick: %s", nick);
 	rb_note(client_p->localClient->F, note);
@@ -653,7 +657,6 @@ set_initial_nick(struct Client *client_p, struct Client *source_p, char *nick)
 static void
 change_local_nick(struct Client *client_p, struct Client *source_p, char *nick, int dosend)
 {
-	rb_dlink_node *ptr, *next_ptr;
 	char note[NICKLEN + 10];
 	int samenick;
 
@@ -718,6 +721,8 @@ change_local_nick(struct Client *client_p, struct Client *source_p, char *nick,
 	hash_del(HASH_CLIENT, source_p->name, source_p);
 	strcpy(source_p->user->name, nick);
 	hash_add(HASH_CLIENT, nick, source_p);
+	invalidate_names_cache_user(source_p);
+	who_index_update(source_p);
 
 	if(!samenick)
 		monitor_signon(source_p);
@@ -726,13 +731,7 @@ change_local_nick(struct Client *client_p, struct Client *source_p, char *nick,
 	 * to clear a clients own list of accepted clients.  So just remove
 	 * them from everyone elses list --anfl
 	 */
-	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, source_p->on_allow_list.head)
-	{
-		struct Client *target_p = ptr->data;
-
-		rb_dlinkFindDestroy(source_p, &target_p->localClient->allow_list);
-		rb_dlinkDestroy(ptr, &source_p->on_allow_list);
-	}
+	del_on_accepts(source_p);
 
 	snprintf(note, sizeof(note), "Nick: %s", nick);
 	rb_note(client_p->localClient->F, note);
@@ -780,6 +779,8 @@ change_remote_nick(struct Client *client_p, struct Client *source_p,
 	                        
 	strcpy(source_p->user->name, nick);
 	hash_add(HASH_CLIENT, nick, source_p);
+	invalidate_names_cache_user(source_p);
+	who_index_update(source_p);
 
 	if(!samenick)
 		monitor_signon(source_p);
@@ -1102,19 +1103,19 @@ register_client(struct Client *client_p, struct Client *server,
 
 	strcpy(source_p->user->name, nick);
 	source_p->name = source_p->user->name;
-	rb_strlcpy(source_p->username, parv[5], sizeof(source_p->username));
-	rb_strlcpy(source_p->host, parv[6], sizeof(source_p->host));
+	set_client_username(source_p, parv[5]);
+	set_client_host(source_p, parv[6]);
 
 	if(parc == 10)
 	{
-		rb_strlcpy(source_p->info, parv[9], sizeof(source_p->info));
-		rb_strlcpy(source_p->sockhost, parv[7], sizeof(source_p->sockhost));
+		set_client_info(source_p, parv[9]);
+		set_client_sockhost(source_p, parv[7]);
 		rb_strlcpy(source_p->id, parv[8], sizeof(source_p->id));
 		hash_add(HASH_ID, source_p->id, source_p);
 	}
 	else
 	{
-		rb_strlcpy(source_p->info, parv[8], sizeof(source_p->info));
+		set_client_info(source_p, parv[8]);
 
 		if((server = find_server(NULL, parv[7])) == NULL)
 		{
@@ -125,7 +125,7 @@ part_one_client(struct Client *client_p, struct Client *source_p, char *name, ch
 	 */
 	if(!EmptyString(reason) && (is_chanop(msptr) || !MyConnect(source_p) ||
 				    ((can_send(chptr, source_p, msptr) > 0 &&
-				      (source_p->localClient->firsttime +
+				      (LocalFirstTime(source_p) +
 				       ConfigFileEntry.anti_spam_exit_message_time) <
 				      rb_current_time()))))
 	{
@@ -640,13 +640,13 @@ set_server_gecos(struct Client *client_p, const char *info)
 			/* if there was a trailing space, s could point to \0, so check */
 			if(s && (*s != '\0'))
 			{
-				rb_strlcpy(client_p->info, s, sizeof(client_p->info));
+				set_client_info(client_p, s);
 				return 1;
 			}
 		}
 	}
 
-	rb_strlcpy(client_p->info, "(Unknown Location)", sizeof(client_p->info));
+	set_client_info(client_p, "(Unknown Location)");
 
 	return 1;
 }
@@ -938,8 +938,11 @@ burst_TS5(struct Client *client_p)
 		if(ConfigFileEntry.burst_away && !EmptyString(target_p->user->away))
 			sendto_one(client_p, ":%s AWAY :%s", target_p->name, target_p->user->away);
 
-		hclientinfo.target = target_p;
-		call_hook(h_burst_client, &hclientinfo);
+		if(hook_has_subscribers(h_burst_client))
+		{
+			hclientinfo.target = target_p;
+			call_hook(h_burst_client, &hclientinfo);
+		}
 	}
 
 	RB_DLINK_FOREACH(ptr, global_channel_list.head)
@@ -1006,8 +1009,11 @@ burst_TS5(struct Client *client_p)
 				   ConfigChannel.burst_topicwho ? chptr->topic->topic_info : "",
 				   ConfigChannel.burst_topicwho ? " " : "", chptr->topic->topic);
 
-		hchaninfo.chptr = chptr;
-		call_hook(h_burst_channel, &hchaninfo);
+		if(hook_has_subscribers(h_burst_channel))
+		{
+			hchaninfo.chptr = chptr;
+			call_hook(h_burst_channel, &hchaninfo);
+		}
 	}
 
 	hclientinfo.target = NULL;
@@ -1072,8 +1078,11 @@ burst_TS6(struct Client *client_p)
 			sendto_one(client_p, ":%s AWAY :%s",
 				   use_id(target_p), target_p->user->away);
 
-		hclientinfo.target = target_p;
-		call_hook(h_burst_client, &hclientinfo);
+		if(hook_has_subscribers(h_burst_client))
+		{
+			hclientinfo.target = target_p;
+			call_hook(h_burst_client, &hclientinfo);
+		}
 	}
 
 	RB_DLINK_FOREACH(ptr, global_channel_list.head)
@@ -1139,8 +1148,11 @@ burst_TS6(struct Client *client_p)
 				   ConfigChannel.burst_topicwho ? chptr->topic->topic_info : "",
 				   ConfigChannel.burst_topicwho ? " " : "", chptr->topic->topic);
 
-		hchaninfo.chptr = chptr;
-		call_hook(h_burst_channel, &hchaninfo);
+		if(hook_has_subscribers(h_burst_channel))
+		{
+			hchaninfo.chptr = chptr;
+			call_hook(h_burst_channel, &hchaninfo);
+		}
 	}
 
 	hclientinfo.target = NULL;
@@ -1280,7 +1292,7 @@ server_estab(struct Client *client_p)
 
 	/* add it to scache */
 	scache_add(client_p->name);
-	client_p->localClient->firsttime = rb_current_time();
+	LocalFirstTime(client_p) = rb_current_time();
 	/* fixing eob timings.. -gnp */
 
 	/* Show the real host/IP to admins */
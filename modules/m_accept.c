@@ -38,7 +38,6 @@
 static int m_accept(struct Client *, struct Client *, int, const char **);
 static void build_nicklist(struct Client *, char *, char *, const char *);
 
-static void add_accept(struct Client *, struct Client *);
 static void list_accepts(struct Client *);
 
 
@@ -98,8 +97,7 @@ m_accept(struct Client *client_p, struct Client *source_p, int parc, const char
 			continue;
 		}
 
-		rb_dlinkFindDestroy(target_p, &source_p->localClient->allow_list);
-		rb_dlinkFindDestroy(source_p, &target_p->on_allow_list);
+		del_accept(source_p, target_p);
 
 	}
 
@@ -201,22 +199,6 @@ build_nicklist(struct Client *source_p, char *addbuf, char *delbuf, const char *
 	}
 }
 
-/*
- * add_accept()
- *
- * input	- pointer to clients accept list to add to
- *		- pointer to client to add
- * output	- none
- * side effects - target is added to clients list
- */
-static void
-add_accept(struct Client *source_p, struct Client *target_p)
-{
-	rb_dlinkAddAlloc(target_p, &source_p->localClient->allow_list);
-	rb_dlinkAddAlloc(source_p, &target_p->on_allow_list);
-}
-
-
 /*
  * list_accepts()
  *
@@ -122,9 +122,9 @@ static void
 dohelp(struct Client *source_p, int flags, const char *topic)
 {
 	static const char ntopic[] = "index";
+	char lead[CACHEFILELEN + 2];
 	struct cachefile *hptr;
 	struct cacheline *lineptr;
-	rb_dlink_node *ptr;
 	rb_dlink_node *fptr;
 	hash_f *htype = HASH_HELP; 
 	if(EmptyString(topic))
@@ -148,11 +148,8 @@ dohelp(struct Client *source_p, int flags, const char *topic)
 	/* first line cant be empty */
 	sendto_one_numeric(source_p, s_RPL(RPL_HELPSTART), topic, lineptr->data);
 
-	RB_DLINK_FOREACH(ptr, fptr->next)
-	{
-		lineptr = ptr->data;
-		sendto_one_numeric(source_p, s_RPL(RPL_HELPTXT), topic, lineptr->data);
-	}
+	snprintf(lead, sizeof(lead), "%s :", topic);
+	send_cache_lines(source_p, RPL_HELPTXT, lead, fptr->next);
 	ClearCork(source_p);
 	sendto_one_numeric(source_p, s_RPL(RPL_ENDOFHELP), topic);
 }
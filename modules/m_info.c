@@ -452,6 +452,24 @@ static struct InfoStruct info_table[] = {
 		{ &ConfigFileEntry.fname_ioerrorlog }, 
 		"IO error log file"
 	},
+	{
+		"log_threaded",
+		OUTPUT_BOOLEAN_YN,
+		{ &ConfigFileEntry.log_threaded },
+		"Write logfiles from a background thread"
+	},
+	{
+		"log_buffer_lines",
+		OUTPUT_DECIMAL,
+		{ &ConfigFileEntry.log_buffer_lines },
+		"Lines buffered for the log writer thread"
+	},
+	{
+		"log_overflow_block",
+		OUTPUT_BOOLEAN_YN,
+		{ &ConfigFileEntry.log_overflow_block },
+		"Block rather than drop when the log buffer is full"
+	},
 	{
 		"glines",
 		OUTPUT_BOOLEAN,
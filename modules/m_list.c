@@ -53,12 +53,59 @@ struct Message list_msgtab = {
 
 mapi_clist_av1 list_clist[] = { &list_msgtab, NULL };
 
-DECLARE_MODULE_AV1(list, NULL, NULL, list_clist, NULL, NULL, "$Revision$");
+static int modinit(void);
+static void moddeinit(void);
 
+DECLARE_MODULE_AV1(list, modinit, moddeinit, list_clist, NULL, NULL, "$Revision$");
+
+/* a LIST in progress, picked up again once a second until the client
+ * has been sent every channel.  the client is looked up by connid each
+ * time, so nothing needs telling when it goes away.
+ */
+struct list_stream
+{
+	rb_dlink_node node;
+	uint32_t connid;
+	struct channel_cursor cursor;
+	int limited;
+	unsigned long max;
+	unsigned int min;
+	time_t cmintime, cmaxtime;
+	time_t tmintime, tmaxtime;
+};
+
+static rb_dlink_list list_streams;
+static rb_ev_entry *list_stream_ev;
+
+static void list_stream_event(void *unused);
 static void list_all_channels(struct Client *source_p);
 static void list_limit_channels(struct Client *source_p, const char *param);
 static void list_named_channel(struct Client *source_p, const char *name);
 
+static int
+modinit(void)
+{
+	list_stream_ev = rb_event_add("list_stream", list_stream_event, NULL, 1);
+	return 0;
+}
+
+static void
+moddeinit(void)
+{
+	rb_dlink_node *ptr, *next_ptr;
+
+	rb_event_delete(list_stream_ev);
+
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, list_streams.head)
+	{
+		struct list_stream *ls = ptr->data;
+
+		del_channel_cursor(&ls->cursor);
+		rb_dlinkDelete(&ls->node, &list_streams);
+		rb_free(ls);
+	}
+}
+
 /* m_list()
  *	parv[0] = sender prefix
  *	parv[1] = channel
@@ -110,39 +157,88 @@ mo_list(struct Client *client_p, struct Client *source_p, int parc, const char *
 	return 0;
 }
 
-/* list_all_channels()
+/* list_stream_find()
  *
- * inputs	- pointer to client requesting list
- * output	-
- * side effects	- list all channels to source_p
+ * inputs	- client
+ * outputs	- the LIST the client has in progress, NULL if none
+ * side effects -
  */
-static void
-list_all_channels(struct Client *source_p)
+static struct list_stream *
+list_stream_find(struct Client *source_p)
 {
 	rb_dlink_node *ptr;
+
+	RB_DLINK_FOREACH(ptr, list_streams.head)
+	{
+		struct list_stream *ls = ptr->data;
+
+		if(ls->connid == source_p->localClient->connid)
+			return ls;
+	}
+	return NULL;
+}
+
+static void
+list_stream_free(struct list_stream *ls)
+{
+	del_channel_cursor(&ls->cursor);
+	rb_dlinkDelete(&ls->node, &list_streams);
+	rb_free(ls);
+}
+
+/* list_stream_send()
+ *
+ * inputs	- client, its LIST in progress
+ * outputs	- 1 if every channel has been sent, 0 if there are more
+ * side effects - sends channels until half the client's sendq is
+ *		  queued, flushing every 10 lines
+ */
+static int
+list_stream_send(struct Client *source_p, struct list_stream *ls)
+{
+	struct Channel *chptr;
 	long sendq_limit;
 	int count = 0;
-	/* give them an output limit of 90% of their sendq. --fl */
-	sendq_limit = get_sendq(source_p);
-	sendq_limit /= 10;
-	sendq_limit *= 9;
 
-	sendto_one_numeric(source_p, s_RPL(RPL_LISTSTART));
+	sendq_limit = get_sendq(source_p) / 2;
+
 	SetCork(source_p);
 
-	RB_DLINK_FOREACH(ptr, global_channel_list.head)
+	while(rb_linebuf_len(source_p->localClient->buf_sendq) < sendq_limit)
 	{
-		struct Channel *chptr = ptr->data;
+		if((chptr = channel_cursor_next(&ls->cursor)) == NULL)
+		{
+			ClearCork(source_p);
+			send_pop_queue(source_p);
+			return 1;
+		}
 
-		/* if theyre overflowing their sendq, stop. --fl */
-		if(rb_linebuf_len(source_p->localClient->buf_sendq) > sendq_limit)
+		if(ls->limited)
 		{
-			sendto_one_numeric(source_p, s_RPL(ERR_TOOMANYMATCHES), "LIST");
-			break;
+			if(chan_member_count(chptr) >= ls->max ||
+			   chan_member_count(chptr) <= ls->min)
+				continue;
+
+			if(ls->cmintime > 0 && chptr->channelts < ls->cmintime)
+				continue;
+
+			if(ls->cmaxtime > 0 && chptr->channelts > ls->cmaxtime)
+				continue;
+
+			if(ls->tmintime > 0 || ls->tmaxtime > 0)
+			{
+				if(chptr->topic == NULL)
+					continue;
+				if(ls->tmintime > 0 && chptr->topic->topic_time < ls->tmintime)
+					continue;
+				if(ls->tmaxtime > 0 && chptr->topic->topic_time > ls->tmaxtime)
+					continue;
+			}
 		}
 
 		if(SecretChannel(chptr) && !IsMember(source_p, chptr))
 			continue;
+
 		sendto_one_numeric(source_p, s_RPL(RPL_LIST), chptr->chname,
 				   chan_member_count(chptr),
 				   chptr->topic == NULL ? "" : chptr->topic->topic);
@@ -155,28 +251,105 @@ list_all_channels(struct Client *source_p)
 			count = 0;
 		}
 	}
+
 	ClearCork(source_p);
-	sendto_one_numeric(source_p, s_RPL(RPL_LISTEND));
-	return;
+	send_pop_queue(source_p);
+	return 0;
+}
+
+/* list_stream_start()
+ *
+ * inputs	- client, LIST to run
+ * outputs	-
+ * side effects - any LIST the client already had running is ended,
+ *		  then as much of this one is sent as fits in its sendq,
+ *		  the rest is left to list_stream_event()
+ */
+static void
+list_stream_start(struct Client *source_p, struct list_stream *ls)
+{
+	struct list_stream *old;
+
+	if((old = list_stream_find(source_p)) != NULL)
+	{
+		list_stream_free(old);
+		sendto_one_numeric(source_p, s_RPL(RPL_LISTEND));
+	}
+
+	ls->connid = source_p->localClient->connid;
+	add_channel_cursor(&ls->cursor);
+	rb_dlinkAdd(ls, &ls->node, &list_streams);
+
+	sendto_one_numeric(source_p, s_RPL(RPL_LISTSTART));
+
+	if(list_stream_send(source_p, ls))
+	{
+		list_stream_free(ls);
+		sendto_one_numeric(source_p, s_RPL(RPL_LISTEND));
+	}
+}
+
+/* list_stream_event()
+ *
+ * inputs	-
+ * outputs	-
+ * side effects - carries on every LIST in progress whose client has
+ *		  drained below half its sendq, forgets those whose client
+ *		  has gone
+ */
+static void
+list_stream_event(void *unused)
+{
+	rb_dlink_node *ptr, *next_ptr;
+	struct Client *source_p;
+
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, list_streams.head)
+	{
+		struct list_stream *ls = ptr->data;
+
+		if((source_p = find_connid(ls->connid)) == NULL)
+		{
+			list_stream_free(ls);
+			continue;
+		}
+
+		if(list_stream_send(source_p, ls))
+		{
+			list_stream_free(ls);
+			sendto_one_numeric(source_p, s_RPL(RPL_LISTEND));
+		}
+	}
+}
+
+/* list_all_channels()
+ *
+ * inputs	- pointer to client requesting list
+ * output	-
+ * side effects	- starts listing all channels to source_p
+ */
+static void
+list_all_channels(struct Client *source_p)
+{
+	struct list_stream *ls = rb_malloc(sizeof(struct list_stream));
+
+	list_stream_start(source_p, ls);
 }
 
 static void
 list_limit_channels(struct Client *source_p, const char *param)
 {
+	struct list_stream *ls;
 	char *args;
 	char *p;
-	rb_dlink_node *ptr;
-	long sendq_limit;
-	unsigned long max = ULONG_MAX;
-	unsigned int min = 0;
 	unsigned int i;
-	unsigned int count = 0;
 	char *endptr;
-	time_t cmintime = 0, cmaxtime = 0;
-	time_t tmintime = 0, tmaxtime = 0;
 	
 	args = LOCAL_COPY(param);
 
+	ls = rb_malloc(sizeof(struct list_stream));
+	ls->limited = 1;
+	ls->max = ULONG_MAX;
+
 	for(i = 0; i < 2; i++)
 	{
 		if((p = strchr(args, ',')) != NULL)
@@ -188,18 +361,18 @@ list_limit_channels(struct Client *source_p, const char *param)
 			{
 				args++;
 				errno = 0;
-				max = strtoul(args, &endptr, 10);
+				ls->max = strtoul(args, &endptr, 10);
 				if(errno || endptr == args)
-					max = ULONG_MAX;
+					ls->max = ULONG_MAX;
 				break;
 			}
 			case '>':
 			{
 				args++;
 				errno = 0;
-				min = strtoul(args, &endptr, 10);
+				ls->min = strtoul(args, &endptr, 10);
 				if(errno || endptr == args)
-					min = 0;
+					ls->min = 0;
 				break;
 
 			}
@@ -217,9 +390,9 @@ list_limit_channels(struct Client *source_p, const char *param)
 						if(errno || endptr == args) 
 						{
 							mintime = 0;
-							cmintime = 0;
+							ls->cmintime = 0;
                                                 } else {
-  							cmintime = rb_current_time() - mintime;
+  							ls->cmintime = rb_current_time() - mintime;
 						}
 						break;
 						
@@ -231,9 +404,9 @@ list_limit_channels(struct Client *source_p, const char *param)
 						if(errno || endptr == args) 
 						{
 							maxtime = 0;
-							cmaxtime = 0;
+							ls->cmaxtime = 0;
                                                 } else
-							cmaxtime = rb_current_time() - maxtime;
+							ls->cmaxtime = rb_current_time() - maxtime;
 						break;
 					}
 					default:
@@ -256,9 +429,9 @@ list_limit_channels(struct Client *source_p, const char *param)
 						if(errno || endptr == args) 
 						{
 							mintime = 0;
-							tmintime = 0;
+							ls->tmintime = 0;
                                                 } else {
-  							tmintime = rb_current_time() - mintime;
+  							ls->tmintime = rb_current_time() - mintime;
 						}
 						break;
 						
@@ -270,9 +443,9 @@ list_limit_channels(struct Client *source_p, const char *param)
 						if(errno || endptr == args) 
 						{
 							maxtime = 0;
-							tmaxtime = 0;
+							ls->tmaxtime = 0;
                                                 } else
-							tmaxtime = rb_current_time() - maxtime;
+							ls->tmaxtime = rb_current_time() - maxtime;
 						break;
 					}
 					default:
@@ -294,63 +467,7 @@ list_limit_channels(struct Client *source_p, const char *param)
 			args = p;
 	}
 
-	/* give them an output limit of 90% of their sendq. --fl */
-	sendq_limit = get_sendq(source_p);
-	sendq_limit /= 10;
-	sendq_limit *= 9;
-
-	sendto_one_numeric(source_p, s_RPL(RPL_LISTSTART));
-	SetCork(source_p);
-
-	RB_DLINK_FOREACH(ptr, global_channel_list.head)
-	{
-		struct Channel *chptr = ptr->data;
-
-		/* if theyre overflowing their sendq, stop. --fl */
-		if(rb_linebuf_len(source_p->localClient->buf_sendq) > sendq_limit)
-		{
-			sendto_one_numeric(source_p, s_RPL(ERR_TOOMANYMATCHES), "LIST");
-			break;
-		}
-
-		if(chan_member_count(chptr) >= max ||
-		   chan_member_count(chptr) <= min)
-			continue;
-
-		if(cmintime > 0 && chptr->channelts < cmintime)
-			continue;
-			
-		if(cmaxtime > 0 && chptr->channelts > cmaxtime)
-			continue;
-
-                if(tmintime > 0 || tmaxtime > 0)
-                {
-			if(chptr->topic == NULL)
-				continue;
-	                if(tmintime > 0 && chptr->topic->topic_time < tmintime)
-        	        	continue;
-			if(tmaxtime > 0 && chptr->topic->topic_time > tmaxtime)
-				continue;
-		}
-
-		if(SecretChannel(chptr) && !IsMember(source_p, chptr))
-			continue;
-
-		sendto_one_numeric(source_p, s_RPL(RPL_LIST), chptr->chname,
-				   chan_member_count(chptr),
-				   chptr->topic == NULL ? "" : chptr->topic->topic);
-
-		if(count++ >= 10)
-		{
-			ClearCork(source_p);
-			send_pop_queue(source_p);
-			SetCork(source_p);
-			count = 0;
-		}
-	}
-	ClearCork(source_p);
-	sendto_one_numeric(source_p, s_RPL(RPL_LISTEND));
-	return;
+	list_stream_start(source_p, ls);
 }
 
 
@@ -125,12 +125,9 @@ add_monitor(struct Client *client_p, const char *nicks)
 		monptr = find_monitor(name, true);
 
 		/* already monitoring this nick */
-		if(rb_dlinkFind(client_p, &monptr->users) != NULL)
+		if(!add_monitor_client(monptr, client_p))
 			continue;
 
-		rb_dlinkAddAlloc(client_p, &monptr->users);
-		rb_dlinkAddAlloc(monptr, &client_p->localClient->monitor_list);
-
 		if((target_p = find_named_person(name)) != NULL)
 		{
 			if(cur_onlen + strlen(target_p->name) +
@@ -199,8 +196,7 @@ del_monitor(struct Client *client_p, const char *nicks)
 		if((monptr = find_monitor(name, false)) == NULL)
 			continue;
 
-		rb_dlinkFindDestroy(client_p, &monptr->users);
-		rb_dlinkFindDestroy(monptr, &client_p->localClient->monitor_list);
+		del_monitor_client(monptr, client_p);
 		free_monitor(monptr);
 	}
 }
@@ -268,7 +264,10 @@ show_monitor_status(struct Client *client_p)
 		struct monitor *monptr = ptr->data;
 		struct Client *target_p;
 
-		if((target_p = find_named_person(monptr->name)) != NULL)
+		target_p = find_named_person(monptr->name);
+		monitor_reported(monptr, client_p, target_p);
+
+		if(target_p != NULL)
 		{
 			if(cur_onlen + strlen(target_p->name) +
 			   strlen(target_p->username) + strlen(target_p->host) + 3 >= IRCD_BUFSIZE - 3)
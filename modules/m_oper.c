@@ -38,6 +38,7 @@
 
 #include <struct.h>
 #include <client.h>
+#include <channel.h>
 #include <match.h>
 #include <ircd.h>
 #include <numeric.h>
@@ -275,6 +276,8 @@ oper_up(struct Client *source_p, struct oper_conf *oper_p)
 		++Count.invisi;
 	if((old & UMODE_INVISIBLE) && !IsInvisible(source_p))
 		--Count.invisi;
+	if((old ^ source_p->umodes) & UMODE_INVISIBLE)
+		invalidate_names_cache_user(source_p);
 	send_umode_out(source_p, source_p, old);
 	sendto_one_numeric(source_p, s_RPL(RPL_YOUREOPER));
 	sendto_one_notice(source_p, ":*** Oper privs are %s", get_oper_privs(oper_p->flags));
@@ -92,7 +92,7 @@ ms_pong(struct Client *client_p, struct Client *source_p, int parc, const char *
 					     "End of burst (emulated) from %s (%d seconds)",
 					     source_p->name,
 					     (signed int) (rb_current_time() -
-							   source_p->localClient->firsttime));
+							   LocalFirstTime(source_p)));
 		SetEob(source_p);
 		eob_count++;
 	}
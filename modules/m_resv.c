@@ -318,7 +318,7 @@ parse_resv(struct Client *source_p, const char *name, const char *reason, int te
 		if(locked)
 			aconf->flags |= CONF_FLAGS_LOCKED;
 
-		rb_dlinkAddAlloc(aconf, &resv_nick_list);
+		add_nick_resv(aconf);
 
 		notify_resv(source_p, aconf->host, aconf->passwd, temp_time);
 
@@ -454,7 +454,7 @@ remove_resv(struct Client *source_p, const char *name)
 			bandb_del(BANDB_RESV, aconf->host, NULL);
 
 		/* already have ptr from the loop above.. */
-		rb_dlinkDestroy(ptr, &resv_nick_list);
+		del_nick_resv(ptr);
 		free_conf(aconf);
 	}
 
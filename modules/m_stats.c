@@ -111,6 +111,7 @@ static void stats_glines(struct Client *);
 static void stats_pending_glines(struct Client *);
 static void stats_hubleaf(struct Client *);
 static void stats_auth(struct Client *);
+static void stats_hooks(struct Client *);
 static void stats_tklines(struct Client *);
 static void stats_klines(struct Client *);
 static void stats_messages(struct Client *);
@@ -156,6 +157,7 @@ static struct StatsStruct stats_cmd_table[] = {
 	{'H', stats_hubleaf, 0, 0,},
 	{'i', stats_auth, 0, 0,},
 	{'I', stats_auth, 0, 0,},
+	{'j', stats_hooks, 1, 0,},
 	{'k', stats_tklines, 0, 0,},
 	{'K', stats_klines, 0, 0,},
 	{'l', stats_ltrace, 0, 0,},
@@ -275,6 +277,12 @@ stats_hash(struct Client *source_p)
 	hash_stats(source_p);
 }
 
+static void
+stats_hooks(struct Client *source_p)
+{
+	hook_stats(source_p);
+}
+
 static void
 stats_connect(struct Client *source_p)
 {
@@ -893,7 +901,7 @@ stats_tstats(struct Client *source_p)
 
 		sp.is_sbs += target_p->localClient->sendB;
 		sp.is_sbr += target_p->localClient->receiveB;
-		sp.is_sti += (uint64_t) (rb_current_time() - target_p->localClient->firsttime);
+		sp.is_sti += (uint64_t) (rb_current_time() - LocalFirstTime(target_p));
 		sp.is_sv++;
 	}
 
@@ -903,7 +911,7 @@ stats_tstats(struct Client *source_p)
 
 		sp.is_cbs += target_p->localClient->sendB;
 		sp.is_cbr += target_p->localClient->receiveB;
-		sp.is_cti += (uint64_t) (rb_current_time() - target_p->localClient->firsttime);
+		sp.is_cti += (uint64_t) (rb_current_time() - LocalFirstTime(target_p));
 		sp.is_cl++;
 	}
 
@@ -1046,7 +1054,7 @@ stats_servers(struct Client *source_p)
 		target_p = ptr->data;
 
 		j++;
-		seconds = (rb_current_time() - target_p->localClient->firsttime);
+		seconds = (rb_current_time() - LocalFirstTime(target_p));
 
 		days = seconds / 86400;
 		seconds %= 86400;
@@ -1060,7 +1068,7 @@ stats_servers(struct Client *source_p)
 				   "Connected: %" RBTT_FMT " day%s, %" RBTT_FMT ":%02" RBTT_FMT
 				   ":%02" RBTT_FMT, target_p->name,
 				   (target_p->serv->by[0] ? target_p->serv->by : "Remote."),
-				   (rb_current_time() - target_p->localClient->lasttime),
+				   (rb_current_time() - LocalLastTime(target_p)),
 				   rb_linebuf_len(target_p->localClient->buf_sendq), days,
 				   (days == 1) ? "" : "s", hours, minutes, seconds);
 	}
@@ -1182,12 +1190,20 @@ stats_memory(struct Client *source_p)
 	size_t remote_client_count = 0;
 	size_t remote_client_memory_used = 0;
 
+	size_t intern_count = 0;
+	size_t intern_refs = 0;
+	size_t intern_mem = 0;
+	long intern_saved;
+
 	size_t whowas_memory = 0;
 	size_t whowas_count = 0;
 
 	size_t ohash_count = 0;
 	size_t ohash_mem = 0;
 
+	size_t log_queued, log_size, log_mem;
+	unsigned long log_written, log_dropped;
+
 	size_t total_memory = 0;
 
 
@@ -1331,6 +1347,13 @@ stats_memory(struct Client *source_p)
 			   "z :scache %ld(%ld)",
 			   (long) number_servers_cached, (long) mem_servers_cached);
 
+	log_buffer_usage(&log_queued, &log_size, &log_mem, &log_written, &log_dropped);
+	total_memory += log_mem;
+
+	sendto_one_numeric(source_p, RPL_STATSDEBUG,
+			   "z :Log buffer %zu/%zu(%zu) written %lu dropped %lu",
+			   log_queued, log_size, log_mem, log_written, log_dropped);
+
 	operhash_count(&ohash_count, &ohash_mem);
 	sendto_one_numeric(source_p, RPL_STATSDEBUG,
 			   "z :Operator Hash entries: %zu memory used: %zu", ohash_count, ohash_mem); 
@@ -1356,6 +1379,19 @@ stats_memory(struct Client *source_p)
 			   "z :Remote client Memory in use: %zu(%zu)",
 			   remote_client_count, remote_client_memory_used);
 
+	/* what the shared strings save over every client carrying its own
+	 * username, host, sockhost and info buffers
+	 */
+	count_intern(&intern_count, &intern_refs, &intern_mem);
+	total_memory += intern_mem;
+	intern_saved = (long)((local_client_count + remote_client_count) *
+			      (USERLEN + HOSTLEN + HOSTIPLEN + REALLEN + 4 - 4 * sizeof(char *))) -
+		(long)intern_mem;
+
+	sendto_one_numeric(source_p, RPL_STATSDEBUG,
+			   "z :Client strings %zu(%zu) references %zu saved %ld",
+			   intern_count, intern_mem, intern_refs, intern_saved);
+
 	sendto_one_numeric(source_p, RPL_STATSDEBUG,
 			   "z :TOTAL: %zu Available:  Current max RSS: %" PRIuPTR,
 			   total_memory, get_maxrss());
@@ -1424,11 +1460,10 @@ stats_servlinks(struct Client *source_p)
 			   target_p->name, rb_linebuf_len(target_p->localClient->buf_sendq),
 			   target_p->localClient->sendM, target_p->localClient->sendB / 1024,
 			   target_p->localClient->receiveM, target_p->localClient->receiveB / 1024,
-			   (rb_current_time() - target_p->localClient->firsttime),
+			   (rb_current_time() - LocalFirstTime(target_p)),
 			   ((rb_current_time() >
-			     target_p->localClient->lasttime) ? (rb_current_time() -
-								 target_p->localClient->
-								 lasttime) : 0),
+			     LocalLastTime(target_p)) ? (rb_current_time() -
+								 LocalLastTime(target_p)) : 0),
 			   IsOper(source_p) ? show_capabilities(target_p) : "TS");
 	}
 
@@ -1570,9 +1605,9 @@ stats_l_client(struct Client *source_p, struct Client *target_p, char statchar)
 				   target_p->localClient->sendB / 1024,
 				   target_p->localClient->receiveM,
 				   target_p->localClient->receiveB / 1024,
-				   rb_current_time() - target_p->localClient->firsttime,
-				   (rb_current_time() > target_p->localClient->lasttime) ?
-				   (rb_current_time() - target_p->localClient->lasttime) : 0,
+				   rb_current_time() - LocalFirstTime(target_p),
+				   (rb_current_time() > LocalLastTime(target_p)) ?
+				   (rb_current_time() - LocalLastTime(target_p)) : 0,
 				   IsOper(source_p) ? show_capabilities(target_p) : "-");
 	}
 
@@ -1585,9 +1620,9 @@ stats_l_client(struct Client *source_p, struct Client *target_p, char statchar)
 				   target_p->localClient->sendB / 1024,
 				   target_p->localClient->receiveM,
 				   target_p->localClient->receiveB / 1024,
-				   (rb_current_time() - target_p->localClient->firsttime),
-				   (rb_current_time() > target_p->localClient->lasttime) ?
-				   (rb_current_time() - target_p->localClient->lasttime) : 0, "-");
+				   (rb_current_time() - LocalFirstTime(target_p)),
+				   (rb_current_time() > LocalLastTime(target_p)) ?
+				   (rb_current_time() - LocalLastTime(target_p)) : 0, "-");
 	}
 
 	else
@@ -1601,9 +1636,9 @@ stats_l_client(struct Client *source_p, struct Client *target_p, char statchar)
 				   target_p->localClient->sendB / 1024,
 				   target_p->localClient->receiveM,
 				   target_p->localClient->receiveB / 1024,
-				   rb_current_time() - target_p->localClient->firsttime,
-				   (rb_current_time() > target_p->localClient->lasttime) ?
-				   (rb_current_time() - target_p->localClient->lasttime) : 0, "-");
+				   rb_current_time() - LocalFirstTime(target_p),
+				   (rb_current_time() > LocalLastTime(target_p)) ?
+				   (rb_current_time() - LocalLastTime(target_p)) : 0, "-");
 	}
 }
 
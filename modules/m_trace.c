@@ -420,7 +420,7 @@ report_this_status(struct Client *source_p, struct Client *target_p)
 		sendto_one_numeric(source_p, RPL_TRACEUNKNOWN,
 				   form_str(RPL_TRACEUNKNOWN),
 				   class_name, name, ip,
-				   rb_current_time() - target_p->localClient->firsttime);
+				   rb_current_time() - LocalFirstTime(target_p));
 		cnt++;
 		break;
 
@@ -431,7 +431,7 @@ report_this_status(struct Client *source_p, struct Client *target_p)
 					   IsOper(target_p) ? form_str(RPL_TRACEOPERATOR) :
 					   form_str(RPL_TRACEUSER), class_name, name,
 					   show_ip(source_p, target_p) ? ip : empty_sockhost,
-					   rb_current_time() - target_p->localClient->lasttime,
+					   rb_current_time() - LocalLastTime(target_p),
 					   rb_current_time() - target_p->localClient->last);
 			cnt++;
 		}
@@ -449,7 +449,7 @@ report_this_status(struct Client *source_p, struct Client *target_p)
 					   class_name, servcount, usercount, name,
 					   *(target_p->serv->by) ? target_p->serv->by : "*", "*",
 					   me.name,
-					   rb_current_time() - target_p->localClient->lasttime);
+					   rb_current_time() - LocalLastTime(target_p));
 			cnt++;
 
 		}
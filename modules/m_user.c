@@ -88,14 +88,14 @@ do_local_user(struct Client *client_p, struct Client *source_p,
 	SetSentUser(source_p);
 	make_user(source_p);
 
-	rb_strlcpy(source_p->info, realname, sizeof(source_p->info));
+	set_client_info(source_p, realname);
 
 	if(!IsGotId(source_p))
 	{
 		/* This is in this location for a reason..If there is no identd
 		 * and ping cookies are enabled..we need to have a copy of this
 		 */
-		rb_strlcpy(source_p->username, username, sizeof(source_p->username));
+		set_client_username(source_p, username);
 	}
 
 	if(!EmptyString(source_p->name))
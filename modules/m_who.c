@@ -39,6 +39,7 @@
 #include <parse.h>
 #include <modules.h>
 #include <s_newconf.h>
+#include <class.h>
 
 static int m_who(struct Client *, struct Client *, int, const char **);
 
@@ -54,17 +55,61 @@ struct Message who_msgtab = {
 
 mapi_clist_av1 who_clist[] = { &who_msgtab, NULL };
 
-DECLARE_MODULE_AV1(who, NULL, NULL, who_clist, NULL, NULL, "$Revision$");
+static int modinit(void);
+static void moddeinit(void);
+
+DECLARE_MODULE_AV1(who, modinit, moddeinit, who_clist, NULL, NULL, "$Revision$");
+
+/* a global WHO in progress, picked up again once a second until every
+ * candidate from the who index has been looked at.  the client is
+ * looked up by connid each time, so nothing needs telling when it goes.
+ */
+struct who_stream
+{
+	rb_dlink_node node;
+	uint32_t connid;
+	char *mask;
+	struct compiled_mask *cmask;
+	struct who_query query;
+	int server_oper;
+	int operspy;
+	int maxmatches;
+};
+
+static rb_dlink_list who_streams;
+static rb_ev_entry *who_stream_ev;
+
+static void who_stream_event(void *unused);
+static void who_stream_free(struct who_stream *ws);
 
 static void do_who_on_channel(struct Client *source_p, struct Channel *chptr,
 			      int server_oper, int member);
 
-static void who_global(struct Client *source_p, const char *mask, int server_oper, int operspy);
+static void who_global(struct Client *source_p, const char *name, const char *mask,
+		       int server_oper, int operspy);
 
 static void do_who(struct Client *source_p,
 		   struct Client *target_p, const char *chname, const char *op_flags);
 
 
+static int
+modinit(void)
+{
+	who_stream_ev = rb_event_add("who_stream", who_stream_event, NULL, 1);
+	return 0;
+}
+
+static void
+moddeinit(void)
+{
+	rb_dlink_node *ptr, *next_ptr;
+
+	rb_event_delete(who_stream_ev);
+
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, who_streams.head)
+		who_stream_free(ptr->data);
+}
+
 /*
 ** m_who
 **	parv[0] = sender prefix
@@ -193,13 +238,10 @@ m_who(struct Client *client_p, struct Client *source_p, int parc, const char *pa
 	 * request a full list.	 I presume its because of too many typos
 	 * with "/who" ;) --fl
 	 */
-	SetCork(source_p);
 	if((*(mask + 1) == '\0') && (*mask == '0'))
-		who_global(source_p, NULL, server_oper, 0);
+		who_global(source_p, mask, NULL, server_oper, 0);
 	else
-		who_global(source_p, mask, server_oper, operspy);
-	ClearCork(source_p);
-	sendto_one_numeric(source_p, s_RPL(RPL_ENDOFWHO), mask);
+		who_global(source_p, mask, mask, server_oper, operspy);
 
 	return 0;
 }
@@ -207,7 +249,7 @@ m_who(struct Client *client_p, struct Client *source_p, int parc, const char *pa
 /* who_common_channel
  * inputs	- pointer to client requesting who
  *		- pointer to channel member chain.
- *		- char * mask to match
+ *		- compiled mask to match
  *		- int if oper on a server or not
  *		- pointer to int maxmatches
  * output	- NONE
@@ -216,7 +258,7 @@ m_who(struct Client *client_p, struct Client *source_p, int parc, const char *pa
  */
 static void
 who_common_channel(struct Client *source_p, struct Channel *chptr,
-		   const char *mask, int server_oper, int *maxmatches)
+		   const struct compiled_mask *mask, int server_oper, int *maxmatches)
 {
 	rb_dlink_node *ptr;
 
@@ -239,9 +281,11 @@ who_common_channel(struct Client *source_p, struct Channel *chptr,
 			if(*maxmatches > 0)
 			{
 				if((mask == NULL) ||
-				   match(mask, target_p->name) || match(mask, target_p->username) ||
-				   match(mask, target_p->host) || match(mask, target_p->servptr->name) ||
-				   match(mask, target_p->info))
+				   match_compiled(mask, target_p->name) ||
+				   match_compiled(mask, target_p->username) ||
+				   match_compiled(mask, target_p->host) ||
+				   match_compiled(mask, target_p->servptr->name) ||
+				   match_compiled(mask, target_p->info))
 				{
 					do_who(source_p, target_p, NULL, "");
 					--(*maxmatches);
@@ -251,74 +295,227 @@ who_common_channel(struct Client *source_p, struct Channel *chptr,
 	}
 }
 
+/* who_clear_marks()
+ *
+ * inputs	- pointer to client requesting who
+ * output	- NONE
+ * side effects - clears the marks who_common_channel() left on members
+ *		  of source_p's channels
+ */
+static void
+who_clear_marks(struct Client *source_p)
+{
+	rb_dlink_node *lp, *ptr;
+
+	RB_DLINK_FOREACH(lp, source_p->user->channel.head)
+	{
+		struct membership *msptr = lp->data;
+
+		for(int i = MEMBER_NOOP; i <= MEMBER_OP; i++)
+		{
+			RB_DLINK_FOREACH(ptr, msptr->chptr->members[i].head)
+				ClearMark(((struct membership *)ptr->data)->client_p);
+		}
+	}
+}
+
+static void
+who_stream_free(struct who_stream *ws)
+{
+	rb_dlinkDelete(&ws->node, &who_streams);
+	free_compiled_mask(ws->cmask);
+	rb_free(ws->mask);
+	rb_free(ws);
+}
+
+/* who_stream_end()
+ *
+ * inputs	- pointer to client requesting who, its WHO in progress
+ * output	- NONE
+ * side effects - ends the WHO and frees it
+ */
+static void
+who_stream_end(struct Client *source_p, struct who_stream *ws)
+{
+	if(ws->maxmatches <= 0)
+		sendto_one_numeric(source_p, s_RPL(ERR_TOOMANYMATCHES), "WHO");
+	sendto_one_numeric(source_p, s_RPL(RPL_ENDOFWHO), ws->mask);
+	who_stream_free(ws);
+}
+
+/* who_stream_send()
+ *
+ * inputs	- pointer to client requesting who, its WHO in progress
+ * output	- 1 if the WHO is finished, 0 if there is more
+ * side effects - lists matching visible clients, or every matching
+ *		  client for an operspy who, until half of source_p's
+ *		  sendq is queued, flushing every 10 lines
+ */
+static int
+who_stream_send(struct Client *source_p, struct who_stream *ws)
+{
+	struct Client *target_p;
+	long sendq_limit;
+	int count = 0;
+
+	sendq_limit = get_sendq(source_p) / 2;
+
+	SetCork(source_p);
+
+	while(rb_linebuf_len(source_p->localClient->buf_sendq) < sendq_limit)
+	{
+		if(ws->maxmatches <= 0 || (target_p = who_query_next(&ws->query)) == NULL)
+		{
+			ClearCork(source_p);
+			send_pop_queue(source_p);
+			return 1;
+		}
+
+		if(!IsClient(target_p))
+			continue;
+
+		if(IsInvisible(target_p) && !ws->operspy)
+			continue;
+
+		if(ws->server_oper && !IsOper(target_p))
+			continue;
+
+		if(ws->cmask == NULL ||
+		   match_compiled(ws->cmask, target_p->name) ||
+		   match_compiled(ws->cmask, target_p->username) ||
+		   match_compiled(ws->cmask, target_p->host) ||
+		   match_compiled(ws->cmask, target_p->servptr->name) ||
+		   match_compiled(ws->cmask, target_p->info))
+		{
+			do_who(source_p, target_p, NULL, "");
+			--ws->maxmatches;
+
+			if(count++ >= 10)
+			{
+				ClearCork(source_p);
+				send_pop_queue(source_p);
+				SetCork(source_p);
+				count = 0;
+			}
+		}
+	}
+
+	ClearCork(source_p);
+	send_pop_queue(source_p);
+	return 0;
+}
+
+/* who_stream_event()
+ *
+ * inputs	- NONE
+ * output	- NONE
+ * side effects - carries on every WHO in progress, forgets those whose
+ *		  client has gone
+ */
+static void
+who_stream_event(void *unused)
+{
+	rb_dlink_node *ptr, *next_ptr;
+	struct Client *source_p;
+
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, who_streams.head)
+	{
+		struct who_stream *ws = ptr->data;
+
+		if((source_p = find_connid(ws->connid)) == NULL)
+			who_stream_free(ws);
+		else if(who_stream_send(source_p, ws))
+			who_stream_end(source_p, ws);
+	}
+}
+
 /*
  * who_global
  *
  * inputs	- pointer to client requesting who
+ *		- name to end the list with
  *		- char * mask to match
  *		- int if oper on a server or not
  * output	- NONE
- * side effects - do a global scan of all clients looking for match
- *		  this is slightly expensive on EFnet ...
+ * side effects - lists matching invisible clients on common channels,
+ *		  then starts a scan of the who index for everyone else,
+ *		  which carries on from who_stream_event() while source_p
+ *		  is behind on its sendq.
  *		  marks assumed cleared for all clients initially
  *		  and will be left cleared on return
  */
 static void
-who_global(struct Client *source_p, const char *mask, int server_oper, int operspy)
+who_global(struct Client *source_p, const char *name, const char *mask,
+	   int server_oper, int operspy)
 {
-	rb_dlink_node *lp, *ptr;
-	int maxmatches = 500;
+	struct who_stream *ws;
+	rb_dlink_node *lp;
+	int narrow = 1;
+
+	RB_DLINK_FOREACH(lp, who_streams.head)
+	{
+		ws = lp->data;
+		if(ws->connid == source_p->localClient->connid)
+		{
+			who_stream_end(source_p, ws);
+			break;
+		}
+	}
+
+	ws = rb_malloc(sizeof(struct who_stream));
+	ws->connid = source_p->localClient->connid;
+	ws->mask = rb_strdup(name);
+	ws->server_oper = server_oper;
+	ws->operspy = operspy;
+	ws->maxmatches = 500;
+
+	/* every client gets checked against it five times, parse it once */
+	if(mask != NULL)
+		ws->cmask = compile_mask(mask, 0);
 
 	/* first, list all matching INvisible clients on common channels
 	 * if this is not an operspy who
 	 */
 	if(!operspy)
 	{
+		SetCork(source_p);
 		RB_DLINK_FOREACH(lp, source_p->user->channel.head)
 		{
 			struct membership *msptr = lp->data;
-			who_common_channel(source_p, msptr->chptr, mask, server_oper, &maxmatches);
+			who_common_channel(source_p, msptr->chptr, ws->cmask, server_oper,
+					   &ws->maxmatches);
 		}
+		ClearCork(source_p);
+		who_clear_marks(source_p);
 	}
 	else
 		report_operspy(source_p, "WHO", mask);
 
-	/* second, list all matching visible clients and clear all marks
-	 * on invisible clients
-	 * if this is an operspy who, list all matching clients, no need
-	 * to clear marks
+	/* the who index only knows the client's own strings, a mask that
+	 * matches a server name has to look at everyone on it
 	 */
-	RB_DLINK_FOREACH(ptr, global_client_list.head)
+	if(ws->cmask != NULL)
 	{
-		struct Client *target_p = ptr->data;
-		if(!IsClient(target_p))
-			continue;
-
-		if(IsInvisible(target_p) && !operspy)
+		RB_DLINK_FOREACH(lp, global_serv_list.head)
 		{
-			ClearMark(target_p);
-			continue;
-		}
-
-		if(server_oper && !IsOper(target_p))
-			continue;
+			struct Client *server_p = lp->data;
 
-		if(maxmatches > 0)
-		{
-			if(!mask ||
-			   match(mask, target_p->name) || match(mask, target_p->username) ||
-			   match(mask, target_p->host) || match(mask, target_p->servptr->name) ||
-			   match(mask, target_p->info))
+			if(match_compiled(ws->cmask, server_p->name))
 			{
-				do_who(source_p, target_p, NULL, "");
-				--maxmatches;
+				narrow = 0;
+				break;
 			}
 		}
-
 	}
 
-	if(maxmatches <= 0)
-		sendto_one_numeric(source_p, s_RPL(ERR_TOOMANYMATCHES), "WHO");
+	/* second, list all matching visible clients, or all matching
+	 * clients if this is an operspy who
+	 */
+	who_query_init(&ws->query, narrow ? ws->cmask : NULL);
+	rb_dlinkAdd(ws, &ws->node, &who_streams);
+
+	if(who_stream_send(source_p, ws))
+		who_stream_end(source_p, ws);
 }
 
 /*
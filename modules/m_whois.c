@@ -339,7 +339,7 @@ single_whois(struct Client *source_p, struct Client *target_p, int operspy)
 		sendto_one_numeric(source_p, s_RPL(RPL_WHOISIDLE),
 				   target_p->name,
 				   rb_current_time() - target_p->localClient->last,
-				   target_p->localClient->firsttime);
+				   LocalFirstTime(target_p));
 	}
 	else
 	{
@@ -66,8 +66,7 @@ m_whowas(struct Client *client_p, struct Client *source_p, int parc, const char
 	char *p;
 	const char *nick;
 	char tbuf[26];
-	rb_dlink_list *whowas_list;
-	rb_dlink_node *ptr;
+	whowas_t *temp;
 	static time_t last_used = 0L;
 
 	if(!IsOper(source_p))
@@ -98,9 +97,9 @@ m_whowas(struct Client *client_p, struct Client *source_p, int parc, const char
 	nick = parv[1];
 
 
-	whowas_list = whowas_get_list(nick);
+	temp = whowas_get_first(nick);
 
-	if(whowas_list == NULL)
+	if(temp == NULL)
 	{
 		sendto_one_numeric(source_p, s_RPL(ERR_WASNOSUCHNICK), nick);
 		sendto_one_numeric(source_p, s_RPL(RPL_ENDOFWHOWAS), parv[1]);
@@ -108,10 +107,8 @@ m_whowas(struct Client *client_p, struct Client *source_p, int parc, const char
 	
 	}
 	
-	RB_DLINK_FOREACH(ptr, whowas_list->head)
+	for(; temp != NULL; temp = whowas_get_next(temp))
 	{
-		whowas_t *temp = ptr->data;
-
 		sendto_one_numeric(source_p, s_RPL(RPL_WHOWASUSER), temp->name,
 				   temp->username, temp->hostname, temp->realname);
 
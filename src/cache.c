@@ -47,7 +47,7 @@
 
 static struct cachefile *user_motd = NULL;
 static struct cachefile *oper_motd = NULL;
-static struct cacheline emptyline = { .data[0] = ' ', .data[1] = '\0' };
+static struct cacheline emptyline = { .len = 1, .data[0] = ' ', .data[1] = '\0' };
 static rb_dlink_list links_cache_list;
 static char user_motd_changed[MAX_DATE_STRING];
 
@@ -145,7 +145,7 @@ cache_file(const char *filename, const char *shortname, int flags)
 		if(!EmptyString(line))
 		{
 			lineptr = rb_malloc(sizeof(struct cacheline));
-			untabify(lineptr->data, line, sizeof(lineptr->data));
+			lineptr->len = untabify(lineptr->data, line, sizeof(lineptr->data));
 			rb_dlinkAddTail(lineptr, &lineptr->linenode, &cacheptr->contents);
 		}
 		else
@@ -271,6 +271,45 @@ load_help(void)
 	closedir(helpfile_dir);
 }
 
+/* send_cache_lines()
+ *
+ * inputs	- client to send to, numeric, text to put in front of each
+ *		  line, first cached line to send
+ * outputs	-
+ * side effects - ptr and every line after it are sent as numeric.  the
+ *		  prefix is formatted once and each line is copied in behind
+ *		  it, the whole lot goes onto the sendq as one linebuf.
+ */
+void
+send_cache_lines(struct Client *source_p, int numeric, const char *lead, rb_dlink_node *ptr)
+{
+	char buf[IRCD_BUFSIZE];
+	rb_buf_head_t linebuf;
+	struct cacheline *lineptr;
+	const char *name;
+	int len;
+
+	name = get_id(source_p, source_p);
+	if(EmptyString(name))
+		name = "*";
+
+	len = snprintf(buf, sizeof(buf), ":%s %03d %s %s", get_id(&me, source_p), numeric, name, lead);
+	if(len < 0)
+		return;
+	if((size_t)len > sizeof(buf) - CACHELINELEN)
+		len = sizeof(buf) - CACHELINELEN;
+
+	rb_linebuf_newbuf(&linebuf);
+	for(; ptr != NULL; ptr = ptr->next)
+	{
+		lineptr = ptr->data;
+		memcpy(buf + len, lineptr->data, lineptr->len + 1);
+		rb_linebuf_putbuf(&linebuf, buf);
+	}
+	sendto_one_linebuf(source_p, &linebuf);
+	rb_linebuf_donebuf(&linebuf);
+}
+
 /* send_user_motd()
  *
  * inputs	- client to send motd to
@@ -280,7 +319,6 @@ load_help(void)
 void
 send_user_motd(struct Client *source_p)
 {
-	rb_dlink_node *ptr;
 	if(user_motd == NULL || rb_dlink_list_length(&user_motd->contents) == 0)
 	{
 		sendto_one_numeric(source_p, s_RPL(ERR_NOMOTD));
@@ -289,11 +327,7 @@ send_user_motd(struct Client *source_p)
 	SetCork(source_p);
 	sendto_one_numeric(source_p, s_RPL(RPL_MOTDSTART), me.name);
 
-	RB_DLINK_FOREACH(ptr, user_motd->contents.head)
-	{
-		struct cacheline *lineptr = ptr->data;
-		sendto_one_numeric(source_p, s_RPL(RPL_MOTD), lineptr->data);
-	}
+	send_cache_lines(source_p, RPL_MOTD, ":- ", user_motd->contents.head);
 	ClearCork(source_p);
 	sendto_one_numeric(source_p, s_RPL(RPL_ENDOFMOTD));
 }
@@ -307,18 +341,12 @@ send_user_motd(struct Client *source_p)
 void
 send_oper_motd(struct Client *source_p)
 {
-	rb_dlink_node *ptr;
-
 	if(oper_motd == NULL || rb_dlink_list_length(&oper_motd->contents) == 0)
 		return;
 	SetCork(source_p);
 	sendto_one_numeric(source_p, s_RPL(RPL_OMOTDSTART));
 
-	RB_DLINK_FOREACH(ptr, oper_motd->contents.head)
-	{
-		struct cacheline *lineptr = ptr->data;
-		sendto_one_numeric(source_p, s_RPL(RPL_OMOTD), lineptr->data);
-	}
+	send_cache_lines(source_p, RPL_OMOTD, "", oper_motd->contents.head);
 	ClearCork(source_p);
 	sendto_one_numeric(source_p, s_RPL(RPL_ENDOFOMOTD));
 }
@@ -44,9 +44,16 @@
 
 struct config_channel_entry ConfigChannel;
 rb_dlink_list global_channel_list;
+static rb_dlink_list channel_cursors;
 
 rb_ev_entry *checksplit_ev;
 
+static struct membership **member_index;
+static uint32_t member_index_mask;
+static uint32_t member_index_count;
+
+#define MEMBER_INDEX_MIN	4096	/* must be a power of 2 */
+
 static int channel_capabs[] = { CAP_EX, CAP_IE,
 #ifdef ENABLE_SERVICES
 	CAP_SERVICE,
@@ -70,7 +77,89 @@ static void free_topic(struct Channel *chptr);
 void
 init_channels(void)
 {
-	/* nothing to do anymore..for now */
+	member_index = rb_malloc(sizeof(struct membership *) * MEMBER_INDEX_MIN);
+	member_index_mask = MEMBER_INDEX_MIN - 1;
+}
+
+/*
+ * Every membership on the network, open addressed by its (client,
+ * channel) pair with linear probing, so find_channel_membership() doesn't
+ * have to walk a member list.  Kept at most half full.
+ */
+static inline uint32_t
+member_hash(const struct Client *client_p, const struct Channel *chptr)
+{
+	uint64_t key;
+
+	key = (uint64_t)(uintptr_t)client_p * 0x9E3779B97F4A7C15ULL;
+	key ^= (uint64_t)(uintptr_t)chptr * 0xC2B2AE3D27D4EB4FULL;
+	return (uint32_t)(key ^ (key >> 32));
+}
+
+/* returns the slot holding the pair, or the empty one it would go in */
+static struct membership **
+member_index_find(const struct Client *client_p, const struct Channel *chptr)
+{
+	uint32_t i = member_hash(client_p, chptr) & member_index_mask;
+
+	while(member_index[i] != NULL)
+	{
+		if(member_index[i]->client_p == client_p && member_index[i]->chptr == chptr)
+			break;
+		i = (i + 1) & member_index_mask;
+	}
+	return &member_index[i];
+}
+
+static void
+member_index_grow(void)
+{
+	struct membership **old = member_index;
+	uint32_t size = member_index_mask + 1;
+	uint32_t i;
+
+	member_index = rb_malloc(sizeof(struct membership *) * size * 2);
+	member_index_mask = size * 2 - 1;
+
+	for(i = 0; i < size; i++)
+	{
+		if(old[i] != NULL)
+			*member_index_find(old[i]->client_p, old[i]->chptr) = old[i];
+	}
+	rb_free(old);
+}
+
+static void
+member_index_add(struct membership *msptr)
+{
+	if((member_index_count + 1) * 2 > member_index_mask + 1)
+		member_index_grow();
+
+	*member_index_find(msptr->client_p, msptr->chptr) = msptr;
+	member_index_count++;
+}
+
+/* empties msptr's slot, shifting back the entries probed past it */
+static void
+member_index_del(struct membership *msptr)
+{
+	struct membership **slot = member_index_find(msptr->client_p, msptr->chptr);
+	uint32_t i = slot - member_index;
+	uint32_t j, home;
+
+	s_assert(*slot == msptr);
+
+	for(j = (i + 1) & member_index_mask; member_index[j] != NULL; j = (j + 1) & member_index_mask)
+	{
+		home = member_hash(member_index[j]->client_p, member_index[j]->chptr) & member_index_mask;
+		if(((j - home) & member_index_mask) >= ((j - i) & member_index_mask))
+		{
+			member_index[i] = member_index[j];
+			i = j;
+		}
+	}
+	member_index[i] = NULL;
+	member_index_count--;
 }
 
 struct Ban *
@@ -79,6 +168,7 @@ allocate_ban(const char *banstr, const char *who)
 	struct Ban *bptr;
 	bptr = rb_malloc(sizeof(struct Ban));
 	bptr->banstr = rb_strndup(banstr, BANLEN);
+	bptr->mask = compile_mask(bptr->banstr, 0);
 	bptr->who = rb_strndup(who, BANLEN);
 
 	return (bptr);
@@ -87,11 +177,74 @@ allocate_ban(const char *banstr, const char *who)
 void
 free_ban(struct Ban *bptr)
 {
+	hash_del_hnode(HASH_BAN, bptr->hnode);
 	rb_free(bptr->banstr);
+	free_compiled_mask(bptr->mask);
 	rb_free(bptr->who);
 	rb_free(bptr);
 }
 
+/*
+ * Every ban, exception and invex is also in HASH_BAN, keyed by the list
+ * it is on followed by its mask folded to upper case, so telling whether
+ * a list already holds a mask, irccmp() style, needs no walk.
+ */
+static size_t
+ban_key(unsigned char *key, rb_dlink_list *list, const char *banstr)
+{
+	size_t len = sizeof(list);
+
+	memcpy(key, &list, sizeof(list));
+	while(*banstr != '\0')
+		key[len++] = ToUpper(*banstr++);
+	return len;
+}
+
+/* find_channel_ban()
+ *
+ * input	- ban list, mask
+ * output	- the entry on the list that irccmp()s equal to mask, or NULL
+ * side effects	-
+ */
+struct Ban *
+find_channel_ban(rb_dlink_list *list, const char *banstr)
+{
+	unsigned char key[sizeof(void *) + BANLEN];
+
+	/* allocate_ban() would have cut it short, so it can't be there */
+	if(strlen(banstr) >= BANLEN)
+		return NULL;
+
+	return hash_find_data_len(HASH_BAN, key, ban_key(key, list, banstr));
+}
+
+/* add_channel_ban()
+ *
+ * input	- ban list, ban from allocate_ban()
+ * output	-
+ * side effects	- ban is put at the head of the list
+ */
+void
+add_channel_ban(rb_dlink_list *list, struct Ban *bptr)
+{
+	unsigned char key[sizeof(void *) + BANLEN];
+
+	rb_dlinkAdd(bptr, &bptr->node, list);
+	bptr->hnode = hash_add_len(HASH_BAN, key, ban_key(key, list, bptr->banstr), bptr);
+}
+
+/* del_channel_ban()
+ *
+ * input	- ban list, ban on it
+ * output	-
+ * side effects	- ban is taken off the list and freed
+ */
+void
+del_channel_ban(rb_dlink_list *list, struct Ban *bptr)
+{
+	rb_dlinkDelete(&bptr->node, list);
+	free_ban(bptr);
+}
 
 /* find_channel_membership()
  *
@@ -102,43 +255,10 @@ free_ban(struct Ban *bptr)
 struct membership *
 find_channel_membership(struct Channel *chptr, struct Client *client_p)
 {
-	rb_dlink_node *ptr;
-
 	if(!IsClient(client_p))
 		return NULL;
 
-	/* Pick the most efficient list to use to be nice to things like
-	 * CHANSERV which could be in a large number of channels
-	 */
-	if(chan_member_count(chptr) < rb_dlink_list_length(&client_p->user->channel))
-	{
-		RB_DLINK_FOREACH(ptr, chptr->members[MEMBER_NOOP].head)
-		{
-			struct membership *msptr = ptr->data;
-
-			if(msptr->client_p == client_p)
-				return msptr;
-		}
-		RB_DLINK_FOREACH(ptr, chptr->members[MEMBER_OP].head)
-		{
-			struct membership *msptr = ptr->data;
-
-			if(msptr->client_p == client_p)
-				return msptr;
-		}
-	}
-	else
-	{
-		RB_DLINK_FOREACH(ptr, client_p->user->channel.head)
-		{
-			struct membership *msptr = ptr->data;
-
-			if(msptr->chptr == chptr)
-				return msptr;
-		}
-	}
-
-	return NULL;
+	return *member_index_find(client_p, chptr);
 }
 
 /* find_channel_status()
@@ -169,6 +289,191 @@ find_channel_status(struct membership *msptr, int combine)
 	return buffer;
 }
 
+/*
+ * NAMES caches
+ *
+ * Rebuilding the NAMES reply for a big channel on every JOIN means a
+ * sprintf per member, so each channel keeps the member list text ready
+ * for the variants that have been asked for.  Members without ops join
+ * the end of the list and leave by being cut out of it, anything else
+ * (ops, voices, nick and +i changes) throws the cache away.  The list
+ * holds ops newest first, then everyone else oldest first, which is the
+ * order a join appends in.
+ */
+static void
+names_cache_put(struct names_cache *nc, const char *status, const char *name)
+{
+	size_t slen = strlen(status);
+	size_t nlen = strlen(name);
+
+	if(nc->len + slen + nlen + 1 > nc->size)
+	{
+		while(nc->len + slen + nlen + 1 > nc->size)
+			nc->size *= 2;
+		nc->buf = rb_realloc(nc->buf, nc->size);
+	}
+
+	memcpy(nc->buf + nc->len, status, slen);
+	nc->len += slen;
+	memcpy(nc->buf + nc->len, name, nlen);
+	nc->len += nlen;
+	nc->buf[nc->len++] = ' ';
+}
+
+/* cuts "<status>name " out of the list */
+static void
+names_cache_cut(struct names_cache *nc, const char *name)
+{
+	size_t nlen = strlen(name);
+	char *p = nc->buf;
+	char *end = nc->buf + nc->len;
+
+	while(p < end)
+	{
+		char *tok = p;
+		char *next = (char *)memchr(p, ' ', end - p) + 1;
+
+		while(*p == '@' || *p == '+')
+			p++;
+
+		if((size_t)(next - 1 - p) == nlen && !memcmp(p, name, nlen))
+		{
+			memmove(tok, next, end - next);
+			nc->len -= next - tok;
+			return;
+		}
+		p = next;
+	}
+}
+
+static struct names_cache *
+names_cache_get(struct Channel *chptr, int variant)
+{
+	struct names_cache *nc;
+	rb_dlink_node *ptr;
+
+	if(chptr->names == NULL)
+		chptr->names = rb_malloc(sizeof(struct names_cache) * NAMES_VARIANTS);
+
+	nc = &chptr->names[variant];
+	if(nc->buf != NULL)
+		return nc;
+
+	nc->size = 64;
+	nc->len = 0;
+	nc->buf = rb_malloc(nc->size);
+
+	RB_DLINK_FOREACH(ptr, chptr->members[MEMBER_OP].head)
+	{
+		struct membership *msptr = ptr->data;
+
+		if(!(variant & NAMES_MEMBER) && IsInvisible(msptr->client_p))
+			continue;
+		names_cache_put(nc, find_channel_status(msptr, variant & NAMES_STACK),
+				msptr->client_p->name);
+	}
+
+	RB_DLINK_FOREACH_PREV(ptr, chptr->members[MEMBER_NOOP].tail)
+	{
+		struct membership *msptr = ptr->data;
+
+		if(!(variant & NAMES_MEMBER) && IsInvisible(msptr->client_p))
+			continue;
+		names_cache_put(nc, find_channel_status(msptr, variant & NAMES_STACK),
+				msptr->client_p->name);
+	}
+
+	return nc;
+}
+
+/* invalidate_names_cache()
+ *
+ * input	- channel
+ * output	-
+ * side effects - channel's prebuilt NAMES lists are freed
+ */
+void
+invalidate_names_cache(struct Channel *chptr)
+{
+	int i;
+
+	if(chptr->names == NULL)
+		return;
+
+	for(i = 0; i < NAMES_VARIANTS; i++)
+		rb_free(chptr->names[i].buf);
+
+	rb_free(chptr->names);
+	chptr->names = NULL;
+}
+
+/* invalidate_names_cache_user()
+ *
+ * input	- user whose nick or visibility changed
+ * output	-
+ * side effects - NAMES lists of all the user's channels are freed
+ */
+void
+invalidate_names_cache_user(struct Client *client_p)
+{
+	rb_dlink_node *ptr;
+
+	if(client_p->user == NULL)
+		return;
+
+	RB_DLINK_FOREACH(ptr, client_p->user->channel.head)
+	{
+		struct membership *msptr = ptr->data;
+		invalidate_names_cache(msptr->chptr);
+	}
+}
+
+static void
+names_cache_join(struct membership *msptr)
+{
+	struct Channel *chptr = msptr->chptr;
+	struct Client *client_p = msptr->client_p;
+	int i;
+
+	if(chptr->names == NULL)
+		return;
+
+	if(is_chanop(msptr))
+	{
+		invalidate_names_cache(chptr);
+		return;
+	}
+
+	for(i = 0; i < NAMES_VARIANTS; i++)
+	{
+		if(chptr->names[i].buf == NULL)
+			continue;
+		if(!(i & NAMES_MEMBER) && IsInvisible(client_p))
+			continue;
+		names_cache_put(&chptr->names[i], find_channel_status(msptr, i & NAMES_STACK),
+				client_p->name);
+	}
+}
+
+static void
+names_cache_part(struct membership *msptr)
+{
+	struct Channel *chptr = msptr->chptr;
+	int i;
+
+	if(chptr->names == NULL)
+		return;
+
+	for(i = 0; i < NAMES_VARIANTS; i++)
+	{
+		if(chptr->names[i].buf == NULL)
+			continue;
+		if(!(i & NAMES_MEMBER) && IsInvisible(msptr->client_p))
+			continue;
+		names_cache_cut(&chptr->names[i], msptr->client_p->name);
+	}
+}
+
 /* add_user_to_channel()
  *
  * input	- channel to add client to, client to add, channel flags
@@ -197,9 +502,15 @@ add_user_to_channel(struct Channel *chptr, struct Client *client_p, int flags)
                 memlist = &chptr->members[MEMBER_NOOP];
 
 	rb_dlinkAdd(msptr, &msptr->channode, memlist);
+	member_index_add(msptr);
 
 	if(MyClient(client_p))
+	{
+		msptr->slot = LocalSlot(client_p);
 		rb_dlinkAdd(msptr, &msptr->locchannode, &chptr->locmembers);
+	}
+
+	names_cache_join(msptr);
 }
 
 /* remove_user_from_channel()
@@ -229,12 +540,15 @@ remove_user_from_channel(struct membership *msptr)
                 memlist = &chptr->members[MEMBER_NOOP];
 
 	rb_dlinkDelete(&msptr->channode, memlist);
+	member_index_del(msptr);
 
 	if(client_p->servptr == &me)
 		rb_dlinkDelete(&msptr->locchannode, &chptr->locmembers);
 
         if(chan_member_count(chptr) <= 0)
 		destroy_channel(chptr);
+	else
+		names_cache_part(msptr);
 
 	rb_free(msptr);
 
@@ -267,12 +581,15 @@ remove_user_from_channels(struct Client *client_p)
                         memlist = &chptr->members[MEMBER_NOOP];
 
 		rb_dlinkDelete(&msptr->channode, memlist);
+		member_index_del(msptr);
 
 		if(client_p->servptr == &me)
 			rb_dlinkDelete(&msptr->locchannode, &chptr->locmembers);
 
                 if(chan_member_count(chptr) <= 0)
 			destroy_channel(chptr);
+		else
+			names_cache_part(msptr);
 
 		rb_free(msptr);
 	}
@@ -372,12 +689,60 @@ destroy_channel(struct Channel *chptr)
 	/* Free the topic */
 	free_topic(chptr);
 
+	invalidate_names_cache(chptr);
+
+	RB_DLINK_FOREACH(ptr, channel_cursors.head)
+	{
+		struct channel_cursor *cursor = ptr->data;
+
+		if(cursor->next == &chptr->node)
+			cursor->next = chptr->node.next;
+	}
+
 	rb_dlinkDelete(&chptr->node, &global_channel_list);
 	hash_del(HASH_CHANNEL, chptr->chname, chptr);
 	rb_free(chptr->chname);
 	rb_free(chptr);
 }
 
+/* add_channel_cursor()
+ *
+ * inputs	- cursor
+ * outputs	-
+ * side effects - cursor is placed at the head of global_channel_list,
+ *		  channels created after this are not seen by it
+ */
+void
+add_channel_cursor(struct channel_cursor *cursor)
+{
+	cursor->next = global_channel_list.head;
+	rb_dlinkAdd(cursor, &cursor->node, &channel_cursors);
+}
+
+void
+del_channel_cursor(struct channel_cursor *cursor)
+{
+	rb_dlinkDelete(&cursor->node, &channel_cursors);
+}
+
+/* channel_cursor_next()
+ *
+ * inputs	- cursor
+ * outputs	- next channel, NULL at the end of the list
+ * side effects - cursor moves past the channel returned
+ */
+struct Channel *
+channel_cursor_next(struct channel_cursor *cursor)
+{
+	rb_dlink_node *ptr = cursor->next;
+
+	if(ptr == NULL)
+		return NULL;
+
+	cursor->next = ptr->next;
+	return ptr->data;
+}
+
 /* channel_pub_or_secret()
  *
  * input	- channel
@@ -403,50 +768,26 @@ channel_pub_or_secret(struct Channel *chptr)
 void
 channel_member_names(struct Channel *chptr, struct Client *client_p, int show_eon)
 {
-	rb_dlink_node *ptr;
+	struct names_cache *nc;
 	char lbuf[IRCD_BUFSIZE];
-	char *t;
-	int mlen;
-	int tlen;
-	int cur_len;
-	int is_member;
-	int stack = IsCapable(client_p, CLICAP_MULTI_PREFIX);
+	const char *p, *end;
+	size_t mlen, room, n;
+	int variant = 0;
+
 	SetCork(client_p);
 	if(ShowChannel(client_p, chptr))
 	{
-		is_member = IsMember(client_p, chptr);
+		if(IsCapable(client_p, CLICAP_MULTI_PREFIX))
+			variant |= NAMES_STACK;
+		if(IsMember(client_p, chptr))
+			variant |= NAMES_MEMBER;
 
-		cur_len = mlen = sprintf(lbuf, form_str(RPL_NAMREPLY),
-					 me.name, client_p->name, channel_pub_or_secret(chptr), chptr->chname);
+		nc = names_cache_get(chptr, variant);
 
-		t = lbuf + cur_len;
+		mlen = sprintf(lbuf, form_str(RPL_NAMREPLY),
+			       me.name, client_p->name, channel_pub_or_secret(chptr), chptr->chname);
+		room = IRCD_BUFSIZE - 5 - mlen;
 
-		
-		for(int i = MEMBER_OP; i >= MEMBER_NOOP; i--)
-		{
-			RB_DLINK_FOREACH(ptr, chptr->members[i].head)
-			{
-				struct membership *msptr = ptr->data;
-				struct Client *target_p = msptr->client_p;
-				
-				if(IsInvisible(target_p) && !is_member)
-					continue;
-
-				/* space, possible "@+" prefix */
-				if(cur_len + strlen(target_p->name) + 3 >= IRCD_BUFSIZE - 3)
-				{
-					*(t - 1) = '\0';
-					sendto_one_buffer(client_p, lbuf);
-					cur_len = mlen;
-					t = lbuf + mlen;
-				}
-
-				tlen = sprintf(t, "%s%s ", find_channel_status(msptr, stack), target_p->name);
-
-				cur_len += tlen;
-				t += tlen;
-			}
-		}
 		/* The old behaviour here was to always output our buffer,
 		 * even if there are no clients we can show.  This happens
 		 * when a client does "NAMES" with no parameters, and all
@@ -454,10 +795,25 @@ channel_member_names(struct Channel *chptr, struct Client *client_p, int show_eo
 		 * reason for keeping that behaviour, as it just wastes
 		 * bandwidth.  --anfl
 		 */
-		if(cur_len != mlen)
+		p = nc->buf;
+		end = nc->buf + nc->len;
+		while(p < end)
 		{
-			*(t - 1) = '\0';
+			/* every name in the list is followed by a space,
+			 * break each line at the last one that fits
+			 */
+			if((size_t)(end - p) <= room + 1)
+				n = end - p - 1;
+			else
+			{
+				for(n = room; p[n] != ' '; n--)
+					;
+			}
+
+			memcpy(lbuf + mlen, p, n);
+			lbuf[mlen + n] = '\0';
 			sendto_one_buffer(client_p, lbuf);
+			p += n + 1;
 		}
 	}
 
@@ -535,9 +891,10 @@ is_banned(struct Channel *chptr, struct Client *who, struct membership *msptr, c
 		actualBan = ptr->data;
 		banstr = actualBan->banstr;
 		
-		if(match(banstr, s) || match(banstr, s2) || match_cidr(banstr, s2)   
+		if(match_compiled(actualBan->mask, s) || match_compiled(actualBan->mask, s2) ||
+		   match_cidr(banstr, s2)
 #ifdef RB_IPv6
-		|| ((s_tunv4 != NULL) && (match(banstr, s_tunv4) || match_cidr(banstr, s_tunv4)))
+		|| ((s_tunv4 != NULL) && (match_compiled(actualBan->mask, s_tunv4) || match_cidr(banstr, s_tunv4)))
 #endif
 		)
 		{		
@@ -555,8 +912,8 @@ is_banned(struct Channel *chptr, struct Client *who, struct membership *msptr, c
 			actualExcept = ptr->data;
 
 			/* theyre exempted.. */
-			if(match(actualExcept->banstr, s) ||
-			   match(actualExcept->banstr, s2) || match_cidr(actualExcept->banstr, s2))
+			if(match_compiled(actualExcept->mask, s) ||
+			   match_compiled(actualExcept->mask, s2) || match_cidr(actualExcept->banstr, s2))
 			{
 				/* cache the fact theyre not banned */
 				if(msptr != NULL)
@@ -907,13 +1264,16 @@ init_chcap_usage_counts(void)
  * Input: serv_p; The client whose capabs to register.
  * Output: none
  * Side-effects: Increments the usage counts for the correct capab
- *		 combination.
+ *		 combination, and files the server in its capab group for
+ *		 sendto_server().
  */
 void
 set_chcap_usage_counts(struct Client *serv_p)
 {
 	int n;
 
+	add_serv_capgroup(serv_p);
+
 	for(n = 0; n < NCHCAP_COMBOS; n++)
 	{
 		if(IsCapable(serv_p, chcap_combos[n].cap_yes) && NotCapable(serv_p, chcap_combos[n].cap_no))
@@ -932,13 +1292,15 @@ set_chcap_usage_counts(struct Client *serv_p)
  * Inputs	- serv_p; The client whose capabs to register.
  * Output	- none
  * Side-effects	- Decrements the usage counts for the correct capab
- *		  combination.
+ *		  combination, and takes the server out of its capab group.
  */
 void
 unset_chcap_usage_counts(struct Client *serv_p)
 {
 	int n;
 
+	del_serv_capgroup(serv_p);
+
 	for(n = 0; n < NCHCAP_COMBOS; n++)
 	{
 		if(IsCapable(serv_p, chcap_combos[n].cap_yes) && NotCapable(serv_p, chcap_combos[n].cap_no))
@@ -56,12 +56,14 @@
 
 #define DEBUG_EXITED_CLIENTS
 
-static void check_pings_list(rb_dlink_list * list);
-static void check_unknowns_list(rb_dlink_list * list);
+static void check_client_ping(struct Client *client_p);
+static void check_unknown(struct Client *client_p);
 static void free_exited_clients(void *unused);
 static void exit_aborted_clients(void *unused);
 
 static int exit_remote_client(struct Client *, struct Client *, struct Client *, const char *);
+static int exit_remote_client_finish(struct Client *, struct Client *, const char *);
+static void remove_generic_client(struct Client *);
 static int exit_remote_server(struct Client *, struct Client *, struct Client *, const char *);
 static int exit_local_client(struct Client *, struct Client *, struct Client *, const char *);
 static int exit_unknown_client(struct Client *, struct Client *, const char *);
@@ -87,6 +89,20 @@ struct abort_client
 
 static rb_dlink_list abort_list;
 
+struct LocalSweep local_sweep;
+
+#define LOCAL_SWEEP_MIN	1024
+
+static struct
+{
+	struct Client **client;
+	struct who_key *key;
+	unsigned int *free;	/* slots given up, to be handed out again */
+	unsigned int nfree;
+	unsigned int count;	/* slots ever handed out */
+	unsigned int size;
+} who_index;
+
 
 /*
  * init_client
@@ -135,8 +151,7 @@ make_client(struct Client *from)
 		SetMyConnect(client_p);
 
 		client_p->localClient = localClient;
-
-		client_p->localClient->lasttime = client_p->localClient->firsttime = rb_current_time();
+		add_local_sweep(client_p);
 
 		client_p->localClient->F = NULL;
 		client_p->localClient->buf_recvq = rb_linebuf_bufhead_alloc();
@@ -162,11 +177,349 @@ make_client(struct Client *from)
 	}
 
 	SetUnknown(client_p);
-	strcpy(client_p->username, "unknown");
+	init_client_strings(client_p);
+	who_index_add(client_p);
+	set_client_username(client_p, "unknown");
 
 	return client_p;
 }
 
+/* add_local_sweep()
+ *
+ * inputs	- local client
+ * outputs	-
+ * side effects - client is given a slot in local_sweep, with its first
+ *		  and last times set to now and its flood counters cleared
+ */
+void
+add_local_sweep(struct Client *client_p)
+{
+	unsigned int slot;
+
+	if(local_sweep.count == local_sweep.size)
+	{
+		unsigned int size = local_sweep.size ? local_sweep.size * 2 : LOCAL_SWEEP_MIN;
+
+		local_sweep.client = rb_realloc(local_sweep.client, size * sizeof(struct Client *));
+		local_sweep.lasttime = rb_realloc(local_sweep.lasttime, size * sizeof(time_t));
+		local_sweep.firsttime = rb_realloc(local_sweep.firsttime, size * sizeof(time_t));
+		local_sweep.sent_parsed = rb_realloc(local_sweep.sent_parsed, size * sizeof(int));
+		local_sweep.actually_read = rb_realloc(local_sweep.actually_read, size * sizeof(int));
+		local_sweep.allow_read = rb_realloc(local_sweep.allow_read, size * sizeof(unsigned int));
+		local_sweep.queued = rb_realloc(local_sweep.queued, size * sizeof(uint8_t));
+		local_sweep.size = size;
+	}
+
+	slot = local_sweep.count++;
+	client_p->localClient->slot = slot;
+	local_sweep.client[slot] = client_p;
+	local_sweep.lasttime[slot] = local_sweep.firsttime[slot] = rb_current_time();
+	local_sweep.sent_parsed[slot] = 0;
+	local_sweep.actually_read[slot] = 0;
+	local_sweep.allow_read[slot] = 0;
+	local_sweep.queued[slot] = 0;
+}
+
+/* del_local_sweep()
+ *
+ * inputs	- local client
+ * outputs	-
+ * side effects - client's slot is filled with the last one in local_sweep,
+ *		  whose channel memberships are given the new slot
+ */
+void
+del_local_sweep(struct Client *client_p)
+{
+	unsigned int slot = client_p->localClient->slot;
+	unsigned int last = --local_sweep.count;
+
+	s_assert(local_sweep.client[slot] == client_p);
+
+	if(slot != last)
+	{
+		struct Client *moved = local_sweep.client[last];
+
+		local_sweep.client[slot] = moved;
+		local_sweep.lasttime[slot] = local_sweep.lasttime[last];
+		local_sweep.firsttime[slot] = local_sweep.firsttime[last];
+		local_sweep.sent_parsed[slot] = local_sweep.sent_parsed[last];
+		local_sweep.actually_read[slot] = local_sweep.actually_read[last];
+		local_sweep.allow_read[slot] = local_sweep.allow_read[last];
+		local_sweep.queued[slot] = local_sweep.queued[last];
+		moved->localClient->slot = slot;
+
+		if(moved->user != NULL)
+		{
+			rb_dlink_node *ptr;
+
+			RB_DLINK_FOREACH(ptr, moved->user->channel.head)
+				((struct membership *)ptr->data)->slot = slot;
+		}
+	}
+	local_sweep.client[last] = NULL;
+}
+
+/* who_key_prefix()
+ *
+ * inputs	- string, may be NULL
+ * outputs	- its first WHO_KEYLEN characters folded and packed, the
+ *		  first in the lowest byte
+ * side effects -
+ */
+static uint32_t
+who_key_prefix(const char *s)
+{
+	uint32_t key = 0;
+	int i;
+
+	if(s == NULL)
+		return 0;
+
+	for(i = 0; i < WHO_KEYLEN && s[i] != '\0'; i++)
+		key |= (uint32_t)(unsigned char)ToUpper(s[i]) << (i * 8);
+	return key;
+}
+
+/* who_key_suffix()
+ *
+ * inputs	- string, may be NULL
+ * outputs	- its last WHO_KEYLEN characters folded and packed, the
+ *		  last in the lowest byte
+ * side effects -
+ */
+static uint32_t
+who_key_suffix(const char *s)
+{
+	uint32_t key = 0;
+	size_t len;
+	int i;
+
+	if(s == NULL)
+		return 0;
+
+	len = strlen(s);
+	for(i = 0; i < WHO_KEYLEN && (size_t)i < len; i++)
+		key |= (uint32_t)(unsigned char)ToUpper(s[len - 1 - i]) << (i * 8);
+	return key;
+}
+
+/* who_index_add()
+ *
+ * inputs	- client
+ * outputs	-
+ * side effects - client is given a slot in the who index, reusing one
+ *		  given up by an earlier client if there is one
+ */
+void
+who_index_add(struct Client *client_p)
+{
+	unsigned int slot;
+
+	if(client_p->whoslot != 0)
+		return;
+
+	if(who_index.nfree > 0)
+		slot = who_index.free[--who_index.nfree];
+	else
+	{
+		if(who_index.count == who_index.size)
+		{
+			unsigned int size = who_index.size ? who_index.size * 2 : LOCAL_SWEEP_MIN;
+
+			who_index.client = rb_realloc(who_index.client, size * sizeof(struct Client *));
+			who_index.key = rb_realloc(who_index.key, size * sizeof(struct who_key));
+			who_index.free = rb_realloc(who_index.free, size * sizeof(unsigned int));
+			who_index.size = size;
+		}
+		slot = who_index.count++;
+	}
+
+	who_index.client[slot] = client_p;
+	client_p->whoslot = slot + 1;
+	who_index_update(client_p);
+}
+
+/* who_index_del()
+ *
+ * inputs	- client
+ * outputs	-
+ * side effects - client's slot in the who index is emptied for reuse
+ */
+void
+who_index_del(struct Client *client_p)
+{
+	unsigned int slot;
+
+	if(client_p->whoslot == 0)
+		return;
+
+	slot = client_p->whoslot - 1;
+	s_assert(who_index.client[slot] == client_p);
+
+	who_index.client[slot] = NULL;
+	memset(&who_index.key[slot], 0, sizeof(struct who_key));
+	who_index.free[who_index.nfree++] = slot;
+	client_p->whoslot = 0;
+}
+
+/* who_index_update()
+ *
+ * inputs	- client
+ * outputs	-
+ * side effects - client's keys are rebuilt from its nick, username,
+ *		  host and gecos, call after changing any of them
+ */
+void
+who_index_update(struct Client *client_p)
+{
+	struct who_key *key;
+
+	if(client_p->whoslot == 0)
+		return;
+
+	key = &who_index.key[client_p->whoslot - 1];
+	key->prefix[WHO_NAME] = who_key_prefix(client_p->name);
+	key->suffix[WHO_NAME] = who_key_suffix(client_p->name);
+	key->prefix[WHO_USERNAME] = who_key_prefix(client_p->username);
+	key->suffix[WHO_USERNAME] = who_key_suffix(client_p->username);
+	key->prefix[WHO_HOST] = who_key_prefix(client_p->host);
+	key->suffix[WHO_HOST] = who_key_suffix(client_p->host);
+	key->prefix[WHO_INFO] = who_key_prefix(client_p->info);
+	key->suffix[WHO_INFO] = who_key_suffix(client_p->info);
+}
+
+/* who_query_init()
+ *
+ * inputs	- query to set up, compiled mask or NULL for everyone
+ * outputs	-
+ * side effects - query will return every client whose nick, username,
+ *		  host or gecos could match the mask, newest slot first
+ */
+void
+who_query_init(struct who_query *query, const struct compiled_mask *cmask)
+{
+	const char *literal;
+	size_t len, i;
+
+	memset(query, 0, sizeof(struct who_query));
+	query->pos = who_index.count;
+
+	if(cmask == NULL)
+		return;
+
+	len = IRCD_MIN(compiled_mask_prefix(cmask, &literal), WHO_KEYLEN);
+	for(i = 0; i < len; i++)
+	{
+		query->prefix |= (uint32_t)(unsigned char)literal[i] << (i * 8);
+		query->prefix_mask |= (uint32_t)0xff << (i * 8);
+	}
+
+	len = compiled_mask_suffix(cmask, &literal);
+	for(i = 0; i < len && i < WHO_KEYLEN; i++)
+	{
+		query->suffix |= (uint32_t)(unsigned char)literal[len - 1 - i] << (i * 8);
+		query->suffix_mask |= (uint32_t)0xff << (i * 8);
+	}
+}
+
+/* who_query_next()
+ *
+ * inputs	- query
+ * outputs	- next client that may match, NULL when there are no more
+ * side effects - clients that join the index while a query is running
+ *		  may or may not be returned, none is returned twice
+ */
+struct Client *
+who_query_next(struct who_query *query)
+{
+	const struct who_key *key;
+	int i;
+
+	while(query->pos > 0)
+	{
+		key = &who_index.key[--query->pos];
+
+		for(i = 0; i < WHO_FIELDS; i++)
+		{
+			if((key->prefix[i] & query->prefix_mask) == query->prefix &&
+			   (key->suffix[i] & query->suffix_mask) == query->suffix)
+				break;
+		}
+
+		if(i < WHO_FIELDS && who_index.client[query->pos] != NULL)
+			return who_index.client[query->pos];
+	}
+	return NULL;
+}
+
+/* init_client_strings()
+ *
+ * inputs	- client
+ * outputs	-
+ * side effects - username, host, sockhost and info all set to ""
+ */
+void
+init_client_strings(struct Client *client_p)
+{
+	client_p->username = intern_add("", 0);
+	client_p->host = intern_add("", 0);
+	client_p->sockhost = intern_add("", 0);
+	client_p->info = intern_add("", 0);
+}
+
+void
+free_client_strings(struct Client *client_p)
+{
+	intern_del(client_p->username);
+	intern_del(client_p->host);
+	intern_del(client_p->sockhost);
+	intern_del(client_p->info);
+	client_p->username = client_p->host = client_p->sockhost = client_p->info = NULL;
+}
+
+/* set_client_string()
+ *
+ * inputs	- field of a client, new value, longest it may be
+ * outputs	-
+ * side effects - the field points at the shared copy of value, and
+ *		  lets go of whatever it held before
+ */
+static void
+set_client_string(const char **field, const char *value, size_t maxlen)
+{
+	const char *old = *field;
+
+	*field = intern_add(value, maxlen);
+	intern_del(old);
+}
+
+void
+set_client_username(struct Client *client_p, const char *username)
+{
+	set_client_string(&client_p->username, username, USERLEN);
+	who_index_update(client_p);
+}
+
+void
+set_client_host(struct Client *client_p, const char *host)
+{
+	set_client_string(&client_p->host, host, HOSTLEN);
+	who_index_update(client_p);
+}
+
+void
+set_client_sockhost(struct Client *client_p, const char *sockhost)
+{
+	set_client_string(&client_p->sockhost, sockhost, HOSTIPLEN);
+}
+
+void
+set_client_info(struct Client *client_p, const char *info)
+{
+	set_client_string(&client_p->info, info, REALLEN);
+	who_index_update(client_p);
+}
+
 static void
 free_local_client(struct Client *client_p)
 {
@@ -220,6 +573,7 @@ free_local_client(struct Client *client_p)
 	/* not needed per-se, but in case start_auth_query never gets called... */
 	rb_free(client_p->localClient->lip);
 
+	del_local_sweep(client_p);
 	rb_free(client_p->localClient);
 	client_p->localClient = NULL;
 }
@@ -230,12 +584,14 @@ free_client(struct Client *client_p)
 	s_assert(NULL != client_p);
 	s_assert(&me != client_p);
 	rb_free(client_p->certfp);
+	who_index_del(client_p);
+	free_client_strings(client_p);
 	free_local_client(client_p);
 	rb_free(client_p);
 }
 
 /*
- * check_pings - go through the local client list and check activity
+ * check_pings - go through local_sweep and check activity
  * kill off stuff that should die
  *
  * inputs	- NOT USED (from event)
@@ -263,109 +619,105 @@ free_client(struct Client *client_p)
 static void
 check_pings(void *notused)
 {
-	check_pings_list(&lclient_list);
-	check_pings_list(&serv_list);
-	check_unknowns_list(&unknown_list);
+	unsigned int i;
+
+	for(i = 0; i < local_sweep.count; i++)
+	{
+		struct Client *client_p = local_sweep.client[i];
+
+		if(IsMe(client_p))
+			continue;
+
+		if(IsClient(client_p) || IsServer(client_p))
+			check_client_ping(client_p);
+		else
+			check_unknown(client_p);
+	}
 }
 
 /*
- * Check_pings_list()
+ * check_client_ping()
  *
- * inputs	- pointer to list to check
+ * inputs	- pointer to registered local client or server
  * output	- NONE
- * side effects	- 
+ * side effects	- client is pinged, or exited if it didn't answer the last one
  */
 static void
-check_pings_list(rb_dlink_list * list)
+check_client_ping(struct Client *client_p)
 {
 	char scratch[32];	/* way too generous but... */
 	int ping = 0;		/* ping time value from client */
-	rb_dlink_node *ptr, *next_ptr;
 
-	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, list->head)
-	{
-		struct Client *client_p = ptr->data;
+	/*
+	 ** Note: No need to notify opers here. It's
+	 ** already done when "FLAGS_DEADSOCKET" is set.
+	 */
+	if(!MyConnect(client_p) || IsDead(client_p))
+		return;
 
+	if(!IsRegistered(client_p))
+		ping = ConfigFileEntry.connect_timeout;
+	else
+		ping = get_client_ping(client_p);
+
+	if(ping < (rb_current_time() - LocalLastTime(client_p)))
+	{
 		/*
-		 ** Note: No need to notify opers here. It's
-		 ** already done when "FLAGS_DEADSOCKET" is set.
+		 * If the client/server hasnt talked to us in 2*ping seconds
+		 * and it has a ping time, then close its connection.
 		 */
-		if(!MyConnect(client_p) || IsDead(client_p))
-			continue;
-
-		if(!IsRegistered(client_p))
-			ping = ConfigFileEntry.connect_timeout;
-		else
-			ping = get_client_ping(client_p);
+		if(((rb_current_time() - LocalLastTime(client_p)) >= (2 * ping)
+		    && (client_p->flags & FLAGS_PINGSENT)))
+		{
+			if(IsAnyServer(client_p))
+			{
+				sendto_realops_flags(UMODE_ALL, L_ALL,
+						     "No response from %s, closing link", client_p->name);
+				ilog(L_SERVER,
+				     "No response from %s, closing link", log_client_name(client_p, HIDE_IP));
+			}
+			snprintf(scratch, sizeof(scratch),
+				 "Ping timeout: %d seconds",
+				 (int)(rb_current_time() - LocalLastTime(client_p)));
 
-		if(ping < (rb_current_time() - client_p->localClient->lasttime))
+			exit_client(client_p, client_p, &me, scratch);
+			return;
+		}
+		else if((client_p->flags & FLAGS_PINGSENT) == 0)
 		{
 			/*
-			 * If the client/server hasnt talked to us in 2*ping seconds
-			 * and it has a ping time, then close its connection.
+			 * if we havent PINGed the connection and we havent
+			 * heard from it in a while, PING it to make sure
+			 * it is still alive.
 			 */
-			if(((rb_current_time() - client_p->localClient->lasttime) >= (2 * ping)
-			    && (client_p->flags & FLAGS_PINGSENT)))
-			{
-				if(IsAnyServer(client_p))
-				{
-					sendto_realops_flags(UMODE_ALL, L_ALL,
-							     "No response from %s, closing link", client_p->name);
-					ilog(L_SERVER,
-					     "No response from %s, closing link", log_client_name(client_p, HIDE_IP));
-				}
-				snprintf(scratch, sizeof(scratch),
-					 "Ping timeout: %d seconds",
-					 (int)(rb_current_time() - client_p->localClient->lasttime));
-
-				exit_client(client_p, client_p, &me, scratch);
-				continue;
-			}
-			else if((client_p->flags & FLAGS_PINGSENT) == 0)
-			{
-				/*
-				 * if we havent PINGed the connection and we havent
-				 * heard from it in a while, PING it to make sure
-				 * it is still alive.
-				 */
-				client_p->flags |= FLAGS_PINGSENT;
-				/* not nice but does the job */
-				client_p->localClient->lasttime = rb_current_time() - ping;
-				sendto_one(client_p, "PING :%s", me.name);
-			}
+			client_p->flags |= FLAGS_PINGSENT;
+			/* not nice but does the job */
+			LocalLastTime(client_p) = rb_current_time() - ping;
+			sendto_one(client_p, "PING :%s", me.name);
 		}
-		/* ping_timeout: */
-
 	}
 }
 
 /*
- * check_unknowns_list
+ * check_unknown
  *
- * inputs	- pointer to list of unknown clients
+ * inputs	- pointer to unknown client
  * output	- NONE
  * side effects	- unknown clients get marked for termination after n seconds
  */
 static void
-check_unknowns_list(rb_dlink_list * list)
+check_unknown(struct Client *client_p)
 {
-	rb_dlink_node *ptr, *next_ptr;
-
-	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, list->head)
-	{
-		struct Client *client_p = ptr->data;
-
-		if(IsDead(client_p) || IsClosing(client_p))
-			continue;
+	if(IsDead(client_p) || IsClosing(client_p))
+		return;
 
-		/*
-		 * Check UNKNOWN connections - if they have been in this state
-		 * for > ConfigFileEntry.connect_timeout, close them.
-		 */
+	/*
+	 * Check UNKNOWN connections - if they have been in this state
+	 * for > ConfigFileEntry.connect_timeout, close them.
+	 */
 
-		if((rb_current_time() - client_p->localClient->firsttime) > ConfigFileEntry.connect_timeout)
-			exit_client(client_p, client_p, &me, "Connection timed out");
-	}
+	if((rb_current_time() - LocalFirstTime(client_p)) > ConfigFileEntry.connect_timeout)
+		exit_client(client_p, client_p, &me, "Connection timed out");
 }
 
 void
@@ -415,14 +767,14 @@ notify_banned_client(struct Client *client_p, struct ConfItem *aconf, int ban)
 void
 check_banned_lines(void)
 {
-	rb_dlink_node *ptr, *next_ptr;
+	unsigned int i;
 
-	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, lclient_list.head)
+	for(i = 0; i < local_sweep.count; i++)
 	{
-		struct Client *client_p = ptr->data;
+		struct Client *client_p = local_sweep.client[i];
 		struct ConfItem *aconf;
 
-		if(IsMe(client_p))
+		if(IsMe(client_p) || IsServer(client_p) || IsAnyDead(client_p))
 			continue;
 
 		/* if there is a returned struct ConfItem then kill it */
@@ -431,8 +783,9 @@ check_banned_lines(void)
 			if(aconf->status & CONF_EXEMPTDLINE)
 				continue;
 
-			sendto_realops_flags(UMODE_ALL, L_ALL,
-					     "DLINE active for %s", get_client_name(client_p, HIDE_IP));
+			if(IsClient(client_p))
+				sendto_realops_flags(UMODE_ALL, L_ALL,
+						     "DLINE active for %s", get_client_name(client_p, HIDE_IP));
 
 			notify_banned_client(client_p, aconf, D_LINED);
 			continue;	/* and go examine next fd/client_p */
@@ -497,21 +850,6 @@ check_banned_lines(void)
 			continue;
 		}
 	}
-
-	/* also check the unknowns list for new dlines */
-	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, unknown_list.head)
-	{
-		struct Client *client_p = ptr->data;
-                struct ConfItem *aconf;
-		if((aconf = find_dline((struct sockaddr *)&client_p->localClient->ip)))
-		{
-			if(aconf->status & CONF_EXEMPTDLINE)
-				continue;
-
-			notify_banned_client(client_p, aconf, D_LINED);
-		}
-	}
-
 }
 
 /* check_klines_event()
@@ -642,6 +980,7 @@ remove_client_from_list(struct Client *client_p)
 		return;
 
 	rb_dlinkDelete(&client_p->node, &global_client_list);
+	who_index_del(client_p);
 
 	update_client_exit_stats(client_p);
 }
@@ -928,6 +1267,62 @@ recurse_send_quits(struct Client *client_p, struct Client *source_p,
 	}
 }
 
+/*
+ * Users behind a split are exited together rather than one at a time,
+ * so their QUITs can be fanned out to local users in one corked pass
+ * before the rest of their state is torn down.
+ */
+static struct Client **split_exits;
+static size_t split_exits_count;
+static size_t split_exits_size;
+
+static void
+collect_split_clients(struct Client *source_p)
+{
+	rb_dlink_node *ptr;
+
+	if(source_p->serv == NULL)	/* oooops. uh this is actually a major bug */
+		return;
+
+	RB_DLINK_FOREACH(ptr, source_p->serv->users.head)
+	{
+		struct Client *target_p = ptr->data;
+		target_p->flags |= FLAGS_KILLED;
+
+		if(ConfigFileEntry.nick_delay > 0)
+			add_nd_entry(target_p->name);
+
+		if(IsDead(target_p) || IsClosing(target_p))
+			continue;
+
+		if(split_exits_count == split_exits_size)
+		{
+			split_exits_size = split_exits_size ? split_exits_size * 2 : 1024;
+			split_exits = rb_realloc(split_exits, sizeof(struct Client *) * split_exits_size);
+		}
+		split_exits[split_exits_count++] = target_p;
+	}
+
+	RB_DLINK_FOREACH(ptr, source_p->serv->servers.head)
+		collect_split_clients(ptr->data);
+}
+
+static void
+remove_split_servers(struct Client *source_p)
+{
+	rb_dlink_node *ptr, *ptr_next;
+
+	if(source_p->serv == NULL)
+		return;
+
+	RB_DLINK_FOREACH_SAFE(ptr, ptr_next, source_p->serv->servers.head)
+	{
+		struct Client *target_p = ptr->data;
+		remove_split_servers(target_p);
+		qs_server(target_p);
+	}
+}
+
 /* 
 ** Remove all clients that depend on source_p; assumes all (S)QUITs have
 ** already been sent.  we make sure to exit a server's dependent clients 
@@ -940,7 +1335,7 @@ recurse_send_quits(struct Client *client_p, struct Client *source_p,
 static void
 recurse_remove_clients(struct Client *source_p, const char *comment)
 {
-	rb_dlink_node *ptr, *ptr_next;
+	size_t i;
 
 	if(IsMe(source_p))
 		return;
@@ -948,37 +1343,29 @@ recurse_remove_clients(struct Client *source_p, const char *comment)
 	if(source_p->serv == NULL)	/* oooops. uh this is actually a major bug */
 		return;
 
-	/* this is very ugly, but it saves cpu :P */
-	if(ConfigFileEntry.nick_delay > 0)
-	{
-		RB_DLINK_FOREACH_SAFE(ptr, ptr_next, source_p->serv->users.head)
-		{
-			struct Client *target_p = ptr->data;
-			target_p->flags |= FLAGS_KILLED;
-			add_nd_entry(target_p->name);
+	split_exits_count = 0;
+	collect_split_clients(source_p);
 
-			if(!IsDead(target_p) && !IsClosing(target_p))
-				exit_remote_client(NULL, target_p, &me, comment);
-		}
-	}
-	else
+	sendto_common_channels_quits(split_exits, split_exits_count, comment);
+
+	for(i = 0; i < split_exits_count; i++)
 	{
-		RB_DLINK_FOREACH_SAFE(ptr, ptr_next, source_p->serv->users.head)
-		{
-			struct Client *target_p = ptr->data;
-			target_p->flags |= FLAGS_KILLED;
+		struct Client *target_p = split_exits[i];
 
-			if(!IsDead(target_p) && !IsClosing(target_p))
-				exit_remote_client(NULL, target_p, &me, comment);
-		}
+		remove_generic_client(target_p);
+		exit_remote_client_finish(NULL, target_p, comment);
 	}
 
-	RB_DLINK_FOREACH_SAFE(ptr, ptr_next, source_p->serv->servers.head)
+	/* don't hang on to a big array after a big split */
+	if(split_exits_size > 4096)
 	{
-		struct Client *target_p = ptr->data;
-		recurse_remove_clients(target_p, comment);
-		qs_server(target_p);
+		rb_free(split_exits);
+		split_exits = NULL;
+		split_exits_size = 0;
 	}
+	split_exits_count = 0;
+
+	remove_split_servers(source_p);
 }
 
 /*
@@ -1073,13 +1460,12 @@ dead_link(struct Client *client_p, bool sendqex)
 }
 
 
-/* This does the remove of the user from channels..local or remote */
-static inline void
-exit_generic_client(struct Client *source_p, const char *comment)
+/* This does the remove of the user from channels..local or remote,
+ * once their QUIT has been sent
+ */
+static void
+remove_generic_client(struct Client *source_p)
 {
-	sendto_common_channels_local(source_p, ":%s!%s@%s QUIT :%s",
-				     source_p->name, source_p->username, source_p->host, comment);
-
 	remove_user_from_channels(source_p);
 
 	/* Should not be in any channels now */
@@ -1101,6 +1487,15 @@ exit_generic_client(struct Client *source_p, const char *comment)
 	remove_client_from_list(source_p);
 }
 
+static inline void
+exit_generic_client(struct Client *source_p, const char *comment)
+{
+	sendto_common_channels_local(source_p, ":%s!%s@%s QUIT :%s",
+				     source_p->name, source_p->username, source_p->host, comment);
+
+	remove_generic_client(source_p);
+}
+
 /* 
  * Assumes IsClient(source_p) && !MyConnect(source_p)
  */
@@ -1109,7 +1504,13 @@ static int
 exit_remote_client(struct Client *client_p, struct Client *source_p, struct Client *from, const char *comment)
 {
 	exit_generic_client(source_p, comment);
+	return exit_remote_client_finish(client_p, source_p, comment);
+}
 
+/* the part of a remote exit after the client is off channels and hashes */
+static int
+exit_remote_client_finish(struct Client *client_p, struct Client *source_p, const char *comment)
+{
 	if(source_p->servptr && source_p->servptr->serv)
 	{
 		rb_dlinkDelete(&source_p->lnode, &source_p->servptr->serv->users);
@@ -1288,10 +1689,10 @@ exit_local_server(struct Client *client_p, struct Client *source_p, struct Clien
 		remove_dependents(client_p, source_p, IsClient(from) ? newcomment : comment, comment1);
 
 	sendto_realops_flags(UMODE_ALL, L_ALL, "%s was connected for %" RBTT_FMT " seconds. %" PRIu64 "/%" PRIu64 " send/recv.",
-			     source_p->name, (rb_current_time() - source_p->localClient->firsttime), sendb, recvb);
+			     source_p->name, (rb_current_time() - LocalFirstTime(source_p)), sendb, recvb);
 
 	ilog(L_SERVER, "%s was connected for %" RBTT_FMT " seconds. %" PRIu64 "/%" PRIu64 " send/recv.",
-	     source_p->name, (rb_current_time() - source_p->localClient->firsttime), sendb, recvb);
+	     source_p->name, (rb_current_time() - LocalFirstTime(source_p)), sendb, recvb);
 
 	if(has_id(source_p))
 		hash_del(HASH_ID, source_p->id, source_p);
@@ -1343,7 +1744,7 @@ exit_local_client(struct Client *client_p, struct Client *source_p, struct Clien
 			     source_p->name, source_p->username, source_p->host,
 			     show_ip(NULL, source_p) ? source_p->sockhost : "255.255.255.255", comment);
 
-	on_for = rb_current_time() - source_p->localClient->firsttime;
+	on_for = rb_current_time() - LocalFirstTime(source_p);
 
 	ilog(L_USER, "%s (%3lu:%02lu:%02lu): %s!%s@%s %s %" PRIu64 "/%" PRIu64 "",
 	     rb_ctime(rb_current_time(), tbuf, sizeof(tbuf)), on_for / 3600,
@@ -1492,6 +1893,75 @@ count_remote_client_memory(size_t * count, size_t * remote_client_memory_used)
  */
 
 
+/*
+ * Each accept is a struct accept_link, which sits on both lists above
+ * and is found through HASH_ACCEPT by its (target, source) pair, so it
+ * can be tested for and removed without walking either list.
+ */
+struct accept_link
+{
+	rb_dlink_node node;	/* on target's allow_list, data is source */
+	rb_dlink_node onode;	/* on source's on_allow_list, data is target */
+};
+
+/*
+ * add_accept()
+ *
+ * inputs	- client whose accept list to add to, client to add
+ * output	- NONE
+ * side effects - source is added to targets accept list
+ */
+void
+add_accept(struct Client *target_p, struct Client *source_p)
+{
+	struct Client *key[2] = { target_p, source_p };
+	struct accept_link *alink;
+
+	alink = rb_malloc(sizeof(struct accept_link));
+	rb_dlinkAdd(source_p, &alink->node, &target_p->localClient->allow_list);
+	rb_dlinkAdd(target_p, &alink->onode, &source_p->on_allow_list);
+	hash_add_len(HASH_ACCEPT, key, sizeof(key), alink);
+}
+
+/*
+ * find_accept()
+ *
+ * inputs	- client whose accept list to search, client to look for
+ * output	- true if source is on targets accept list
+ * side effects - NONE
+ */
+bool
+find_accept(struct Client *target_p, struct Client *source_p)
+{
+	struct Client *key[2] = { target_p, source_p };
+
+	return hash_find_len(HASH_ACCEPT, key, sizeof(key)) != NULL;
+}
+
+/*
+ * del_accept()
+ *
+ * inputs	- client whose accept list to remove from, client to remove
+ * output	- NONE
+ * side effects - source is removed from targets accept list, if it was there
+ */
+void
+del_accept(struct Client *target_p, struct Client *source_p)
+{
+	struct Client *key[2] = { target_p, source_p };
+	struct accept_link *alink;
+	hash_node *hnode;
+
+	if((hnode = hash_find_len(HASH_ACCEPT, key, sizeof(key))) == NULL)
+		return;
+
+	alink = hnode->data;
+	rb_dlinkDelete(&alink->node, &target_p->localClient->allow_list);
+	rb_dlinkDelete(&alink->onode, &source_p->on_allow_list);
+	hash_del_hnode(HASH_ACCEPT, hnode);
+	rb_free(alink);
+}
+
 /*
  * del_all_accepts
  *
@@ -1514,18 +1984,30 @@ del_all_accepts(struct Client *client_p)
 
 		RB_DLINK_FOREACH_SAFE(ptr, next_ptr, client_p->localClient->allow_list.head)
 		{
-			struct Client *target_p = ptr->data;
-			rb_dlinkFindDestroy(client_p, &target_p->on_allow_list);
-			rb_dlinkDestroy(ptr, &client_p->localClient->allow_list);
+			del_accept(client_p, ptr->data);
 		}
 	}
 
 	/* remove this client from everyones accept list */
+	del_on_accepts(client_p);
+}
+
+/*
+ * del_on_accepts
+ *
+ * inputs	- pointer to client
+ * output	- NONE
+ * side effects - client is removed from everyones accept list
+ */
+void
+del_on_accepts(struct Client *client_p)
+{
+	rb_dlink_node *ptr;
+	rb_dlink_node *next_ptr;
+
 	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, client_p->on_allow_list.head)
 	{
-		struct Client *target_p = ptr->data;
-		rb_dlinkFindDestroy(client_p, &target_p->localClient->allow_list);
-		rb_dlinkDestroy(ptr, &client_p->on_allow_list);
+		del_accept(ptr->data, client_p);
 	}
 }
 
@@ -1720,7 +2202,7 @@ close_connection(struct Client *client_p)
 		ServerStats.is_sv++;
 		ServerStats.is_sbs += client_p->localClient->sendB;
 		ServerStats.is_sbr += client_p->localClient->receiveB;
-		ServerStats.is_sti += (uint64_t) (rb_current_time() - client_p->localClient->firsttime);
+		ServerStats.is_sti += (uint64_t) (rb_current_time() - LocalFirstTime(client_p));
 
 		/*
 		 * If the connection has been up for a long amount of time, schedule
@@ -1736,7 +2218,7 @@ close_connection(struct Client *client_p)
 			 */
 			server_p->hold = rb_current_time();
 			server_p->hold +=
-				(server_p->hold - client_p->localClient->lasttime >
+				(server_p->hold - LocalLastTime(client_p) >
 				 HANGONGOODLINK) ? HANGONRETRYDELAY : ConFreq(server_p->class);
 		}
 
@@ -1746,7 +2228,7 @@ close_connection(struct Client *client_p)
 		ServerStats.is_cl++;
 		ServerStats.is_cbs += client_p->localClient->sendB;
 		ServerStats.is_cbr += client_p->localClient->receiveB;
-		ServerStats.is_cti += (rb_current_time() - client_p->localClient->firsttime);
+		ServerStats.is_cti += (rb_current_time() - LocalFirstTime(client_p));
 	}
 	else
 		ServerStats.is_ni++;
@@ -1805,7 +2287,7 @@ error_exit_client(struct Client *client_p, int error)
 
 	if(IsServer(client_p) || IsHandshake(client_p))
 	{
-		time_t connected = rb_current_time() - client_p->localClient->firsttime;
+		time_t connected = rb_current_time() - LocalFirstTime(client_p);
 
 		if(error == 0)
 		{
@@ -1841,6 +2323,23 @@ find_id(const char *name)
 	return hash_find_data(HASH_ID, name);
 }
 
+/* find_connid()
+ *
+ * inputs	- connection id of a local client
+ * outputs	- the client, NULL if it has gone or is on its way out
+ * side effects -
+ */
+struct Client *
+find_connid(uint32_t connid)
+{
+	struct Client *client_p;
+
+	client_p = hash_find_data_len(HASH_CONNID, &connid, sizeof(connid));
+	if(client_p == NULL || IsAnyDead(client_p))
+		return NULL;
+	return client_p;
+}
+
 /* hash_find_masked_server()
  * 
  * Whats happening in this next loop ? Well, it takes a name like
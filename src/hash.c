@@ -46,36 +46,49 @@
 /*
  * Hashing.
  *
- *   The server uses a chained hash table to provide quick and efficient
- * hash table maintenance (providing the hash function works evenly over
- * the input range).  The hash table is thus not susceptible to problems
- * of filling all the buckets or the need to rehash.
- *    It is expected that the hash table would look something like this
- * during use:
- *		     +-----+	+-----+	   +-----+   +-----+
- *		  ---| 224 |----| 225 |----| 226 |---| 227 |---
- *		     +-----+	+-----+	   +-----+   +-----+
- *			|	   |	      |
- *		     +-----+	+-----+	   +-----+
- *		     |	A  |	|  C  |	   |  D	 |
- *		     +-----+	+-----+	   +-----+
- *			|
- *		     +-----+
- *		     |	B  |
- *		     +-----+
+ *   The server uses open addressed hash tables with Robin Hood probing.
+ * Each slot holds the full 32 bit hash value of its entry next to a
+ * pointer to the hash_node, so a lookup walks one contiguous array and
+ * only follows the pointer to compare keys when the hash values match.
  *
- * A - GOPbot, B - chang, C - hanuaway, D - *.mu.OZ.AU
+ *	  slots:  | 3f1a A | 3f1b C | 0000 - | 7c02 D | 3f1a B | ...
+ *			|	 |		  |	   |
+ *		     hash_node	...		 ...	  ...
  *
- * The order shown above is just one instant of the server. 
+ *   Robin Hood insertion keeps every entry as close as possible to its
+ * home slot by displacing entries that are closer to theirs, so a
+ * lookup may stop as soon as it meets an entry that is nearer home than
+ * the key it is looking for would be.  Deleting shifts the following
+ * entries back one slot, so there are no tombstones.
  *
+ *   When a table gets too full a table of twice the size is allocated
+ * and the old one is drained into it a few entries at a time from every
+ * add and delete, so no single operation has to rehash the whole table.
+ * While that happens lookups check both tables.  Tables that empty out
+ * shrink the same way, down to the size they were created with.
  *
- * The hash functions currently used are based Fowler/Noll/Vo hashes
- * which work amazingly well and have a extremely low collision rate
- * For more info see http://www.isthe.com/chongo/tech/comp/fnv/index.html
+ *   Entries that share a key (several clients on one host, say) hang off
+ * a single slot on a list, so they do not lengthen the probe sequence
+ * for everything else.  hash_nodes themselves never move, so callers
+ * may keep hold of them.
+ *
+ * String keys are hashed and compared eight bytes at a time, see
+ * hash_words() and irc_memcaseeq().  Binary keys still use a
+ * Fowler/Noll/Vo hash, for more info on those see
+ * http://www.isthe.com/chongo/tech/comp/fnv/index.html
  *
  * 
  */
 
+/* grow once a table is three quarters full, shrink below an eighth */
+#define HASH_GROW_NUM	3
+#define HASH_GROW_DEN	4
+#define HASH_SHRINK_NUM	1
+#define HASH_SHRINK_DEN	8
+
+/* entries moved to the new table per add/delete while resizing */
+#define HASH_MIGRATE_STEP	8
+
 hash_f *hash_client;
 hash_f *hash_id;
 hash_f *hash_channel;
@@ -90,6 +103,12 @@ hash_f *hash_connid;
 hash_f *hash_zconnid;
 hash_f *hash_monitor;
 hash_f *hash_command;
+hash_f *hash_intern;
+hash_f *hash_accept;
+hash_f *hash_monlink;
+hash_f *hash_ban;
+hash_f *hash_reject;
+hash_f *hash_throttle;
 
 /* init_hash()
  *
@@ -98,127 +117,421 @@ hash_f *hash_command;
 void
 init_hash(void)
 {
-	hash_client = hash_create("NICK", CMP_IRCCMP, U_MAX_BITS, 0);
-	hash_id = hash_create("ID", CMP_STRCMP, U_MAX_BITS, 0);
-	hash_channel = hash_create("Channel", CMP_IRCCMP, CH_MAX_BITS, 30);
-	hash_hostname = hash_create("Host", CMP_IRCCMP, HOST_MAX_BITS, 30);
-	hash_resv = hash_create("Channel RESV", CMP_IRCCMP, R_MAX_BITS, 30);
-	hash_oper = hash_create("Operator", CMP_IRCCMP, OPERHASH_MAX_BITS, 0);
-	hash_scache = hash_create("Server", CMP_IRCCMP, SCACHE_MAX_BITS, 0);
-	hash_help = hash_create("Help", CMP_IRCCMP, HELP_MAX_BITS, 10);
-	hash_ohelp = hash_create("Operator Help", CMP_IRCCMP, HELP_MAX_BITS, 10);
-	hash_nd = hash_create("ND", CMP_IRCCMP, U_MAX_BITS, 0);
-	hash_connid = hash_create("Connection ID", CMP_MEMCMP, CLI_CONNID_MAX_BITS, sizeof(uint32_t));
-	hash_zconnid = hash_create("Ziplinks ID", CMP_MEMCMP, CLI_ZCONNID_MAX_BITS, sizeof(uint32_t));
-	hash_monitor = hash_create("MONITOR", CMP_IRCCMP, MONITOR_MAX_BITS, 0);
-	hash_command = hash_create("Command", CMP_IRCCMP, COMMAND_MAX_BITS, 10);
+	hash_client = hash_create("NICK", CMP_IRCCMP, U_MIN_BITS, 0);
+	hash_id = hash_create("ID", CMP_STRCMP, U_MIN_BITS, 0);
+	hash_channel = hash_create("Channel", CMP_IRCCMP, CH_MIN_BITS, 30);
+	hash_hostname = hash_create("Host", CMP_IRCCMP, HOST_MIN_BITS, 30);
+	hash_resv = hash_create("Channel RESV", CMP_IRCCMP, R_MIN_BITS, 30);
+	hash_oper = hash_create("Operator", CMP_IRCCMP, OPERHASH_MIN_BITS, 0);
+	hash_scache = hash_create("Server", CMP_IRCCMP, SCACHE_MIN_BITS, 0);
+	hash_help = hash_create("Help", CMP_IRCCMP, HELP_MIN_BITS, 10);
+	hash_ohelp = hash_create("Operator Help", CMP_IRCCMP, HELP_MIN_BITS, 10);
+	hash_nd = hash_create("ND", CMP_IRCCMP, U_MIN_BITS, 0);
+	hash_connid = hash_create("Connection ID", CMP_MEMCMP, CLI_CONNID_MIN_BITS, sizeof(uint32_t));
+	hash_zconnid = hash_create("Ziplinks ID", CMP_MEMCMP, CLI_ZCONNID_MIN_BITS, sizeof(uint32_t));
+	hash_monitor = hash_create("MONITOR", CMP_IRCCMP, MONITOR_MIN_BITS, 0);
+	hash_command = hash_create("Command", CMP_IRCCMP, COMMAND_MIN_BITS, 10);
+	hash_intern = hash_create("Strings", CMP_STRCMP, INTERN_MIN_BITS, 0);
+	hash_accept = hash_create("Accept", CMP_MEMCMP, ACCEPT_MIN_BITS, 2 * sizeof(void *));
+	hash_monlink = hash_create("MONITOR users", CMP_MEMCMP, MONLINK_MIN_BITS, 2 * sizeof(void *));
+	hash_ban = hash_create("Bans", CMP_MEMCMP, BAN_MIN_BITS, sizeof(void *) + BANLEN);
+	hash_reject = hash_create("Reject", CMP_MEMCMP, REJECT_MIN_BITS, sizeof(struct in6_addr));
+	hash_throttle = hash_create("Throttle", CMP_MEMCMP, THROTTLE_MIN_BITS, sizeof(struct in6_addr));
+}
+
+/* the hashes are weak in their low bits, which are the ones used to
+ * pick a slot, so give the result a final mix
+ */
+static inline uint32_t
+hash_mix(uint32_t h)
+{
+	h ^= h >> 16;
+	h *= 0x7feb352dUL;
+	h ^= h >> 15;
+	return h;
 }
 
 /* fnv_hash_len_data hashses any data */
 static uint32_t
-fnv_hash_len_data(const unsigned char *s, unsigned int bits, size_t len)
+fnv_hash_len_data(const unsigned char *s, size_t len)
 {
 	uint32_t h = FNV1_32_INIT;
-	bits = 32 - bits;
 	const unsigned char *x = s + len;
 	while(s < x)
 	{
 		h ^= *s++;
 		h += (h << 1) + (h << 4) + (h << 7) + (h << 8) + (h << 24);
 	}
-	h = (h >> bits) ^ (h & ((2 ^ bits) - 1));
-	return h;
+	return hash_mix(h);
 }
 
-static uint32_t
-fnv_hash_upper(const unsigned char *s, unsigned int bits, size_t unused)
+/* string keys are hashed eight bytes at a time, folding case with
+ * irc_toupper_word() as they go for the irccmp() hashes.  The last
+ * partial word is picked up with loads that overlap ones already
+ * made, which is fine as the length is mixed in as well.
+ */
+#define HASH_WORD_MUL	0x9e3779b97f4a7c15ULL
+
+static inline uint64_t
+hash_word_step(uint64_t h, uint64_t w)
 {
-	uint32_t h = FNV1_32_INIT;
-	bits = 32 - bits;
-	while(*s)
+	h = (h ^ w) * HASH_WORD_MUL;
+	return h ^ (h >> 32);
+}
+
+static inline uint32_t
+hash_words(const unsigned char *s, size_t len, bool fold)
+{
+	uint64_t h = FNV1_32_INIT ^ len;
+	uint64_t w;
+	uint32_t head, tail;
+	size_t i;
+
+	if(len >= sizeof(uint64_t))
 	{
-		h ^= ToUpper(*s++);
-		h += (h << 1) + (h << 4) + (h << 7) + (h << 8) + (h << 24);
+		for(i = 0; i + sizeof(uint64_t) < len; i += sizeof(uint64_t))
+		{
+			w = irc_load_word(s + i);
+			h = hash_word_step(h, fold ? irc_toupper_word(w) : w);
+		}
+		w = irc_load_word(s + len - sizeof(uint64_t));
 	}
-	h = (h >> bits) ^ (h & ((2 ^ bits) - 1));
-	return h;
+	else if(len >= sizeof(uint32_t))
+	{
+		memcpy(&head, s, sizeof(head));
+		memcpy(&tail, s + len - sizeof(tail), sizeof(tail));
+		w = head | (uint64_t)tail << 32;
+	}
+	else if(len > 0)
+		w = s[0] | (uint64_t)s[len >> 1] << 8 | (uint64_t)s[len - 1] << 16;
+	else
+		w = 0;
+
+	h = hash_word_step(h, fold ? irc_toupper_word(w) : w);
+	return hash_mix((uint32_t)h);
 }
 
+/* string hashes stop at the terminator or len, whichever comes first */
 static uint32_t
-fnv_hash(const unsigned char *s, unsigned int bits, size_t unused)
+hash_string(const unsigned char *s, size_t len)
 {
-	uint32_t h = FNV1_32_INIT;
-	bits = 32 - bits;
-	while(*s)
+	return hash_words(s, rb_strnlen((const char *)s, len), false);
+}
+
+static uint32_t
+hash_string_upper(const unsigned char *s, size_t len)
+{
+	return hash_words(s, rb_strnlen((const char *)s, len), true);
+}
+
+/* hash_irccase()
+ *
+ * inputs	- string
+ * outputs	- the irccmp() hash of it, for tables kept outside of hash_f
+ * side effects -
+ */
+uint32_t
+hash_irccase(const char *s)
+{
+	return hash_words((const unsigned char *)s, strlen(s), true);
+}
+
+struct hash_slot
+{
+	uint32_t hashv;
+	hash_node *hnode;	/* NULL if the slot is free */
+};
+
+struct hash_table
+{
+	struct hash_slot *slots;
+	unsigned int bits;
+	unsigned int mask;	/* number of slots - 1 */
+	unsigned int count;	/* slots in use */
+};
+
+struct _hash_function
+{
+	char *name;
+	uint32_t(*func) (unsigned const char *, size_t);
+	hash_cmptype cmptype;
+	struct hash_table table;	/* current table, new keys go here */
+	struct hash_table old;		/* previous table, drained during a resize */
+	unsigned int migrate_pos;	/* next slot of old to drain */
+	unsigned int entries;
+	unsigned int hashbits;		/* smallest size we shrink to */
+	unsigned int hashlen;
+	unsigned long grows;
+	unsigned long shrinks;
+	unsigned long lookups;
+	unsigned long probes;
+};
+
+static rb_dlink_list list_of_hashes;
+
+/* how far the entry in slot pos is from its home slot */
+#define SLOT_DIST(t, pos) (((pos) - (t)->slots[(pos)].hashv) & (t)->mask)
+
+static void
+hash_table_init(struct hash_table *t, unsigned int bits)
+{
+	t->slots = rb_malloc(sizeof(struct hash_slot) * (1U << bits));
+	t->bits = bits;
+	t->mask = (1U << bits) - 1;
+	t->count = 0;
+}
+
+static void
+hash_table_insert(struct hash_table *t, uint32_t hashv, hash_node *hnode)
+{
+	struct hash_slot cur, tmp;
+	unsigned int pos, dist, sdist;
+
+	cur.hashv = hashv;
+	cur.hnode = hnode;
+	pos = hashv & t->mask;
+	dist = 0;
+
+	for(;;)
 	{
-		h ^= *s++;
-		h += (h << 1) + (h << 4) + (h << 7) + (h << 8) + (h << 24);
+		struct hash_slot *slot = &t->slots[pos];
+
+		if(slot->hnode == NULL)
+		{
+			*slot = cur;
+			t->count++;
+			return;
+		}
+
+		/* take the slot from anyone closer to home than we are */
+		sdist = SLOT_DIST(t, pos);
+		if(sdist < dist)
+		{
+			tmp = *slot;
+			*slot = cur;
+			cur = tmp;
+			dist = sdist;
+		}
+
+		pos = (pos + 1) & t->mask;
+		dist++;
 	}
-	h = (h >> bits) ^ (h & ((2 ^ bits) - 1));
-	return h;
 }
 
-#if 1				/* unused currently */
+/* remove the slot at pos, shifting the rest of its run back one */
+static void
+hash_table_remove(struct hash_table *t, unsigned int pos)
+{
+	unsigned int next;
+
+	for(;;)
+	{
+		next = (pos + 1) & t->mask;
+		if(t->slots[next].hnode == NULL || SLOT_DIST(t, next) == 0)
+			break;
+		t->slots[pos] = t->slots[next];
+		pos = next;
+	}
 
-static uint32_t
-fnv_hash_len(const unsigned char *s, unsigned int bits, size_t len)
+	t->slots[pos].hnode = NULL;
+	t->count--;
+}
+
+/* keys are stored with their length, and every string key is passed in
+ * as strlen() + 1, so keys of different lengths can never match and
+ * the rest can be compared knowing where they end
+ */
+static inline bool
+hash_do_cmp(hash_f *hfunc, const void *x, size_t len, hash_node *hnode)
 {
-	uint32_t h = FNV1_32_INIT;
-	bits = 32 - bits;
-	const unsigned char *x = s + len;
-	while(*s && s < x)
+	if(len != hnode->keylen)
+		return false;
+
+	switch (hfunc->cmptype)
 	{
-		h ^= *s++;
-		h += (h << 1) + (h << 4) + (h << 7) + (h << 8) + (h << 24);
+	case CMP_IRCCMP:
+		return irc_memcaseeq(x, hnode->key, len);
+	case CMP_STRCMP:
+	case CMP_MEMCMP:
+		return memcmp(x, hnode->key, len) == 0;
 	}
-	h = (h >> bits) ^ (h & ((2 ^ bits) - 1));
-	return h;
+	return false;
 }
-#endif
 
-static uint32_t
-fnv_hash_upper_len(const unsigned char *s, unsigned int bits, size_t len)
+/* hash_table_find()
+ *
+ * inputs	- hash, table, key, length of key, hash value of key
+ * outputs	- slot holding the entries for key, or -1
+ * side effects -
+ */
+static int
+hash_table_find(hash_f *hf, struct hash_table *t, const void *hashindex, size_t len,
+		uint32_t hashv)
 {
-	uint32_t h = FNV1_32_INIT;
-	bits = 32 - bits;
-	const unsigned char *x = s + len;
-	while(*s && s < x)
+	unsigned int pos, dist = 0;
+
+	if(t->slots == NULL)
+		return -1;
+
+	hf->lookups++;
+	pos = hashv & t->mask;
+	for(;;)
 	{
-		h ^= ToUpper(*s++);
-		h += (h << 1) + (h << 4) + (h << 7) + (h << 8) + (h << 24);
+		struct hash_slot *slot = &t->slots[pos];
+
+		hf->probes++;
+
+		/* an entry nearer its home than we would be means
+		 * we would have been put in its place
+		 */
+		if(slot->hnode == NULL || SLOT_DIST(t, pos) < dist)
+			return -1;
+
+		if(slot->hashv == hashv && hash_do_cmp(hf, hashindex, len, slot->hnode))
+			return pos;
+
+		pos = (pos + 1) & t->mask;
+		dist++;
 	}
-	h = (h >> bits) ^ (h & ((2 ^ bits) - 1));
-	return h;
 }
 
+/* hash_lookup()
+ *
+ * inputs	- hash, key, length of key, hash value of key, table
+ * outputs	- slot holding the entries for key, or -1, and the
+ *		  table it was found in
+ * side effects -
+ */
+static int
+hash_lookup(hash_f *hf, const void *hashindex, size_t len, uint32_t hashv,
+	    struct hash_table **t)
+{
+	int pos;
+
+	*t = &hf->table;
+	if((pos = hash_table_find(hf, *t, hashindex, len, hashv)) >= 0)
+		return pos;
+
+	*t = &hf->old;
+	return hash_table_find(hf, *t, hashindex, len, hashv);
+}
+
+/* hash_unlink()
+ *
+ * inputs	- table, slot, node to remove
+ * outputs	-
+ * side effects - node is taken off the slot's list, and the slot freed
+ *		  if that was the last one
+ */
 static void
-free_hashnode(hash_node * hnode)
+hash_unlink(struct hash_table *t, unsigned int pos, hash_node *hnode)
 {
-	rb_free(hnode->key);
-	rb_free(hnode);
+	hash_node **link;
+
+	for(link = &t->slots[pos].hnode; *link != NULL; link = &(*link)->next)
+	{
+		if(*link != hnode)
+			continue;
+
+		*link = hnode->next;
+		if(t->slots[pos].hnode == NULL)
+			hash_table_remove(t, pos);
+		return;
+	}
 }
 
-typedef bool hash_cmp(const void *x, const void *y, size_t len);
+/* hash_migrate()
+ *
+ * inputs	- hash, number of slots to move
+ * outputs	-
+ * side effects - moves slots from the old table to the current one,
+ *		  freeing the old table once it is empty
+ */
+static void
+hash_migrate(hash_f *hf, unsigned int steps)
+{
+	struct hash_table *old = &hf->old;
+
+	while(old->slots != NULL)
+	{
+		if(old->count == 0)
+		{
+			rb_free(old->slots);
+			old->slots = NULL;
+			hf->migrate_pos = 0;
+			return;
+		}
+
+		if(steps-- == 0)
+			return;
 
+		/* nothing gets added to the old table, and removing a slot
+		 * only ever shifts later ones back onto it, so a single pass
+		 * over it finds everything
+		 */
+		while(old->slots[hf->migrate_pos].hnode == NULL)
+			hf->migrate_pos = (hf->migrate_pos + 1) & old->mask;
 
-struct _hash_function
+		hash_table_insert(&hf->table, old->slots[hf->migrate_pos].hashv,
+				  old->slots[hf->migrate_pos].hnode);
+		hash_table_remove(old, hf->migrate_pos);
+	}
+}
+
+/* hash_resize()
+ *
+ * inputs	- hash, new size in bits
+ * outputs	-
+ * side effects - a new current table is allocated, and the existing one
+ *		  left to be drained into it by hash_migrate()
+ */
+static void
+hash_resize(hash_f *hf, unsigned int bits)
 {
-	char *name;
-	uint32_t(*func) (unsigned const char *, unsigned int, size_t);
-	hash_cmptype cmptype;
-	rb_dlink_list **htable;
-	unsigned int hashbits;
-	unsigned int hashlen;
-};
+	/* finish off any resize still in progress first */
+	hash_migrate(hf, UINT_MAX);
 
-static rb_dlink_list list_of_hashes;
+	hf->old = hf->table;
+	hf->migrate_pos = 0;
+	hash_table_init(&hf->table, bits);
+}
+
+/* hash_deleted()
+ *
+ * inputs	- hash that just lost an entry
+ * outputs	-
+ * side effects - moves a resize along, or starts shrinking the table
+ */
+static void
+hash_deleted(hash_f *hf)
+{
+	struct hash_table *t = &hf->table;
+
+	hash_migrate(hf, HASH_MIGRATE_STEP);
+
+	if(hf->old.slots != NULL || t->bits <= hf->hashbits)
+		return;
+
+	if(t->count * HASH_SHRINK_DEN < (t->mask + 1) * HASH_SHRINK_NUM)
+	{
+		hf->shrinks++;
+		hash_resize(hf, t->bits - 1);
+	}
+}
+
+static void
+free_hashnode(hash_node * hnode)
+{
+	rb_free(hnode);
+}
 
 static void
 hash_free(hash_f *hf)
 {
 	rb_dlinkFindDestroy(hf, &list_of_hashes);
 	rb_free(hf->name);
-	rb_free(hf->htable);
+	rb_free(hf->table.slots);
+	rb_free(hf->old.slots);
 	rb_free(hf);
 }
 
@@ -235,22 +548,16 @@ hash_create(const char *name, hash_cmptype cmptype, unsigned int hashbits, unsig
 
 	hfunc->name = rb_strdup(name);
 	hfunc->hashbits = hashbits;
-	hfunc->htable = rb_malloc(sizeof(rb_dlink_list *) * (1 << hashbits));
+	hash_table_init(&hfunc->table, hashbits);
 	hfunc->cmptype = cmptype;
 	hfunc->hashlen = maxkeylen; 
 	switch(cmptype)
 	{
 		case CMP_IRCCMP:
-			if(hfunc->hashlen > 0)
-				hfunc->func = fnv_hash_upper_len;
-			else
-				hfunc->func = fnv_hash_upper;
+			hfunc->func = hash_string_upper;
 			break;
 		case CMP_STRCMP:
-			if(hfunc->hashlen > 0)
-				hfunc->func = fnv_hash_len;
-			else
-				hfunc->func = fnv_hash;
+			hfunc->func = hash_string;
 			break;
 		case CMP_MEMCMP:
 			hfunc->func = fnv_hash_len_data;
@@ -264,22 +571,15 @@ hash_create(const char *name, hash_cmptype cmptype, unsigned int hashbits, unsig
 
 static inline uint32_t do_hfunc(hash_f *hf, const void *hashindex, size_t hashlen)
 {
-	return hf->func((unsigned const char *)hashindex, hf->hashbits, hashlen);
+	return hf->func((unsigned const char *)hashindex, hashlen);
 }
 
-static inline int
-hash_do_cmp(hash_f *hfunc, const void *x, const void *y, size_t len)
+static inline size_t
+hash_keylen(hash_f *hf, size_t size)
 {
-	switch (hfunc->cmptype)
-	{
-	case CMP_IRCCMP:
-		return irccmp(x, y);
-	case CMP_STRCMP:
-		return strcmp(x, y);
-	case CMP_MEMCMP:
-		return memcmp(x, y, len);
-	}
-	return -1;
+	if(hf->hashlen == 0)
+		return size;
+	return IRCD_MIN(size, hf->hashlen);
 }
 
 void
@@ -296,40 +596,27 @@ hash_free_list(rb_dlink_list * table)
 rb_dlink_list *
 hash_find_list_len(hash_f *hf, const void *hashindex, size_t size)
 {
-	rb_dlink_list *bucket;
+	struct hash_table *t;
 	rb_dlink_list *results;
+	hash_node *hnode;
 	size_t hashlen;
 	uint32_t hashv;
-	rb_dlink_node *ptr;
+	int pos;
 
 	if(hashindex == NULL || hf == NULL)
 		return NULL;
 
-	if(hf->hashlen == 0)
-		hashlen = size;
-	else
-		hashlen = IRCD_MIN(size, hf->hashlen);
-
+	hashlen = hash_keylen(hf, size);
 	hashv = do_hfunc(hf, hashindex, hashlen);
-	
-	if(hf->htable[hashv] == NULL)
-		return NULL;
 
-	bucket = hf->htable[hashv];
+	if((pos = hash_lookup(hf, hashindex, size, hashv, &t)) < 0)
+		return NULL;
 
 	results = rb_malloc(sizeof(rb_dlink_list));
 
-	RB_DLINK_FOREACH(ptr, bucket->head)
-	{
-		hash_node *hnode = ptr->data;
-		if(hash_do_cmp(hf, hashindex, hnode->key, hashlen) == 0)
-			rb_dlinkAddAlloc(hnode->data, results);
-	}
-	if(rb_dlink_list_length(results) == 0)
-	{
-		rb_free(results);
-		return NULL;
-	}
+	for(hnode = t->slots[pos].hnode; hnode != NULL; hnode = hnode->next)
+		rb_dlinkAddAlloc(hnode->data, results);
+
 	return results;
 }
 
@@ -344,35 +631,21 @@ hash_find_list(hash_f *hf, const char *hashindex)
 hash_node *
 hash_find_len(hash_f *hf, const void *hashindex, size_t size)
 {
-	rb_dlink_list *bucket; // = hash_function[type].table;
-
+	struct hash_table *t;
 	size_t hashlen;
 	uint32_t hashv;
-	rb_dlink_node *ptr;
+	int pos;
 
 	if(hf == NULL || hashindex == NULL)
 		return NULL;
 
-	if(hf->hashlen == 0)
-		hashlen = size;
-	else
-		hashlen = IRCD_MIN(size, hf->hashlen);
-
+	hashlen = hash_keylen(hf, size);
 	hashv = do_hfunc(hf, hashindex, hashlen);
-	
-	if(hf->htable[hashv] == NULL)
-		return NULL;
-	
-	bucket = hf->htable[hashv];
 
-	RB_DLINK_FOREACH(ptr, bucket->head)
-	{
-		hash_node *hnode = ptr->data;
+	if((pos = hash_lookup(hf, hashindex, size, hashv, &t)) < 0)
+		return NULL;
 
-		if(hash_do_cmp(hf, hashindex, hnode->key, hashlen) == 0)
-			return hnode;
-	}
-	return NULL;
+	return t->slots[pos].hnode;
 }
 
 hash_node *
@@ -401,43 +674,44 @@ hash_find_data(hash_f *hf, const char *hashindex)
 	return hash_find_data_len(hf, hashindex, strlen(hashindex) + 1);
 }
 
-static rb_dlink_list *
-hash_allocate_bucket(hash_f *hf, uint32_t hashv)
-{
-	if(hf->htable[hashv] != NULL)
-		return hf->htable[hashv];
-	hf->htable[hashv] = rb_malloc(sizeof(rb_dlink_list));
-	return hf->htable[hashv];
-}
-
-static void
-hash_free_bucket(hash_f *hf, uint32_t hashv)
-{
-	if(rb_dlink_list_length(hf->htable[hashv]) > 0)
-		return;
-	rb_free(hf->htable[hashv]);
-	hf->htable[hashv] = NULL;
-}
-
 hash_node *
 hash_add_len(hash_f *hf, const void *hashindex, size_t indexlen, void *pointer)
 {
-	rb_dlink_list *bucket; // = hash_function[type].table;
+	struct hash_table *t;
 	hash_node *hnode;
-	uint32_t hashv;
+	size_t hashlen;
+	int pos;
 
 	if(hf == NULL || hashindex == NULL || pointer == NULL)
 		return NULL;
 
-	hashv = do_hfunc(hf, hashindex, IRCD_MIN(indexlen, hf->hashlen));
-	bucket = hash_allocate_bucket(hf, hashv);
-	hnode = rb_malloc(sizeof(hash_node));
-	hnode->key = rb_malloc(indexlen);
+	hash_migrate(hf, HASH_MIGRATE_STEP);
+
+	/* the key lives on the end of the node */
+	hashlen = hash_keylen(hf, indexlen);
+	hnode = rb_malloc(sizeof(hash_node) + indexlen);
+	hnode->key = hnode + 1;
 	hnode->keylen = indexlen;
 	memcpy(hnode->key, hashindex, indexlen);
-	hnode->hashv = hashv;
+	hnode->hashv = do_hfunc(hf, hashindex, hashlen);
 	hnode->data = pointer;
-	rb_dlinkAdd(hnode, &hnode->node, bucket);
+	hf->entries++;
+
+	/* already got this key, just join the list */
+	if((pos = hash_lookup(hf, hashindex, indexlen, hnode->hashv, &t)) >= 0)
+	{
+		hnode->next = t->slots[pos].hnode;
+		t->slots[pos].hnode = hnode;
+		return hnode;
+	}
+
+	if((hf->table.count + 1) * HASH_GROW_DEN > (hf->table.mask + 1) * HASH_GROW_NUM)
+	{
+		hf->grows++;
+		hash_resize(hf, hf->table.bits + 1);
+	}
+
+	hash_table_insert(&hf->table, hnode->hashv, hnode);
 	return hnode;
 }
 
@@ -452,33 +726,29 @@ hash_add(hash_f *hf, const char *hashindex, void *pointer)
 void
 hash_del_len(hash_f *hf, const void *hashindex, size_t size, void *pointer)
 {
-	rb_dlink_list *bucket;
-	rb_dlink_node *ptr;
+	struct hash_table *t;
+	hash_node *hnode;
 	uint32_t hashv;
 	size_t hashlen;
+	int pos;
 
 	if(hf == NULL || pointer == NULL || hashindex == NULL)
 		return;
 
-	if(hf->hashlen == 0)
-		hashlen = size;
-	else
-		hashlen = IRCD_MIN(size, hf->hashlen);
-
+	hashlen = hash_keylen(hf, size);
 	hashv = do_hfunc(hf, hashindex, hashlen);
-	bucket = hf->htable[hashv];
 
-	if(bucket == NULL)
+	if((pos = hash_lookup(hf, hashindex, size, hashv, &t)) < 0)
 		return;
-	
-	RB_DLINK_FOREACH(ptr, bucket->head)
+
+	for(hnode = t->slots[pos].hnode; hnode != NULL; hnode = hnode->next)
 	{
-		hash_node *hnode = ptr->data;
 		if(hnode->data == pointer)
 		{
-			rb_dlinkDelete(&hnode->node, bucket);
+			hash_unlink(t, pos, hnode);
 			free_hashnode(hnode);
-			hash_free_bucket(hf, hashv);
+			hf->entries--;
+			hash_deleted(hf);
 			return;
 		}
 	}
@@ -495,172 +765,173 @@ hash_del(hash_f *hf, const char *hashindex, void *pointer)
 void
 hash_del_hnode(hash_f *hf, hash_node * hnode)
 {
-	rb_dlink_list *bucket; 
-	uint32_t hashv;	
+	struct hash_table *t;
+	int pos;
+
 	if(hf == NULL || hnode == NULL)
 		return;
 
-	hashv = hnode->hashv;
-	bucket = hf->htable[hashv];
-
-	if(bucket == NULL)
+	pos = hash_lookup(hf, hnode->key, hnode->keylen, hnode->hashv, &t);
+	if(pos < 0)
 		return;
 
-	rb_dlinkDelete(&hnode->node, bucket);
+	hash_unlink(t, pos, hnode);
 	free_hashnode(hnode);
-	hash_free_bucket(hf, hashv);
+	hf->entries--;
+	hash_deleted(hf);
 }
 
-void
-hash_destroyall(hash_f *hf, hash_destroy_cb * destroy_cb)
+/* hash_snapshot()
+ *
+ * inputs	- hash, pointer to count
+ * outputs	- array of every data pointer in the hash
+ * side effects - callbacks may change the hash while we work through the
+ *		  copy, which would upset a walk over the slots themselves
+ */
+static void **
+hash_snapshot(hash_f *hf, unsigned int *count)
 {
-	for(int i = 0; i < (1 << hf->hashbits); i++)
+	struct hash_table *tables[2] = { &hf->table, &hf->old };
+	void **data;
+	unsigned int i, n = 0;
+
+	*count = hf->entries;
+	if(*count == 0)
+		return NULL;
+
+	data = rb_malloc(sizeof(void *) * *count);
+
+	for(int t = 0; t < 2; t++)
 	{
-		rb_dlink_list *ltable;
-		rb_dlink_node *ptr, *nptr;
-		
-		ltable = hf->htable[i];
-		if(ltable == NULL)
+		if(tables[t]->slots == NULL)
 			continue;
-		RB_DLINK_FOREACH_SAFE(ptr, nptr, ltable->head)
+
+		for(i = 0; i <= tables[t]->mask; i++)
 		{
-			hash_node *hnode = ptr->data;
-			void *cbdata = hnode->data;
-			
-			rb_dlinkDelete(ptr, ltable);
-			free_hashnode(hnode);
-			if(destroy_cb != NULL)
-				destroy_cb(cbdata);
+			for(hash_node *hnode = tables[t]->slots[i].hnode; hnode != NULL; hnode = hnode->next)
+				data[n++] = hnode->data;
 		}
-		hash_free_bucket(hf, i);
 	}
-	hash_free(hf);
+	return data;
 }
 
 void
-hash_walkall(hash_f *hf, hash_walk_cb * walk_cb, void *walk_data)
+hash_destroyall(hash_f *hf, hash_destroy_cb * destroy_cb)
 {
-	for(unsigned int i = 0; i < ( 1 << hf->hashbits); i++)
+	struct hash_table *tables[2] = { &hf->table, &hf->old };
+
+	for(int t = 0; t < 2; t++)
 	{
-		rb_dlink_list *ltable;
-		rb_dlink_node *ptr, *next_ptr;
-		
-		ltable = hf->htable[i];
-		if(ltable == NULL)
+		if(tables[t]->slots == NULL)
 			continue;
 
-		RB_DLINK_FOREACH_SAFE(ptr, next_ptr, ltable->head)
+		for(unsigned int i = 0; i <= tables[t]->mask; i++)
 		{
-			hash_node *hnode = ptr->data;
-			void *cbdata = hnode->data;
-			walk_cb(cbdata, walk_data);
-		
+			hash_node *hnode, *next;
+
+			for(hnode = tables[t]->slots[i].hnode; hnode != NULL; hnode = next)
+			{
+				void *cbdata = hnode->data;
+
+				next = hnode->next;
+				free_hashnode(hnode);
+				if(destroy_cb != NULL)
+					destroy_cb(cbdata);
+			}
 		}
 	}
+	hash_free(hf);
 }
 
-rb_dlink_list
-hash_get_channel_block(int i)
-{
-	/* XXX FIX ME */
-	static rb_dlink_list moo;
-	return moo;
-//	return *channelTable[i];
-}
-
-
-rb_dlink_list *
-hash_get_tablelist(hash_f *hf)
+void
+hash_walkall(hash_f *hf, hash_walk_cb * walk_cb, void *walk_data)
 {
-	rb_dlink_list *alltables;
+	void **data;
+	unsigned int count;
 
-	alltables = rb_malloc(sizeof(rb_dlink_list));
+	data = hash_snapshot(hf, &count);
+	if(data == NULL)
+		return;
 
-	for(int i = 0; i < (1 << hf->hashbits); i++)
-	{
-		rb_dlink_list *table = hf->htable[i];
-		
-		if(table == NULL || rb_dlink_list_length(table) == 0)
-			continue;
-		rb_dlinkAddAlloc(table, alltables);
-	}
+	for(unsigned int i = 0; i < count; i++)
+		walk_cb(data[i], walk_data);
 
-	if(rb_dlink_list_length(alltables) == 0)
-	{
-		rb_free(alltables);
-		alltables = NULL;
-	}
-	return alltables;
+	rb_free(data);
 }
 
-void
-hash_free_tablelist(rb_dlink_list * table)
+rb_dlink_list
+hash_get_channel_block(int i)
 {
-	rb_dlink_node *ptr, *next;
-	RB_DLINK_FOREACH_SAFE(ptr, next, table->head)
-	{
-		rb_free(ptr);
-	}
-	rb_free(table);
+	/* XXX FIX ME */
+	static rb_dlink_list moo;
+	return moo;
+//	return *channelTable[i];
 }
 
 static void
-output_hash(struct Client *source_p, const char *name, unsigned long length, unsigned long *counts,
-	    unsigned long deepest)
+output_hash(struct Client *source_p, const char *name, unsigned long length, unsigned long used,
+	    unsigned long entries, unsigned long total, unsigned long *counts, unsigned long deepest)
 {
-	unsigned long total = 0;
-
 	sendto_one_numeric(source_p, RPL_STATSDEBUG, "B :%s Hash Statistics", name);
 
-	sendto_one_numeric(source_p, RPL_STATSDEBUG, "B :Size: %lu Empty: %lu (%.3f%%)",
-			   length, counts[0], (float) ((counts[0] * 100) / (float) length));
+	sendto_one_numeric(source_p, RPL_STATSDEBUG, "B :Size: %lu Entries: %lu Empty: %lu (%.3f%%)",
+			   length, entries, length - used,
+			   (float) (((length - used) * 100) / (float) length));
 
-	for(unsigned long i = 1; i < 11; i++)
-	{
-		total += (counts[i] * i);
-	}
+	sendto_one_numeric(source_p, RPL_STATSDEBUG, "B :Load factor: %.3f",
+			   (float) used / (float) length);
 
 	/* dont want to divide by 0! --fl */
-	if(counts[0] != length)
-	{
-		sendto_one_numeric(source_p, RPL_STATSDEBUG,
-				   "B :Average depth: %.3f%%/%.3f%% Highest depth: %lu",
-				   (float) (total / (length - counts[0])), (float) (total / length), deepest);
-	}
+	if(used == 0)
+		return;
+
+	sendto_one_numeric(source_p, RPL_STATSDEBUG,
+			   "B :Average probe length: %.3f Highest probe length: %lu",
+			   (float) total / (float) used, deepest);
 
 	for(unsigned long i = 1; i < IRCD_MIN(11, deepest + 1); i++)
 	{
-		sendto_one_numeric(source_p, RPL_STATSDEBUG, "B :Nodes with %lu entries: %lu", i, counts[i]);
+		sendto_one_numeric(source_p, RPL_STATSDEBUG, "B :Keys found in %lu probes: %lu", i, counts[i]);
 	}
 }
 
+/* count_hash()
+ *
+ * reports how many probes it takes to find each key, where a key in
+ * its home slot takes one
+ */
 static void
-count_hash(struct Client *source_p, rb_dlink_list ** table, unsigned int length, const char *name)
+count_hash(struct Client *source_p, hash_f *hf)
 {
+	struct hash_table *t = &hf->table;
 	unsigned long counts[11];
-	unsigned long deepest = 0;
-	unsigned long i;
+	unsigned long deepest = 0, total = 0;
+	unsigned long i, probes;
 
 	memset(counts, 0, sizeof(counts));
 
-	for(i = 0; i < length; i++)
+	for(i = 0; i <= t->mask; i++)
 	{
-		if(table[i] == NULL) 
-		{
-			counts[0]++;
+		if(t->slots[i].hnode == NULL) 
 			continue;
-		}
-	
-		if(rb_dlink_list_length(table[i]) >= 10)
+
+		probes = SLOT_DIST(t, i) + 1;
+		total += probes;
+		if(probes >= 10)
 			counts[10]++;
 		else
-			counts[rb_dlink_list_length(table[i])]++;
+			counts[probes]++;
 
-		if(rb_dlink_list_length(table[i]) > deepest)
-			deepest = rb_dlink_list_length(table[i]);
+		if(probes > deepest)
+			deepest = probes;
 	}
 
-	output_hash(source_p, name, length, counts, deepest);
+	output_hash(source_p, hf->name, t->mask + 1, t->count, hf->entries, total, counts, deepest);
+
+	sendto_one_numeric(source_p, RPL_STATSDEBUG,
+			   "B :Lookups: %lu Average probes per lookup: %.3f Grown: %lu Shrunk: %lu",
+			   hf->lookups, hf->lookups ? (float) hf->probes / (float) hf->lookups : 0.0,
+			   hf->grows, hf->shrinks);
 }
 
 void
@@ -671,7 +942,13 @@ hash_stats(struct Client *source_p)
 	RB_DLINK_FOREACH(ptr, list_of_hashes.head)
 	{
 		hash_f *hf = ptr->data;
-		count_hash(source_p, hf->htable, 1 << hf->hashbits, hf->name);
+		count_hash(source_p, hf);
+		if(hf->old.slots != NULL)
+		{
+			sendto_one_numeric(source_p, RPL_STATSDEBUG,
+					   "B :Resizing from %u slots, %u keys left to move",
+					   hf->old.mask + 1, hf->old.count);
+		}
 		sendto_one_numeric(source_p, RPL_STATSDEBUG, "B :--");
 	}
 }
@@ -679,26 +956,25 @@ hash_stats(struct Client *source_p)
 void
 hash_get_memusage(hash_f *hf, size_t * entries, size_t * memusage)
 {
-	rb_dlink_list **htable;
-	rb_dlink_node *ptr;
-	hash_node *hnode;
+	struct hash_table *tables[2] = { &hf->table, &hf->old };
 	size_t mem = 0, cnt = 0;
-	unsigned int max, i;
-	max = 1 << hf->hashbits;
 
-	htable = hf->htable;
-	for(i = 0; i < max; i++)
+	for(int t = 0; t < 2; t++)
 	{
-		if(htable[i] == NULL)
+		if(tables[t]->slots == NULL)
 			continue;
 
-		mem += sizeof(rb_dlink_list);
-		RB_DLINK_FOREACH(ptr, htable[i]->head)
+		mem += sizeof(struct hash_slot) * (tables[t]->mask + 1);
+		for(unsigned int i = 0; i <= tables[t]->mask; i++)
 		{
-			hnode = ptr->data;
-			mem += hnode->keylen + sizeof(hash_node);
-			cnt++;
-		} 
+			hash_node *hnode;
+
+			for(hnode = tables[t]->slots[i].hnode; hnode != NULL; hnode = hnode->next)
+			{
+				mem += hnode->keylen + sizeof(hash_node);
+				cnt++;
+			}
+		}
 	}
 	if(memusage != NULL)
 		*memusage = mem;
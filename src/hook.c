@@ -38,14 +38,11 @@
  */
 #include <stdinc.h>
 #include <ratbox_lib.h>
+#include <struct.h>
 #include <hook.h>
 #include <match.h>
-
-struct hook_info
-{
-	rb_dlink_node node;
-	hookfn fn;
-};
+#include <numeric.h>
+#include <send.h>
 
 hook *hooks;
 
@@ -55,6 +52,12 @@ int num_hooks = 0;
 int last_hook = 0;
 int max_hooks = HOOK_INCREMENT;
 
+/* subscriber arrays replaced while call_hook() is running, freed once
+ * the outermost call_hook() has finished with them
+ */
+static int hook_depth;
+static rb_dlink_list retired_fns;
+
 int h_burst_client;
 int h_burst_channel;
 int h_burst_finished;
@@ -164,58 +167,145 @@ register_hook(const char *name)
 }
 
 
+/* retire_fns()
+ *
+ * inputs	- subscriber array that has just been replaced
+ * outputs	-
+ * side effects - the array is freed, or kept until the outermost
+ *		  call_hook() returns if a dispatch may still be using it
+ */
+static void
+retire_fns(hookfn *fns)
+{
+	if(fns == NULL)
+		return;
+
+	if(hook_depth > 0)
+		rb_dlinkAddAlloc(fns, &retired_fns);
+	else
+		rb_free(fns);
+}
+
 /* add_hook()
- *   Adds a hook to an event in the hook table, creating event first if
- *   needed.
+ *
+ * The subscribers are kept as a flat array so call_hook() is a straight
+ * run of indirect calls.  The newest subscriber goes first, as it always
+ * has.  The array is never changed in place, a new one replaces it.
  */
 void
 add_hook(const char *name, hookfn fn)
 {
-	struct hook_info *info;
+	hookfn *fns;
 	int i;
 
 	i = register_hook(name);
-	info = rb_malloc(sizeof(struct hook_info));
-	info->fn = fn;
-	rb_dlinkAdd(info, &info->node, &hooks[i].hooks);
+
+	fns = rb_malloc(sizeof(hookfn) * (hooks[i].nfns + 1));
+	fns[0] = fn;
+	if(hooks[i].nfns > 0)
+		memcpy(&fns[1], hooks[i].fns, sizeof(hookfn) * hooks[i].nfns);
+
+	retire_fns(hooks[i].fns);
+	hooks[i].fns = fns;
+	hooks[i].nfns++;
 }
 
 /* remove_hook()
- *   Removes a hook from an event in the hook table.
  */
 void
 remove_hook(const char *name, hookfn fn)
 {
-	int i;
-	rb_dlink_node *ptr, *next;
+	hookfn *fns = NULL;
+	int i, j;
+
 	if((i = find_hook(name)) < 0)
 		return;
 
-	RB_DLINK_FOREACH_SAFE(ptr, next, hooks[i].hooks.head)
+	for(j = 0; j < hooks[i].nfns; j++)
 	{
-		struct hook_info *info = ptr->data;
-		if(info->fn == fn)
+		if(hooks[i].fns[j] != fn)
+			continue;
+
+		if(hooks[i].nfns > 1)
 		{
-			rb_dlinkDelete(&info->node, &hooks[i].hooks);
-			rb_free(info);
-			return;
+			fns = rb_malloc(sizeof(hookfn) * (hooks[i].nfns - 1));
+			memcpy(fns, hooks[i].fns, sizeof(hookfn) * j);
+			memcpy(&fns[j], &hooks[i].fns[j + 1],
+			       sizeof(hookfn) * (hooks[i].nfns - j - 1));
 		}
+
+		retire_fns(hooks[i].fns);
+		hooks[i].fns = fns;
+		hooks[i].nfns--;
+		return;
 	}
 }
 
 /* call_hook()
- *   Calls functions from a given event in the hook table.
  */
 void
 call_hook(int id, void *arg)
 {
-	rb_dlink_node *ptr;
-
 	/* The ID we were passed is the position in the hook table of this
 	 * hook
 	 */
-	RB_DLINK_FOREACH(ptr, hooks[id].hooks.head)
+	struct timeval start, end;
+	rb_dlink_node *ptr, *next;
+	hookfn *fns;
+	long long usec;
+	int i, nfns;
+
+	if(hooks[id].nfns == 0)
+		return;
+
+	hooks[id].calls++;
+	rb_gettimeofday(&start, NULL);
+
+	/* a subscriber may add or remove hooks, growing the hook table or
+	 * replacing this array.  work from a snapshot, retire_fns() keeps
+	 * it alive until we are done.
+	 */
+	fns = hooks[id].fns;
+	nfns = hooks[id].nfns;
+	hook_depth++;
+	for(i = 0; i < nfns; i++)
+		fns[i](arg);
+	hook_depth--;
+
+	if(hook_depth == 0)
+	{
+		RB_DLINK_FOREACH_SAFE(ptr, next, retired_fns.head)
+		{
+			rb_free(ptr->data);
+			rb_dlinkDestroy(ptr, &retired_fns);
+		}
+	}
+
+	rb_gettimeofday(&end, NULL);
+	usec = (long long)(end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec);
+	if(usec > 0)
+		hooks[id].usec += usec;
+}
+
+/* hook_stats()
+ *
+ * inputs	- client to report to
+ * outputs	-
+ * side effects - subscribers, calls and time spent for each hook are
+ *		  sent to the client
+ */
+void
+hook_stats(struct Client *source_p)
+{
+	int i;
+
+	for(i = 0; i < max_hooks; i++)
 	{
-		((struct hook_info *)ptr->data)->fn(arg);
+		if(hooks[i].name == NULL)
+			continue;
+
+		sendto_one_numeric(source_p, RPL_STATSDEBUG,
+				   "j :%s subscribers %d calls %lu time %" PRIu64 "us",
+				   hooks[i].name, hooks[i].nfns, hooks[i].calls, hooks[i].usec);
 	}
 }
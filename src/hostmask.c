@@ -241,8 +241,7 @@ find_auth(const char *name, const char *sockhost, struct sockaddr *addr, int fam
 					   comp_with_mask_sock(addr,
 							       (struct sockaddr *)&arec->Mask.ipa.addr,
 							       arec->Mask.ipa.bits) && (arec->type & CONF_SKIPUSER
-											|| match(arec->username,
-												 username))
+											|| match_compiled(arec->aconf->user_mask, username))
 					   && arec->precedence > hprecv)
 					{
 						hprecv = arec->precedence;
@@ -264,8 +263,7 @@ find_auth(const char *name, const char *sockhost, struct sockaddr *addr, int fam
 					   comp_with_mask_sock(addr,
 							       (struct sockaddr *)&arec->Mask.ipa.addr,
 							       arec->Mask.ipa.bits) && (arec->type & CONF_SKIPUSER
-											|| match(arec->username,
-												 username)))
+											|| match_compiled(arec->aconf->user_mask, username)))
 					{
 						hprecv = arec->precedence;
 						hprec = arec->aconf;
@@ -286,8 +284,8 @@ find_auth(const char *name, const char *sockhost, struct sockaddr *addr, int fam
 				if((arec->type & ~CONF_SKIPUSER) == CONF_CLIENT &&
 				   (arec->masktype == HM_HOST) &&
 				   arec->precedence > hprecv &&
-				   match(arec->Mask.hostname, name) &&
-				   (arec->type & CONF_SKIPUSER || match(arec->username, username)))
+				   match_compiled(arec->aconf->host_mask, name) &&
+				   (arec->type & CONF_SKIPUSER || match_compiled(arec->aconf->user_mask, username)))
 				{
 					hprecv = arec->precedence;
 					hprec = arec->aconf;
@@ -305,9 +303,9 @@ find_auth(const char *name, const char *sockhost, struct sockaddr *addr, int fam
 			if((arec->type & ~CONF_SKIPUSER) == CONF_CLIENT &&
 			   arec->masktype == HM_HOST &&
 			   arec->precedence > hprecv &&
-			   (match(arec->Mask.hostname, name) ||
-			    (sockhost && match(arec->Mask.hostname, sockhost))) &&
-			   (arec->type & CONF_SKIPUSER || match(arec->username, username)))
+			   (match_compiled(arec->aconf->host_mask, name) ||
+			    (sockhost && match_compiled(arec->aconf->host_mask, sockhost))) &&
+			   (arec->type & CONF_SKIPUSER || match_compiled(arec->aconf->user_mask, username)))
 			{
 				hprecv = arec->precedence;
 				hprec = arec->aconf;
@@ -351,8 +349,7 @@ find_conf_by_address(const char *name, const char *sockhost,
 					   comp_with_mask_sock(addr,
 							       (struct sockaddr *)&arec->Mask.ipa.addr,
 							       arec->Mask.ipa.bits) && (arec->type & CONF_SKIPUSER
-											|| match(arec->username,
-												 username)))
+											|| match_compiled(arec->aconf->user_mask, username)))
 						return arec->aconf;
 				}
 			}
@@ -370,8 +367,7 @@ find_conf_by_address(const char *name, const char *sockhost,
 					   comp_with_mask_sock(addr,
 							       (struct sockaddr *)&arec->Mask.ipa.addr,
 							       arec->Mask.ipa.bits) && (arec->type & CONF_SKIPUSER
-											|| match(arec->username,
-												 username)))
+											|| match_compiled(arec->aconf->user_mask, username)))
 						return arec->aconf;
 				}
 			}
@@ -389,8 +385,8 @@ find_conf_by_address(const char *name, const char *sockhost,
 			{
 				if(type == (arec->type & ~CONF_SKIPUSER) &&
 				   (arec->masktype == HM_HOST) &&
-				   match(arec->Mask.hostname, name) &&
-				   (arec->type & CONF_SKIPUSER || match(arec->username, username)))
+				   match_compiled(arec->aconf->host_mask, name) &&
+				   (arec->type & CONF_SKIPUSER || match_compiled(arec->aconf->user_mask, username)))
 					return arec->aconf;
 			}
 
@@ -404,9 +400,9 @@ find_conf_by_address(const char *name, const char *sockhost,
 		{
 			if(type == (arec->type & ~CONF_SKIPUSER) &&
 			   arec->masktype == HM_HOST &&
-			   (match(arec->Mask.hostname, name) ||
-			    (sockhost && match(arec->Mask.hostname, sockhost))) &&
-			   (arec->type & CONF_SKIPUSER || match(arec->username, username)))
+			   (match_compiled(arec->aconf->host_mask, name) ||
+			    (sockhost && match_compiled(arec->aconf->host_mask, sockhost))) &&
+			   (arec->type & CONF_SKIPUSER || match_compiled(arec->aconf->user_mask, username)))
 				return arec->aconf;
 		}
 	}
@@ -524,6 +520,9 @@ add_conf_by_address(const char *address, int type, const char *username, struct
 		arec->Mask.hostname = address;
 		arec->next = atable[(hv = get_mask_hash(address))];
 		atable[hv] = arec;
+
+		free_compiled_mask(aconf->host_mask);
+		aconf->host_mask = compile_mask(address, 0);
 	}
 	arec->username = username;
 	arec->aconf = aconf;
@@ -535,6 +534,11 @@ add_conf_by_address(const char *address, int type, const char *username, struct
 
 	if(EmptyString(username) || (username[0] == '*' && username[1] == '\0'))
 		arec->type |= CONF_SKIPUSER;
+	else
+	{
+		free_compiled_mask(aconf->user_mask);
+		aconf->user_mask = compile_mask(username, 0);
+	}
 }
 
 /* void delete_one_address(const char*, struct ConfItem*)
@@ -481,6 +481,7 @@ diecb(const char *buf)
 		ilog(L_MAIN, "libratbox has called the die callback..aborting: %s", buf);
 	else
 		ilog(L_MAIN, "libratbox has called the die callback..aborting");
+	flush_logfiles();
 	abort();
 }
 
@@ -489,6 +490,8 @@ int
 ratbox_main(int argc, char *argv[])
 {
 	char emptyname[] = "";
+	struct timeval lap;
+	unsigned long parse_usec, check_usec, load_usec;
 	int r;
 	/* Check to see if the user is running us as root, which is a nono */
 #ifndef _WIN32
@@ -531,7 +534,9 @@ ratbox_main(int argc, char *argv[])
 
 	add_all_conf_settings();
 
+	rb_gettimeofday(&lap, NULL);
 	r = read_config_file(configfile);
+	parse_usec = conf_lap_usec(&lap);
 	if(r > 0)
 	{
 		fprintf(stderr,
@@ -544,7 +549,9 @@ ratbox_main(int argc, char *argv[])
 		fprintf(stderr, "Syntax OK, doing second pass...\n");
 
 
+	rb_gettimeofday(&lap, NULL);
 	r = check_valid_entries();
+	check_usec = conf_lap_usec(&lap);
 	if(r > 0)
 	{
 		fprintf(stderr,
@@ -581,6 +588,7 @@ ratbox_main(int argc, char *argv[])
 	me.name = emptyname;
 	memset(&meLocalUser, 0, sizeof(meLocalUser));
 	me.localClient = &meLocalUser;
+	add_local_sweep(&me);
 
 	/* Make sure all lists are zeroed */
 	memset(&unknown_list, 0, sizeof(unknown_list));
@@ -619,6 +627,7 @@ ratbox_main(int argc, char *argv[])
 
 	init_main_logfile(logFileName);
 	init_hash();
+	init_client_strings(&me);
 	init_host_hash();
 	init_client();
 	init_channels();
@@ -638,7 +647,9 @@ ratbox_main(int argc, char *argv[])
 	init_resolver();	/* Needs to be setup before the io loop */
 	init_ssld();
 
+	rb_gettimeofday(&lap, NULL);
 	load_conf_settings();
+	load_usec = conf_lap_usec(&lap);
 	if(ServerInfo.bandb_path == NULL)
 		ServerInfo.bandb_path = rb_strdup(DBPATH);
 
@@ -683,7 +694,7 @@ ratbox_main(int argc, char *argv[])
 		ilog(L_MAIN, "ERROR: No server description specified in serverinfo block.");
 		exit(EXIT_FAILURE);
 	}
-	rb_strlcpy(me.info, ServerInfo.description, sizeof(me.info));
+	set_client_info(&me, ServerInfo.description);
 
 	if(testing_conf == true)
 	{
@@ -707,6 +718,8 @@ ratbox_main(int argc, char *argv[])
 	load_help();
 	open_logfiles(logFileName);
 
+	ilog(L_MAIN, "Config file %s loaded in %lu us (parse %lu, check %lu, load %lu)",
+	     configfile, parse_usec + check_usec + load_usec, parse_usec, check_usec, load_usec);
 	ilog(L_MAIN, "Server Ready");
 
 	/* We want try_connections to be called as soon as possible now! -- adrian */
@@ -746,6 +759,7 @@ server_reboot(void)
 	sendto_realops_flags(UMODE_ALL, L_ALL, "Restarting server...");
 
 	ilog(L_MAIN, "Restarting server...");
+	close_logfiles();
 
 	/* set all the signal handlers to a dummy */
 	setup_reboot_signals();
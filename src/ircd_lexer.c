@@ -1990,7 +1990,10 @@ void cinclude(void)
 				conf_report_error("Include %s: %s.", c, strerror(errno));
 				return;
 			}
+			conf_add_source(fnamebuf, tmp_fbfile_in);
 		}
+		else
+			conf_add_source(c, tmp_fbfile_in);
 		lineno_stack[include_stack_ptr] = lineno;
 		lineno = 1;
 		inc_fbfile_in[include_stack_ptr] = conf_fbfile_in;
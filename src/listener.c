@@ -414,6 +414,7 @@ static void
 add_connection(struct Listener *listener, rb_fde_t * F, struct sockaddr *sai, struct sockaddr *lai)
 {
 	struct Client *new_client;
+	char host[HOSTLEN + 1];
 	s_assert(NULL != listener);
 	/* 
 	 * get the client socket name from the socket
@@ -457,16 +458,16 @@ add_connection(struct Listener *listener, rb_fde_t * F, struct sockaddr *sai, st
 	 * so we have something valid to put into error messages...
 	 */
 
-	rb_inet_ntop_sock((struct sockaddr *)&new_client->localClient->ip, new_client->sockhost,
-			  sizeof(new_client->sockhost));
-	rb_strlcpy(new_client->host, new_client->sockhost, sizeof(new_client->host));
+	rb_inet_ntop_sock((struct sockaddr *)&new_client->localClient->ip, host, sizeof(host));
+	set_client_sockhost(new_client, host);
 
 #ifdef RB_IPV6
 	if(GET_SS_FAMILY(&new_client->localClient->ip) == AF_INET6 && ConfigFileEntry.dot_in_ip6_addr == 1)
 	{
-		rb_strlcat(new_client->host, ".", sizeof(new_client->host));
+		rb_strlcat(host, ".", sizeof(host));
 	}
 #endif
+	set_client_host(new_client, host);
 	new_client->localClient->F = F;
 	new_client->localClient->listener = listener;
 
@@ -314,6 +314,345 @@ match_esc(const char *mask, const char *name)
 	return 0;
 }
 
+/*
+ * compiled masks
+ *
+ * A mask is kept as the runs between its '*'s, with each byte of a run
+ * either a literal (stored uppercased, ToUpper() and ToLower() give the
+ * same equivalence) or one of the '?', '@' and '#' wildcards.  Because
+ * those all match exactly one character, a name matches if the first
+ * run sits at its start, the last run at its end, and the runs between
+ * can be found in order; taking the leftmost place for each never
+ * loses a match.  match() gives up after MATCH_MAX_CALLS steps and says
+ * no, this does not, so a mask that needed that much backtracking may
+ * now match where it did not before.
+ *
+ * Masks with escapes are left to match_esc(), as are names too long
+ * to fold onto the stack.
+ */
+enum
+{
+	MC_LITERAL,
+	MC_ANY,
+	MC_LETTER,
+	MC_DIGIT
+};
+
+struct mask_run
+{
+	unsigned int start;	/* offset into pattern */
+	unsigned int len;
+	int literal;		/* first literal in the run, -1 if none */
+	bool plain;		/* only literals, so memcmp() will do */
+};
+
+struct compiled_mask
+{
+	char *mask;
+	int flags;
+	bool interpret;		/* hand it to match()/match_esc() */
+	bool star;
+	bool anchor_start;	/* first run must start the name */
+	bool anchor_end;	/* last run must end it */
+	unsigned int minlen;
+	unsigned int nruns;
+	unsigned char *pattern;
+	unsigned char *type;
+	struct mask_run runs[];
+};
+
+struct compiled_mask *
+compile_mask(const char *mask, int flags)
+{
+	struct compiled_mask *cmask;
+	struct mask_run *run = NULL;
+	size_t len = strlen(mask);
+	unsigned int i, n = 0;
+	unsigned char c;
+
+	cmask = rb_malloc(sizeof(struct compiled_mask) + sizeof(struct mask_run) * (len / 2 + 1) +
+			  (len + 1) * 2);
+	cmask->pattern = (unsigned char *)&cmask->runs[len / 2 + 1];
+	cmask->type = cmask->pattern + len + 1;
+	cmask->mask = rb_strdup(mask);
+	cmask->flags = flags;
+
+	if((flags & MASK_ESC) && strchr(mask, '\\') != NULL)
+	{
+		cmask->interpret = true;
+		return cmask;
+	}
+
+	cmask->anchor_start = (*mask != '*');
+	cmask->anchor_end = (len == 0 || mask[len - 1] != '*');
+
+	for(i = 0; i < len; i++)
+	{
+		c = mask[i];
+		if(c == '*')
+		{
+			cmask->star = true;
+			run = NULL;
+			continue;
+		}
+
+		if(run == NULL)
+		{
+			run = &cmask->runs[cmask->nruns++];
+			run->start = n;
+			run->literal = -1;
+			run->plain = true;
+		}
+
+		if(c == '?')
+			cmask->type[n] = MC_ANY;
+		else if((flags & MASK_ESC) && c == '@')
+			cmask->type[n] = MC_LETTER;
+		else if((flags & MASK_ESC) && c == '#')
+			cmask->type[n] = MC_DIGIT;
+		else
+		{
+			cmask->type[n] = MC_LITERAL;
+			if(run->literal < 0)
+				run->literal = run->len;
+		}
+
+		if(cmask->type[n] != MC_LITERAL)
+			run->plain = false;
+
+		cmask->pattern[n++] = ToUpper(c);
+		run->len++;
+	}
+
+	cmask->minlen = n;
+	return cmask;
+}
+
+void
+free_compiled_mask(struct compiled_mask *cmask)
+{
+	if(cmask == NULL)
+		return;
+	rb_free(cmask->mask);
+	rb_free(cmask);
+}
+
+/* compiled_mask_prefix()
+ *
+ * inputs	- compiled mask, pointer to set to the literal
+ * outputs	- how many literal characters every matching name starts
+ *		  with, 0 if the mask can't say
+ * side effects - the literal is folded to upper case and not terminated
+ */
+size_t
+compiled_mask_prefix(const struct compiled_mask *cmask, const char **literal)
+{
+	const struct mask_run *run;
+	size_t i;
+
+	if(cmask->interpret || !cmask->anchor_start || cmask->nruns == 0)
+		return 0;
+
+	run = &cmask->runs[0];
+	for(i = 0; i < run->len && cmask->type[run->start + i] == MC_LITERAL; i++)
+		;
+
+	*literal = (const char *)cmask->pattern + run->start;
+	return i;
+}
+
+/* compiled_mask_suffix()
+ *
+ * inputs	- compiled mask, pointer to set to the literal
+ * outputs	- how many literal characters every matching name ends
+ *		  with, 0 if the mask can't say
+ * side effects - the literal is folded to upper case and not terminated
+ */
+size_t
+compiled_mask_suffix(const struct compiled_mask *cmask, const char **literal)
+{
+	const struct mask_run *run;
+	size_t i;
+
+	if(cmask->interpret || !cmask->anchor_end || cmask->nruns == 0)
+		return 0;
+
+	run = &cmask->runs[cmask->nruns - 1];
+	for(i = 0; i < run->len && cmask->type[run->start + run->len - 1 - i] == MC_LITERAL; i++)
+		;
+
+	*literal = (const char *)cmask->pattern + run->start + run->len - i;
+	return i;
+}
+
+/* compiled_mask_literal()
+ *
+ * inputs	- compiled mask
+ * outputs	- true if the mask has no wildcards, so only matches names
+ *		  that compare equal to it with irccmp()
+ * side effects -
+ */
+bool
+compiled_mask_literal(const struct compiled_mask *cmask)
+{
+	return !cmask->interpret && !cmask->star && cmask->nruns == 1 && cmask->runs[0].plain;
+}
+
+/* run_at()
+ *
+ * inputs	- compiled mask, run, folded name, name, offset
+ * outputs	- true if the run matches the name at offset
+ * side effects -
+ */
+static inline bool
+run_at(const struct compiled_mask *cmask, const struct mask_run *run,
+       const unsigned char *folded, const unsigned char *name, size_t pos)
+{
+	const unsigned char *p = cmask->pattern + run->start;
+	const unsigned char *t = cmask->type + run->start;
+	unsigned int i;
+
+	if(run->plain)
+		return memcmp(p, folded + pos, run->len) == 0;
+
+	for(i = 0; i < run->len; i++)
+	{
+		switch (t[i])
+		{
+		case MC_LITERAL:
+			if(p[i] != folded[pos + i])
+				return false;
+			break;
+		case MC_LETTER:
+			if(!IsLetter(name[pos + i]))
+				return false;
+			break;
+		case MC_DIGIT:
+			if(!IsDigit(name[pos + i]))
+				return false;
+			break;
+		}
+	}
+	return true;
+}
+
+/* find_run()
+ *
+ * inputs	- compiled mask, run, folded name, name, first and last
+ *		  offsets the run may start at
+ * outputs	- leftmost offset the run matches at, or -1
+ * side effects -
+ */
+static long
+find_run(const struct compiled_mask *cmask, const struct mask_run *run,
+	 const unsigned char *folded, const unsigned char *name, size_t pos, size_t last)
+{
+	const unsigned char *hit;
+	unsigned char c;
+
+	if(run->literal < 0)
+	{
+		for(; pos <= last; pos++)
+		{
+			if(run_at(cmask, run, folded, name, pos))
+				return pos;
+		}
+		return -1;
+	}
+
+	/* look for the first literal, then check the rest around it */
+	c = cmask->pattern[run->start + run->literal];
+	while(pos <= last)
+	{
+		hit = memchr(folded + pos + run->literal, c, last - pos + 1);
+		if(hit == NULL)
+			return -1;
+
+		pos = hit - folded - run->literal;
+		if(run_at(cmask, run, folded, name, pos))
+			return pos;
+		pos++;
+	}
+	return -1;
+}
+
+int
+match_compiled(const struct compiled_mask *cmask, const char *name)
+{
+	unsigned char folded[IRCD_BUFSIZE];
+	const unsigned char *n = (const unsigned char *)name;
+	const struct mask_run *run, *first, *last;
+	size_t len, pos, end, i;
+	long found;
+	uint64_t w;
+
+	s_assert(cmask != NULL);
+	s_assert(name != NULL);
+
+	if(cmask == NULL || name == NULL)
+		return 0;
+
+	len = strlen(name);
+
+	if(cmask->interpret || len >= sizeof(folded))
+	{
+		if(cmask->flags & MASK_ESC)
+			return match_esc(cmask->mask, name);
+		return match(cmask->mask, name);
+	}
+
+	if(len < cmask->minlen)
+		return 0;
+
+	if(cmask->nruns == 0)
+		return cmask->star || len == 0;
+
+	if(!cmask->star && len != cmask->minlen)
+		return 0;
+
+	for(i = 0; i + sizeof(w) <= len; i += sizeof(w))
+	{
+		w = irc_toupper_word(irc_load_word(n + i));
+		memcpy(folded + i, &w, sizeof(w));
+	}
+	for(; i < len; i++)
+		folded[i] = ToUpper(n[i]);
+
+	first = &cmask->runs[0];
+	last = &cmask->runs[cmask->nruns - 1];
+	pos = 0;
+	end = len;
+
+	if(cmask->anchor_start)
+	{
+		if(!run_at(cmask, first, folded, n, 0))
+			return 0;
+		pos = first->len;
+		first++;
+	}
+
+	if(cmask->anchor_end && first <= last)
+	{
+		/* minlen says both ends fit without overlapping */
+		if(!run_at(cmask, last, folded, n, len - last->len))
+			return 0;
+		end = len - last->len;
+		last--;
+	}
+
+	for(run = first; run <= last; run++)
+	{
+		if(end < pos + run->len)
+			return 0;
+
+		found = find_run(cmask, run, folded, n, pos, end - run->len);
+		if(found < 0)
+			return 0;
+		pos = found + run->len;
+	}
+	return 1;
+}
+
 int
 comp_with_mask(void *addr, void *dest, unsigned int mask)
 {
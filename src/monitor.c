@@ -39,6 +39,32 @@
 #include <ircd.h>
 #include <match.h>
 #include <send.h>
+#include <client.h>
+
+/*
+ * Signons and signoffs are not sent straight away.  The nick is queued on
+ * monitor_pending, and monitor_flush() later compares who holds it with
+ * what each watcher was last told, whether by an earlier flush or by
+ * MONITOR + and MONITOR S in the meantime.  Only the difference is sent:
+ * nothing for a nick that went away and came back, a 731 and then a 730
+ * for one now held by someone else.  Each watcher gets its changes packed
+ * into as few 731/730 lines as will fit, offline ones first.
+ */
+struct monitor_batch
+{
+	rb_dlink_node node;
+	int mlen;
+	int onlen;
+	int offlen;
+	char onbuf[IRCD_BUFSIZE];
+	char offbuf[IRCD_BUFSIZE];
+};
+
+static rb_dlink_list monitor_pending;
+static rb_dlink_list monitor_batches;
+static rb_ev_entry *monitor_flush_ev;
+
+static void monitor_flush(void *unused);
 
 struct monitor *
 find_monitor(const char *name, bool add)
@@ -60,12 +86,110 @@ find_monitor(const char *name, bool add)
 	return NULL;
 }
 
+/*
+ * Each client watching a nick is tied to its struct monitor by a
+ * struct monitor_link, which sits on both the monitors users list and
+ * the clients monitor_list, and is found through HASH_MONLINK by its
+ * (monitor, client) pair.
+ */
+struct monitor_link
+{
+	rb_dlink_node cnode;	/* on client's monitor_list, data is monptr, must be first */
+	rb_dlink_node node;	/* on monptr->users, data is the client */
+	hash_node *hnode;
+	char told[IDLEN + 1];	/* id of who the client was told holds the nick, "" for offline */
+};
+
+#define monitor_user_link(ptr) \
+	((struct monitor_link *)((char *)(ptr) - offsetof(struct monitor_link, node)))
+
+/* who the watchers see as holding a nick, by id so that someone else
+ * taking the nick over is noticed even if the name is the same
+ */
+static const char *
+monitor_holder(struct Client *target_p)
+{
+	if(target_p == NULL)
+		return "";
+	return use_id(target_p);
+}
+
+static void
+free_monitor_link(struct monitor *monptr, struct Client *client_p, struct monitor_link *mlink)
+{
+	rb_dlinkDelete(&mlink->node, &monptr->users);
+	rb_dlinkDelete(&mlink->cnode, &client_p->localClient->monitor_list);
+	hash_del_hnode(HASH_MONLINK, mlink->hnode);
+	rb_free(mlink);
+}
+
+/* add_monitor_client()
+ *
+ * inputs	- monitor, local client
+ * outputs	- false if the client was already watching this nick
+ * side effects	- client is added to the monitor's users, and taken to
+ *		  know the nick's current state, which the caller sends
+ */
+bool
+add_monitor_client(struct monitor *monptr, struct Client *client_p)
+{
+	void *key[2] = { monptr, client_p };
+	struct monitor_link *mlink;
+
+	if(hash_find_len(HASH_MONLINK, key, sizeof(key)) != NULL)
+		return false;
+
+	mlink = rb_malloc(sizeof(struct monitor_link));
+	rb_strlcpy(mlink->told, monitor_holder(find_named_person(monptr->name)), sizeof(mlink->told));
+	rb_dlinkAdd(client_p, &mlink->node, &monptr->users);
+	rb_dlinkAdd(monptr, &mlink->cnode, &client_p->localClient->monitor_list);
+	mlink->hnode = hash_add_len(HASH_MONLINK, key, sizeof(key), mlink);
+	return true;
+}
+
+/* del_monitor_client()
+ *
+ * inputs	- monitor, local client
+ * outputs	-
+ * side effects	- client is removed from the monitor's users, the monitor
+ *		  itself is not freed
+ */
+void
+del_monitor_client(struct monitor *monptr, struct Client *client_p)
+{
+	void *key[2] = { monptr, client_p };
+	struct monitor_link *mlink;
+
+	if((mlink = hash_find_data_len(HASH_MONLINK, key, sizeof(key))) != NULL)
+		free_monitor_link(monptr, client_p, mlink);
+}
+
+/* monitor_reported()
+ *
+ * inputs	- monitor, local client, who holds the nick or NULL
+ * outputs	-
+ * side effects	- records that the client has just been sent the nick's
+ *		  state, so monitor_flush() doesn't send it again
+ */
+void
+monitor_reported(struct monitor *monptr, struct Client *client_p, struct Client *target_p)
+{
+	void *key[2] = { monptr, client_p };
+	struct monitor_link *mlink;
+
+	if((mlink = hash_find_data_len(HASH_MONLINK, key, sizeof(key))) != NULL)
+		rb_strlcpy(mlink->told, monitor_holder(target_p), sizeof(mlink->told));
+}
+
 void
 free_monitor(struct monitor *monptr)
 {
 	/* don't free if there are users attached */
 	if(rb_dlink_list_length(&monptr->users) > 0)
 		return;
+
+	if(monptr->pending)
+		rb_dlinkDelete(&monptr->pnode, &monitor_pending);
 	
 	hash_del_hnode(HASH_MONITOR, monptr->hnode);		
 	rb_free(monptr->name);
@@ -73,17 +197,157 @@ free_monitor(struct monitor *monptr)
 }
 
 
+static void
+monitor_queue(struct monitor *monptr)
+{
+	if(monptr->pending)
+		return;
+
+	monptr->pending = true;
+	rb_dlinkAddTail(monptr, &monptr->pnode, &monitor_pending);
+
+	if(monitor_flush_ev == NULL)
+		monitor_flush_ev = rb_event_addonce("monitor_flush", monitor_flush, NULL, 1);
+}
+
+/* monitor_batch_add()
+ *
+ * inputs	- watcher, whether the nick is online, nick or nick!user@host
+ * outputs	-
+ * side effects	- name is added to the watchers 730 or 731 line, which is
+ *		  sent first if it is full
+ */
+static void
+monitor_batch_add(struct Client *client_p, bool online, const char *name)
+{
+	struct monitor_batch *mb = client_p->localClient->monitor_batch;
+	char *buf;
+	int *len;
+	int arglen;
+
+	if(mb == NULL)
+	{
+		mb = rb_malloc(sizeof(struct monitor_batch));
+		/* these two are same length, just diff numeric */
+		mb->mlen = mb->onlen = sprintf(mb->onbuf, form_str(RPL_MONONLINE),
+					       me.name, client_p->name, "");
+		mb->offlen = sprintf(mb->offbuf, form_str(RPL_MONOFFLINE), me.name, client_p->name, "");
+		client_p->localClient->monitor_batch = mb;
+		rb_dlinkAdd(client_p, &mb->node, &monitor_batches);
+	}
+
+	if(online)
+	{
+		buf = mb->onbuf;
+		len = &mb->onlen;
+	}
+	else
+	{
+		buf = mb->offbuf;
+		len = &mb->offlen;
+	}
+
+	arglen = strlen(name);
+
+	if(*len + arglen + 1 >= IRCD_BUFSIZE - 3)
+	{
+		/* a nick can be on both lines, keep its 731 ahead of its 730 */
+		if(online && mb->offlen != mb->mlen)
+		{
+			sendto_one_buffer(client_p, mb->offbuf);
+			mb->offlen = mb->mlen;
+		}
+		sendto_one_buffer(client_p, buf);
+		*len = mb->mlen;
+	}
+
+	if(*len != mb->mlen)
+		buf[(*len)++] = ',';
+
+	memcpy(buf + *len, name, arglen + 1);
+	*len += arglen;
+}
+
+/* monitor_flush()
+ *
+ * inputs	-
+ * outputs	-
+ * side effects	- every queued nick whose holder differs from what a
+ *		  watcher was last told is sent to that watcher, packed
+ *		  per watcher
+ */
+static void
+monitor_flush(void *unused)
+{
+	char buf[USERHOST_REPLYLEN];
+	rb_dlink_node *ptr, *next_ptr, *uptr;
+	struct monitor_link *mlink;
+	const char *holder;
+
+	monitor_flush_ev = NULL;
+
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, monitor_pending.head)
+	{
+		struct monitor *monptr = ptr->data;
+		struct Client *target_p;
+
+		rb_dlinkDelete(&monptr->pnode, &monitor_pending);
+		monptr->pending = false;
+
+		target_p = find_named_person(monptr->name);
+		holder = monitor_holder(target_p);
+
+		if(target_p != NULL)
+			snprintf(buf, sizeof(buf), "%s!%s@%s",
+				 target_p->name, target_p->username, target_p->host);
+		else
+			rb_strlcpy(buf, monptr->name, sizeof(buf));
+
+		RB_DLINK_FOREACH(uptr, monptr->users.head)
+		{
+			struct Client *client_p = uptr->data;
+
+			mlink = monitor_user_link(uptr);
+
+			/* flapped back to what this watcher last saw */
+			if(!strcmp(mlink->told, holder) || IsIOError(client_p))
+				continue;
+
+			/* someone else has the nick now, the old holder went first */
+			if(mlink->told[0] != '\0' && target_p != NULL)
+				monitor_batch_add(client_p, false, monptr->name);
+
+			monitor_batch_add(client_p, target_p != NULL, buf);
+			rb_strlcpy(mlink->told, holder, sizeof(mlink->told));
+		}
+	}
+
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, monitor_batches.head)
+	{
+		struct Client *client_p = ptr->data;
+		struct monitor_batch *mb = client_p->localClient->monitor_batch;
+
+		if(mb->offlen != mb->mlen)
+			sendto_one_buffer(client_p, mb->offbuf);
+		if(mb->onlen != mb->mlen)
+			sendto_one_buffer(client_p, mb->onbuf);
+
+		rb_dlinkDelete(&mb->node, &monitor_batches);
+		client_p->localClient->monitor_batch = NULL;
+		rb_free(mb);
+	}
+}
+
 /* monitor_signon()
  *
  * inputs	- client who has just connected
  * outputs	-
- * side effects	- notifies any clients monitoring this nickname that it has
- *		  connected to the network
+ * side effects	- queues a notice to any clients monitoring this nickname
+ *		  that it has connected to the network
  */
 void
 monitor_signon(struct Client *client_p)
 {
-	char buf[USERHOST_REPLYLEN];
 	struct monitor *monptr;
 	
 	monptr = find_monitor(client_p->name, false);
@@ -92,17 +356,15 @@ monitor_signon(struct Client *client_p)
 	if(monptr == NULL)
 		return;
 
-	snprintf(buf, sizeof(buf), "%s!%s@%s", client_p->name, client_p->username, client_p->host);
-
-	sendto_monitor(monptr, form_str(RPL_MONONLINE), me.name, "*", buf);
+	monitor_queue(monptr);
 }
 
 /* monitor_signoff()
  *
  * inputs	- client who is exiting
  * outputs	-
- * side effects	- notifies any clients monitoring this nickname that it has
- *		  left the network
+ * side effects	- queues a notice to any clients monitoring this nickname
+ *		  that it has left the network
  */
 void
 monitor_signoff(struct Client *client_p)
@@ -115,7 +377,7 @@ monitor_signoff(struct Client *client_p)
 	if(monptr == NULL)
 		return;
 
-	sendto_monitor(monptr, form_str(RPL_MONOFFLINE), me.name, "*", client_p->name);
+	monitor_queue(monptr);
 }
 
 
@@ -127,17 +389,9 @@ clear_monitor(struct Client *client_p)
 	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, client_p->localClient->monitor_list.head)
 	{
 		struct monitor *monptr = ptr->data;
-		rb_dlinkFindDestroy(client_p, &monptr->users);
-
-		/* free the rb_dlink_node allocated in add_monitor -
-		 * we don't use rb_dlinkDestory here as we are clearing the list anyways.. */
-		rb_free(ptr); 
 
+		/* ptr is the cnode at the start of the link, no lookup needed */
+		free_monitor_link(monptr, client_p, (struct monitor_link *)ptr);
 		free_monitor(monptr); /* this checks if monptr is still in use */
 	}
-
-	client_p->localClient->monitor_list.head = client_p->localClient->monitor_list.tail = NULL;
-	client_p->localClient->monitor_list.length = 0;
 }
-
-
@@ -27,6 +27,7 @@
 
 #include <ratbox_lib.h>
 #include <stdinc.h>
+#include <sys/mman.h>
 #ifdef USE_CHALLENGE
 #include <openssl/pem.h>
 #include <openssl/rsa.h>
@@ -54,6 +55,7 @@
 #include <sslproc.h>
 #include <whowas.h>
 #include <s_auth.h>
+#include <version.h>
 
 #define CF_TYPE(x) ((x) & CF_MTYPE)
 
@@ -62,6 +64,7 @@ FILE *conf_fbfile_in;
 char conffilebuf[IRCD_BUFSIZE + 1];
 
 static rb_dlink_list conflist;
+static rb_dlink_list applied_conflist;
 static conf_t *curconf;
 
 extern char *current_file;
@@ -91,9 +94,12 @@ struct topconf
 	void (*end_func) (conf_t *);
 	int needsub;
 	struct conf_items *itemtable;
+	rb_dlink_list blocks;
+	int keep;
 };
 
 static rb_dlink_list toplist;
+static rb_dlink_list conf_filenames;
 static rb_dlink_list valid_blocks;
 
 static const char *
@@ -331,6 +337,32 @@ set_modes_from_table(int *modes, const char *whatis, struct mode_table *tab, con
 
 }
 
+/* conf_filename()
+ *
+ * inputs	- name of a config file
+ * outputs	- shared copy of the name
+ * side effects - the name is added to conf_filenames the first time
+ *		  it is seen, every block and entry from that file then
+ *		  points at the one copy.  the copies are never freed, as
+ *		  the applied config keeps using them across a rehash
+ */
+static char *
+conf_filename(const char *name)
+{
+	rb_dlink_node *ptr;
+
+	RB_DLINK_FOREACH(ptr, conf_filenames.head)
+	{
+		if(!strcmp(ptr->data, name))
+			return ptr->data;
+	}
+
+	/* the block heap may not be set up yet, see add_entry() */
+	ptr = rb_malloc(sizeof(rb_dlink_node));
+	rb_dlinkAdd(rb_strdup(name), ptr, &conf_filenames);
+	return ptr->data;
+}
+
 static conf_t *
 make_conf_block(const char *blockname)
 {
@@ -351,7 +383,7 @@ add_entry(conf_t * conf, const char *name, void *value, int type)
 	}
 	entry->entryname = rb_strdup(name);
 	entry->line = lineno;
-	entry->filename = rb_strdup(current_file);
+	entry->filename = conf_filename(current_file);
 	switch (CF_TYPE(type))
 	{
 
@@ -404,7 +436,6 @@ del_entry(conf_t * conf, confentry_t * entry)
 				break;
 			}
 			rb_free(xentry->entryname);
-			rb_free(xentry->filename);
 			rb_dlinkDelete(&xentry->node, &entry->flist);
 			rb_free(xentry);
 		}
@@ -425,7 +456,6 @@ del_entry(conf_t * conf, confentry_t * entry)
 		break;
 	}
 	rb_free(entry->entryname);
-	rb_free(entry->filename);
 	rb_dlinkDelete(&entry->node, &conf->entries);
 
 	rb_free(entry);
@@ -433,7 +463,7 @@ del_entry(conf_t * conf, confentry_t * entry)
 
 
 static void
-del_conf(conf_t * conf)
+del_conf(conf_t * conf, rb_dlink_list *list)
 {
 	rb_dlink_node *ptr, *next;
 	RB_DLINK_FOREACH_SAFE(ptr, next, conf->entries.head)
@@ -442,26 +472,29 @@ del_conf(conf_t * conf)
 		del_entry(conf, entry);
 	}
 	rb_free(conf->confname);
-	rb_free(conf->filename);
 	rb_free(conf->subname);
-	rb_dlinkDelete(&conf->node, &conflist);
+	rb_dlinkDelete(&conf->node, list);
 	rb_free(conf);
 }
 
-
-
-void
-delete_all_conf(void)
+static void
+delete_conf_list(rb_dlink_list *list)
 {
 	rb_dlink_node *ptr, *next;
 
-	RB_DLINK_FOREACH_SAFE(ptr, next, conflist.head)
+	RB_DLINK_FOREACH_SAFE(ptr, next, list->head)
 	{
 		conf_t *conf = ptr->data;
-		del_conf(conf);
+		del_conf(conf, list);
 	}
 }
 
+void
+delete_all_conf(void)
+{
+	delete_conf_list(&conflist);
+}
+
 
 static char *
 strip_tabs(char *dest, const char *src, size_t len)
@@ -567,7 +600,7 @@ conf_start_block(char *block, char *name)
 	if(name != NULL)
 		conf->subname = rb_strdup(name);
 	conf->line = lineno;
-	conf->filename = rb_strdup(current_file);
+	conf->filename = conf_filename(current_file);
 	curconf = conf;
 	return 0;
 }
@@ -597,14 +630,14 @@ add_entry_flist(conf_t * conf, const char *name, conf_parm_t * parm)
 	}
 	entry->entryname = rb_strdup(name);
 	entry->line = lineno;
-	entry->filename = rb_strdup(current_file);
+	entry->filename = conf_filename(current_file);
 	entry->type = parm->type | CF_FLIST;
 	RB_DLINK_FOREACH_SAFE(cp, next, parm)
 	{
 		sub = rb_malloc(sizeof(confentry_t));
 		sub->entryname = rb_strdup(name);
 		sub->line = lineno;
-		sub->filename = rb_strdup(current_file);
+		sub->filename = conf_filename(current_file);
 
 		switch (CF_TYPE(cp->type))
 		{
@@ -674,20 +707,602 @@ conf_call_set(char *item, conf_parm_t * value, int type)
 	return 0;
 }
 
+/*
+ * The parsed conflist is saved next to the config file as a snapshot and
+ * mmap()ed back in place of running the parser again, for as long as none
+ * of the files that went into it have changed.  Integers are stored in
+ * host byte order, strings as a 32 bit length, the bytes and a NUL, with
+ * CONF_SNAP_NULL as the length of a NULL string, and the file ends in a
+ * checksum of everything before it.  The snapshot is tied to
+ * the ircd build that wrote it, so any change to the format or the parser
+ * only needs a rebuild to retire old ones.
+ */
+#define CONF_SNAP_SUFFIX	".snap"
+#define CONF_SNAP_MAGIC		"RBCONFSN"
+#define CONF_SNAP_MAGICLEN	8
+#define CONF_SNAP_VERSION	1
+#define CONF_SNAP_ENDIAN	0x01020304
+#define CONF_SNAP_NULL		0xFFFFFFFF
+#define CONF_SNAP_SUM_INIT	0x811c9dc5UL
+
+struct conf_source
+{
+	rb_dlink_node node;
+	char *path;
+	int64_t mtime;
+	int64_t size;
+	int64_t ino;
+};
+
+static rb_dlink_list conf_sources;
+
+struct snap_writer
+{
+	FILE *f;
+	uint32_t sum;
+};
+
+struct snap_reader
+{
+	const char *pos;
+	const char *end;
+	int bad;
+};
+
+/* conf_add_source()
+ *
+ * inputs	- path of a file opened for the parser, the open file
+ * outputs	- none
+ * side effects - the file is recorded in conf_sources, so that a
+ *		  snapshot of this parse can tell later on if it is stale
+ */
+void
+conf_add_source(const char *path, FILE * file)
+{
+	struct conf_source *src;
+	struct stat st;
+
+	if(fstat(fileno(file), &st) < 0)
+		memset(&st, 0, sizeof(st));
+
+	src = rb_malloc(sizeof(struct conf_source));
+	src->path = rb_strdup(path);
+	src->mtime = st.st_mtime;
+	src->size = st.st_size;
+	src->ino = st.st_ino;
+	rb_dlinkAddTail(src, &src->node, &conf_sources);
+}
+
+static void
+clear_conf_sources(void)
+{
+	rb_dlink_node *ptr, *next;
+	struct conf_source *src;
+
+	RB_DLINK_FOREACH_SAFE(ptr, next, conf_sources.head)
+	{
+		src = ptr->data;
+		rb_dlinkDelete(ptr, &conf_sources);
+		rb_free(src->path);
+		rb_free(src);
+	}
+}
+
+/* snap_sum()
+ *
+ * inputs	- running sum, data to add to it
+ * outputs	- the new sum, FNV-1a over everything before the trailer,
+ *		  so a damaged snapshot is parsed over instead of loaded
+ * side effects - none
+ */
+static uint32_t
+snap_sum(uint32_t h, const void *data, size_t len)
+{
+	const unsigned char *s = data;
+	const unsigned char *x = s + len;
+
+	while(s < x)
+	{
+		h ^= *s++;
+		h += (h << 1) + (h << 4) + (h << 7) + (h << 8) + (h << 24);
+	}
+	return h;
+}
+
+static void
+snap_put(struct snap_writer *w, const void *data, size_t len)
+{
+	fwrite(data, 1, len, w->f);
+	w->sum = snap_sum(w->sum, data, len);
+}
+
+static void
+snap_put_u32(struct snap_writer *w, uint32_t val)
+{
+	snap_put(w, &val, sizeof(val));
+}
+
+static void
+snap_put_i64(struct snap_writer *w, int64_t val)
+{
+	snap_put(w, &val, sizeof(val));
+}
+
+static void
+snap_put_str(struct snap_writer *w, const char *str)
+{
+	uint32_t len;
+
+	if(str == NULL)
+	{
+		snap_put_u32(w, CONF_SNAP_NULL);
+		return;
+	}
+	len = strlen(str);
+	snap_put_u32(w, len);
+	snap_put(w, str, len + 1);
+}
+
+static uint32_t
+snap_file_index(const char *filename)
+{
+	rb_dlink_node *ptr;
+	uint32_t i = 0;
+
+	RB_DLINK_FOREACH(ptr, conf_filenames.head)
+	{
+		if(ptr->data == filename)
+			return i;
+		i++;
+	}
+	return CONF_SNAP_NULL;
+}
+
+static void
+snap_put_item(struct snap_writer *w, confentry_t * entry)
+{
+	snap_put_str(w, entry->entryname);
+	snap_put_u32(w, entry->type);
+	snap_put_i64(w, entry->number);
+	snap_put_str(w, entry->string);
+	snap_put_u32(w, snap_file_index(entry->filename));
+	snap_put_u32(w, entry->line);
+}
+
+static void
+snap_put_entry(struct snap_writer *w, confentry_t * entry)
+{
+	rb_dlink_node *ptr;
+
+	snap_put_item(w, entry);
+	if(!(entry->type & CF_FLIST))
+		return;
+
+	snap_put_u32(w, rb_dlink_list_length(&entry->flist));
+	RB_DLINK_FOREACH(ptr, entry->flist.head)
+	{
+		snap_put_item(w, ptr->data);
+	}
+}
+
+static int snap_write_failed;
+
+/* snap_write_error()
+ *
+ * inputs	- name of the file that couldn't be written
+ * outputs	- none
+ * side effects - logged only the first time in a row, the config is
+ *		  just parsed again next time so there is no harm done
+ */
+static void
+snap_write_error(const char *name)
+{
+	if(snap_write_failed++)
+		return;
+	ilog(L_MAIN, "Unable to write config snapshot %s: %s", name, strerror(errno));
+}
+
+/* write_conf_snapshot()
+ *
+ * inputs	- name of the config file that has just been parsed
+ * outputs	- none
+ * side effects - conflist is written out to filename.snap
+ */
+static void
+write_conf_snapshot(const char *filename)
+{
+	char snapname[PATH_MAX];
+	char tmpname[PATH_MAX];
+	const char *ver, *serno, *creation;
+	rb_dlink_node *ptr, *xptr;
+	struct conf_source *src;
+	conf_t *conf;
+	time_t now = time(NULL);
+	struct snap_writer w;
+	int fd;
+
+	snprintf(snapname, sizeof(snapname), "%s%s", filename, CONF_SNAP_SUFFIX);
+	snprintf(tmpname, sizeof(tmpname), "%s.tmp", snapname);
+
+	/* a file written to again within the second we read it could
+	 * still match the mtime and size we saw, so don't vouch for it
+	 */
+	RB_DLINK_FOREACH(ptr, conf_sources.head)
+	{
+		src = ptr->data;
+		if(src->mtime >= now)
+		{
+			unlink(snapname);
+			return;
+		}
+	}
+
+	/* it holds the passwords from the config too */
+	if((fd = open(tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0)
+	{
+		snap_write_error(tmpname);
+		return;
+	}
+
+	if((w.f = fdopen(fd, "w")) == NULL)
+	{
+		close(fd);
+		unlink(tmpname);
+		return;
+	}
+
+	ratbox_version(&ver, &serno, NULL, NULL, &creation);
+	w.sum = CONF_SNAP_SUM_INIT;
+	snap_put(&w, CONF_SNAP_MAGIC, CONF_SNAP_MAGICLEN);
+	snap_put_u32(&w, CONF_SNAP_VERSION);
+	snap_put_u32(&w, CONF_SNAP_ENDIAN);
+	snap_put_str(&w, ver);
+	snap_put_str(&w, serno);
+	snap_put_str(&w, creation);
+	snap_put_str(&w, filename);
+
+	snap_put_u32(&w, rb_dlink_list_length(&conf_sources));
+	RB_DLINK_FOREACH(ptr, conf_sources.head)
+	{
+		src = ptr->data;
+		snap_put_str(&w, src->path);
+		snap_put_i64(&w, src->mtime);
+		snap_put_i64(&w, src->size);
+		snap_put_i64(&w, src->ino);
+	}
+
+	snap_put_u32(&w, rb_dlink_list_length(&conf_filenames));
+	RB_DLINK_FOREACH(ptr, conf_filenames.head)
+	{
+		snap_put_str(&w, ptr->data);
+	}
+
+	snap_put_u32(&w, rb_dlink_list_length(&conflist));
+	RB_DLINK_FOREACH(ptr, conflist.head)
+	{
+		conf = ptr->data;
+		snap_put_str(&w, conf->confname);
+		snap_put_str(&w, conf->subname);
+		snap_put_u32(&w, snap_file_index(conf->filename));
+		snap_put_u32(&w, conf->line);
+		snap_put_u32(&w, rb_dlink_list_length(&conf->entries));
+		RB_DLINK_FOREACH(xptr, conf->entries.head)
+		{
+			snap_put_entry(&w, xptr->data);
+		}
+	}
+
+	/* the sum goes last and isn't part of itself */
+	fwrite(&w.sum, sizeof(w.sum), 1, w.f);
+
+	if(fflush(w.f) != 0 || ferror(w.f))
+	{
+		snap_write_error(tmpname);
+		fclose(w.f);
+		unlink(tmpname);
+		return;
+	}
+
+	if(fclose(w.f) != 0 || rename(tmpname, snapname) < 0)
+	{
+		snap_write_error(snapname);
+		unlink(tmpname);
+		return;
+	}
+	snap_write_failed = 0;
+}
+
+static void
+snap_get(struct snap_reader *r, void *buf, size_t len)
+{
+	if(r->bad || (size_t)(r->end - r->pos) < len)
+	{
+		r->bad = 1;
+		memset(buf, 0, len);
+		return;
+	}
+	memcpy(buf, r->pos, len);
+	r->pos += len;
+}
+
+static uint32_t
+snap_get_u32(struct snap_reader *r)
+{
+	uint32_t val;
+	snap_get(r, &val, sizeof(val));
+	return val;
+}
+
+static int64_t
+snap_get_i64(struct snap_reader *r)
+{
+	int64_t val;
+	snap_get(r, &val, sizeof(val));
+	return val;
+}
+
+/* snap_get_str()
+ *
+ * inputs	- snapshot reader
+ * outputs	- the next string, pointing into the snapshot itself, or
+ *		  NULL for a NULL string or when the snapshot is bad
+ * side effects - r->bad is set if the string runs off the end
+ */
+static const char *
+snap_get_str(struct snap_reader *r)
+{
+	const char *str;
+	uint32_t len;
+
+	len = snap_get_u32(r);
+	if(r->bad || len == CONF_SNAP_NULL)
+		return NULL;
+
+	if((size_t)(r->end - r->pos) <= len || r->pos[len] != '\0')
+	{
+		r->bad = 1;
+		return NULL;
+	}
+	str = r->pos;
+	r->pos += len + 1;
+	return str;
+}
+
+static int
+snap_str_equal(const char *a, const char *b)
+{
+	if(a == NULL || b == NULL)
+		return a == b;
+	return !strcmp(a, b);
+}
+
+static confentry_t *
+snap_get_item(struct snap_reader *r, char **names, uint32_t nnames)
+{
+	confentry_t *entry;
+	const char *name, *string;
+	uint32_t idx;
+
+	if((name = snap_get_str(r)) == NULL)
+	{
+		r->bad = 1;
+		return NULL;
+	}
+
+	entry = rb_malloc(sizeof(confentry_t));
+	entry->entryname = rb_strdup(name);
+	entry->type = snap_get_u32(r);
+	entry->number = snap_get_i64(r);
+	string = snap_get_str(r);
+
+	/* del_entry() only frees the string for these */
+	switch (CF_TYPE(entry->type))
+	{
+	case CF_STRING:
+	case CF_QSTRING:
+	case CF_YESNO:
+		if(string != NULL)
+			entry->string = rb_strdup(string);
+	default:
+		break;
+	}
+
+	idx = snap_get_u32(r);
+	entry->filename = idx < nnames ? names[idx] : NULL;
+	entry->line = snap_get_u32(r);
+	return entry;
+}
+
+/* snap_get_entry()
+ *
+ * inputs	- snapshot reader, the file name table
+ * outputs	- the next entry built the same way add_entry() and
+ *		  add_entry_flist() build them, or NULL
+ * side effects - r->bad is set on a damaged snapshot, the entry is
+ *		  still returned if it got as far as being allocated
+ */
+static confentry_t *
+snap_get_entry(struct snap_reader *r, char **names, uint32_t nnames)
+{
+	confentry_t *entry, *sub;
+	uint32_t count;
+
+	if((entry = snap_get_item(r, names, nnames)) == NULL)
+		return NULL;
+
+	if(!(entry->type & CF_FLIST))
+	{
+		rb_dlinkAdd(entry, rb_malloc(sizeof(rb_dlink_node)), &entry->flist);
+		return entry;
+	}
+
+	for(count = snap_get_u32(r); count > 0 && !r->bad; count--)
+	{
+		if((sub = snap_get_item(r, names, nnames)) == NULL)
+			break;
+		rb_dlinkAddTail(sub, &sub->node, &entry->flist);
+	}
+	return entry;
+}
+
+/* read_conf_snapshot()
+ *
+ * inputs	- reader over the mapped snapshot, the config file name
+ * outputs	- 1 if conflist was rebuilt from it, 0 otherwise
+ * side effects - conflist may be left half built on failure
+ */
+static int
+read_conf_snapshot(struct snap_reader *r, const char *filename)
+{
+	const char *ver, *serno, *creation;
+	const char *path, *name;
+	char **names;
+	struct stat st;
+	conf_t *conf;
+	confentry_t *entry;
+	int64_t mtime, size, ino;
+	uint32_t count, nentries, nnames, i;
+
+	if(r->end - r->pos < CONF_SNAP_MAGICLEN || memcmp(r->pos, CONF_SNAP_MAGIC, CONF_SNAP_MAGICLEN))
+		return 0;
+	r->pos += CONF_SNAP_MAGICLEN;
+
+	if(snap_get_u32(r) != CONF_SNAP_VERSION || snap_get_u32(r) != CONF_SNAP_ENDIAN)
+		return 0;
+
+	ratbox_version(&ver, &serno, NULL, NULL, &creation);
+	if(!snap_str_equal(snap_get_str(r), ver) || !snap_str_equal(snap_get_str(r), serno) ||
+	   !snap_str_equal(snap_get_str(r), creation) || !snap_str_equal(snap_get_str(r), filename))
+		return 0;
+
+	/* everything that went into it has to be untouched since */
+	for(count = snap_get_u32(r); count > 0 && !r->bad; count--)
+	{
+		path = snap_get_str(r);
+		mtime = snap_get_i64(r);
+		size = snap_get_i64(r);
+		ino = snap_get_i64(r);
+		if(path == NULL || stat(path, &st) < 0)
+			return 0;
+		if(st.st_mtime != mtime || st.st_size != size || (int64_t)st.st_ino != ino)
+			return 0;
+	}
+
+	/* each name takes at least five bytes, don't let a damaged
+	 * count make us allocate more than the snapshot could hold
+	 */
+	nnames = snap_get_u32(r);
+	if(r->bad || nnames > (size_t)(r->end - r->pos) / 5)
+		return 0;
+
+	names = rb_malloc(sizeof(char *) * (nnames + 1));
+	for(i = 0; i < nnames; i++)
+	{
+		name = snap_get_str(r);
+		if(name != NULL)
+			names[i] = conf_filename(name);
+	}
+
+	for(count = snap_get_u32(r); count > 0 && !r->bad; count--)
+	{
+		if((name = snap_get_str(r)) == NULL)
+		{
+			r->bad = 1;
+			break;
+		}
+		conf = make_conf_block(name);
+		if((name = snap_get_str(r)) != NULL)
+			conf->subname = rb_strdup(name);
+		i = snap_get_u32(r);
+		conf->filename = i < nnames ? names[i] : NULL;
+		conf->line = snap_get_u32(r);
+
+		for(nentries = snap_get_u32(r); nentries > 0 && !r->bad; nentries--)
+		{
+			if((entry = snap_get_entry(r, names, nnames)) == NULL)
+				break;
+			rb_dlinkAddTail(entry, &entry->node, &conf->entries);
+		}
+	}
+
+	rb_free(names);
+	return !r->bad && r->pos == r->end;
+}
+
+/* load_conf_snapshot()
+ *
+ * inputs	- name of the config file
+ * outputs	- 1 if conflist was loaded from filename.snap, 0 if the
+ *		  file has to be parsed
+ * side effects - none if the snapshot is missing, stale or damaged
+ */
+static int
+load_conf_snapshot(const char *filename)
+{
+	char snapname[PATH_MAX];
+	struct snap_reader r;
+	struct stat st;
+	uint32_t sum;
+	void *map;
+	int fd, ok;
+
+	snprintf(snapname, sizeof(snapname), "%s%s", filename, CONF_SNAP_SUFFIX);
+	if((fd = open(snapname, O_RDONLY)) < 0)
+		return 0;
+
+	if(fstat(fd, &st) < 0 || st.st_size <= (off_t)sizeof(sum))
+	{
+		close(fd);
+		return 0;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED)
+		return 0;
+
+	r.pos = map;
+	r.end = r.pos + st.st_size - sizeof(sum);
+	r.bad = 0;
+	memcpy(&sum, r.end, sizeof(sum));
+	if(snap_sum(CONF_SNAP_SUM_INIT, r.pos, r.end - r.pos) == sum)
+		ok = read_conf_snapshot(&r, filename);
+	else
+		ok = 0;
+	munmap(map, st.st_size);
+
+	if(!ok)
+	{
+		delete_conf_list(&conflist);
+		return 0;
+	}
+
+	ilog(L_MAIN, "Loaded %s from snapshot %s", filename, snapname);
+	return 1;
+}
+
 int
 read_config_file(const char *filename)
 {
 	conf_parse_failure = 0;
 	delete_all_conf();
 	rb_strlcpy(conffilebuf, filename, sizeof(conffilebuf));
+
+	if(load_conf_snapshot(filename))
+		return 0;
+
+	clear_conf_sources();
 	if((conf_fbfile_in = fopen(filename, "r")) == NULL)
 	{
 		conf_report_error_nl("Unable to open file %s %s", filename, strerror(errno));
 		return 1;
 	}
+	conf_add_source(filename, conf_fbfile_in);
 	yyparse();
 
 	fclose(conf_fbfile_in);
+	if(conf_parse_failure == 0)
+		write_conf_snapshot(filename);
 	return conf_parse_failure;
 
 }
@@ -1751,6 +2366,20 @@ conf_set_general_hide_error_messages(confentry_t * entry, conf_t * conf, struct
 			 entry->filename, entry->line);
 }
 
+static void
+conf_set_log_overflow(confentry_t * entry, conf_t * conf, struct conf_items *item)
+{
+	char *val = entry->string;
+
+	if(strcasecmp(val, "block") == 0)
+		ConfigFileEntry.log_overflow_block = 1;
+	else if(strcasecmp(val, "drop") == 0)
+		ConfigFileEntry.log_overflow_block = 0;
+	else
+		conf_report_warning_nl("Invalid setting '%s' for log::overflow at %s:%d", val,
+				       entry->filename, entry->line);
+}
+
 static void
 conf_set_general_oper_only_umodes(confentry_t * entry, conf_t * conf, struct conf_items *item)
 {
@@ -2339,24 +2968,175 @@ find_item(const char *name, struct conf_items *itemtable)
 	return NULL;
 }
 
+static struct topconf *
+find_top_conf(const char *name)
+{
+	rb_dlink_node *ptr;
+	struct topconf *top;
+
+	RB_DLINK_FOREACH(ptr, toplist.head)
+	{
+		top = ptr->data;
+		if(!strcasecmp(name, top->tc_name))
+			return top;
+	}
+	return NULL;
+}
+
+static int
+conf_entry_equal(confentry_t * a, confentry_t * b)
+{
+	rb_dlink_node *aptr, *bptr;
+
+	if(a->type != b->type || a->number != b->number || strcmp(a->entryname, b->entryname)
+	   || !snap_str_equal(a->string, b->string))
+		return 0;
+
+	if(!(a->type & CF_FLIST))
+		return 1;
+
+	for(aptr = a->flist.head, bptr = b->flist.head; aptr != NULL && bptr != NULL;
+	    aptr = aptr->next, bptr = bptr->next)
+	{
+		if(!conf_entry_equal(aptr->data, bptr->data))
+			return 0;
+	}
+	return aptr == bptr;
+}
+
+static int
+conf_block_equal(conf_t * a, conf_t * b)
+{
+	rb_dlink_node *aptr, *bptr;
+
+	if(!snap_str_equal(a->subname, b->subname))
+		return 0;
+
+	for(aptr = a->entries.head, bptr = b->entries.head; aptr != NULL && bptr != NULL;
+	    aptr = aptr->next, bptr = bptr->next)
+	{
+		if(!conf_entry_equal(aptr->data, bptr->data))
+			return 0;
+	}
+	return aptr == bptr;
+}
+
+static rb_dlink_node *
+next_conf_block(rb_dlink_node *ptr, const char *name)
+{
+	conf_t *conf;
+
+	for(; ptr != NULL; ptr = ptr->next)
+	{
+		conf = ptr->data;
+		if(!strcasecmp(conf->confname, name))
+			return ptr;
+	}
+	return NULL;
+}
+
+/* conf_type_changed()
+ *
+ * inputs	- name of a top level block type
+ * outputs	- 1 if the blocks of that type in conflist differ from the
+ *		  ones last applied, in content or order, 0 if not
+ * side effects - none
+ */
+static int
+conf_type_changed(const char *name)
+{
+	rb_dlink_node *optr, *nptr;
+
+	optr = next_conf_block(applied_conflist.head, name);
+	nptr = next_conf_block(conflist.head, name);
+	while(optr != NULL && nptr != NULL)
+	{
+		if(!conf_block_equal(optr->data, nptr->data))
+			return 1;
+		optr = next_conf_block(optr->next, name);
+		nptr = next_conf_block(nptr->next, name);
+	}
+	return optr != nptr;
+}
+
+/* block types a rehash only rebuilds when their blocks changed.  their
+ * clear function has to remove exactly what the blocks added, and the
+ * blocks must not depend on anything but the type named in depends.
+ * everything else is cleared and applied again by every rehash.
+ */
+static struct conf_incremental
+{
+	const char *name;
+	void (*clear_func) (void);
+	const char *depends;
+} conf_incremental_table[] = {
+	{ "auth",	clear_out_address_conf,	"class"	},
+	{ "exempt",	remove_exempts,		NULL	},
+	{ NULL,		NULL,			NULL	}
+};
+
+/* clear_changed_confs()
+ *
+ * inputs	- none
+ * outputs	- none
+ * side effects - the incremental block types that changed since the
+ *		  last load are cleared, the others are marked to be
+ *		  skipped by the coming load_conf_settings()
+ */
+void
+clear_changed_confs(void)
+{
+	struct conf_incremental *inc;
+	struct topconf *top;
+
+	for(inc = conf_incremental_table; inc->name != NULL; inc++)
+	{
+		if((top = find_top_conf(inc->name)) == NULL)
+			continue;
+
+		if(conf_type_changed(inc->name) || (inc->depends != NULL && conf_type_changed(inc->depends)))
+		{
+			inc->clear_func();
+			top->keep = 0;
+			ilog(L_MAIN, "Rehash: %s blocks changed, rebuilding them", inc->name);
+		}
+		else
+		{
+			top->keep = 1;
+			ilog(L_MAIN, "Rehash: %s blocks unchanged, keeping them", inc->name);
+		}
+	}
+}
+
 static void
 register_top_confs(void)
 {
 	CONF_CB *func;
-	rb_dlink_node *ptr, *xptr, *yptr;
+	rb_dlink_node *ptr, *next, *xptr, *yptr;
 	struct topconf *top;
 	conf_t *conf;
 	confentry_t *entry;
 	struct conf_items *tab;
 
+	/* sort the blocks by type in one pass over conflist, keeping the
+	 * order of both toplist and the file within each type
+	 */
+	RB_DLINK_FOREACH(xptr, conflist.head)
+	{
+		conf = xptr->data;
+		top = find_top_conf(conf->confname);
+		if(top != NULL && !top->keep)
+			rb_dlinkAddTailAlloc(conf, &top->blocks);
+	}
+
 	RB_DLINK_FOREACH(ptr, toplist.head)
 	{
 		top = ptr->data;
-		RB_DLINK_FOREACH(xptr, conflist.head)
+		top->keep = 0;
+		RB_DLINK_FOREACH_SAFE(xptr, next, top->blocks.head)
 		{
 			conf = xptr->data;
-			if(strcasecmp(conf->confname, top->tc_name))
-				continue;
+			rb_dlinkDestroy(xptr, &top->blocks);
 
 			if(top->start_func != NULL)
 				top->start_func(conf);
@@ -2443,6 +3223,11 @@ load_conf_settings(void)
 	}
 	whowas_set_size(ConfigFileEntry.whowas_length);	
 	check_class();
+
+	/* keep what we just applied around for the next rehash to diff */
+	delete_conf_list(&applied_conflist);
+	applied_conflist = conflist;
+	memset(&conflist, 0, sizeof(conflist));
 }
 
 
@@ -2503,6 +3288,9 @@ static struct conf_items conf_log_table[] =
 	{ "fname_klinelog",	CF_QSTRING, NULL, MAXPATHLEN, &ConfigFileEntry.fname_klinelog	},
 	{ "fname_operspylog",	CF_QSTRING, NULL, MAXPATHLEN, &ConfigFileEntry.fname_operspylog	},
 	{ "fname_ioerrorlog",	CF_QSTRING, NULL, MAXPATHLEN, &ConfigFileEntry.fname_ioerrorlog },
+	{ "threaded",		CF_YESNO,   NULL, 0,	      &ConfigFileEntry.log_threaded	},
+	{ "buffer_lines",	CF_INT,	    NULL, 0,	      &ConfigFileEntry.log_buffer_lines	},
+	{ "overflow",		CF_STRING,  conf_set_log_overflow, 0, NULL },
 	{ "\0",			0,	    NULL, 0,	      NULL }
 };
 
@@ -57,7 +57,7 @@ parse_client_queued(struct Client *client_p)
 	{
 		for(;;)
 		{
-			if(client_p->localClient->sent_parsed >= client_p->localClient->allow_read)
+			if(LocalSentParsed(client_p) >= LocalAllowRead(client_p))
 				break;
 
 			dolen = rb_linebuf_get(client_p->localClient->buf_recvq, readBuf,
@@ -67,7 +67,7 @@ parse_client_queued(struct Client *client_p)
 				break;
 
 			client_dopacket(client_p, readBuf, dolen);
-			client_p->localClient->sent_parsed++;
+			LocalSentParsed(client_p)++;
 
 			/* He's dead cap'n */
 			if(IsAnyDead(client_p))
@@ -80,7 +80,7 @@ parse_client_queued(struct Client *client_p)
 				/* reset their flood limits, they're now
 				 * graced to flood
 				 */
-				client_p->localClient->sent_parsed = 0;
+				LocalSentParsed(client_p) = 0;
 				break;
 			}
 		}
@@ -113,7 +113,7 @@ parse_client_queued(struct Client *client_p)
 			 * so just hope the queue is big enough for them.. --anfl
 			 */
 			if(!tested &&
-			   (client_p->localClient->firsttime + ConfigFileEntry.post_registration_delay) >
+			   (LocalFirstTime(client_p) + ConfigFileEntry.post_registration_delay) >
 			   rb_current_time())
 				break;
 			else
@@ -134,14 +134,14 @@ parse_client_queued(struct Client *client_p)
 			 */
 			if(checkflood)
 			{
-				if(client_p->localClient->sent_parsed >= client_p->localClient->allow_read)
+				if(LocalSentParsed(client_p) >= LocalAllowRead(client_p))
 					break;
 			}
 
 			/* allow opers 4 times the amount of messages as users. why 4?
 			 * why not. :) --fl_
 			 */
-			else if(client_p->localClient->sent_parsed >= (4 * client_p->localClient->allow_read))
+			else if(LocalSentParsed(client_p) >= (4 * LocalAllowRead(client_p)))
 				break;
 
 			dolen = rb_linebuf_get(client_p->localClient->buf_recvq, readBuf,
@@ -153,9 +153,12 @@ parse_client_queued(struct Client *client_p)
 			client_dopacket(client_p, readBuf, dolen);
 			if(IsAnyDead(client_p))
 				return;
-			client_p->localClient->sent_parsed++;
+			LocalSentParsed(client_p)++;
 		}
 	}
+
+	/* let flood_recalc() know whether there is anything left for it */
+	LocalQueued(client_p) = rb_linebuf_numlines(client_p->localClient->buf_recvq) != 0;
 }
 
 /*
@@ -163,59 +166,49 @@ parse_client_queued(struct Client *client_p)
  *
  * recalculate the number of allowed flood lines. this should be called
  * once a second on any given client. We then attempt to flush some data.
+ *
+ * This walks local_sweep rather than lclient_list and unknown_list, and
+ * only calls parse_client_queued() for clients that left lines behind,
+ * so an idle client costs its sweep entries and the head of its struct
+ * Client.
  */
 void
 flood_recalc(void *unused)
 {
-	rb_dlink_node *ptr, *next;
+	unsigned int i;
 
-	RB_DLINK_FOREACH_SAFE(ptr, next, lclient_list.head)
+	for(i = 0; i < local_sweep.count; i++)
 	{
-		struct Client *client_p = ptr->data;
+		struct Client *client_p = local_sweep.client[i];
 
-		if(rb_unlikely(IsMe(client_p)))
+		if(rb_unlikely(IsMe(client_p) || IsServer(client_p) || IsAnyDead(client_p)))
 			continue;
 
-		if(rb_unlikely(client_p->localClient == NULL))
-			continue;
-
-		if(IsFloodDone(client_p))
-			client_p->localClient->sent_parsed -= 2;
+		if(!IsClient(client_p))
+			local_sweep.sent_parsed[i]--;
+		else if(IsFloodDone(client_p))
+			local_sweep.sent_parsed[i] -= 2;
 		else
-			client_p->localClient->sent_parsed = 0;
+			local_sweep.sent_parsed[i] = 0;
 
-		if(client_p->localClient->sent_parsed < 0)
-			client_p->localClient->sent_parsed = 0;
+		if(local_sweep.sent_parsed[i] < 0)
+			local_sweep.sent_parsed[i] = 0;
 
-		if(--client_p->localClient->actually_read < 0)
-			client_p->localClient->actually_read = 0;
+		if(--local_sweep.actually_read[i] < 0)
+			local_sweep.actually_read[i] = 0;
 
-		parse_client_queued(client_p);
+		if(local_sweep.queued[i])
+		{
+			parse_client_queued(client_p);
 
-		if(rb_unlikely(IsAnyDead(client_p)))
-			continue;
+			if(rb_unlikely(IsAnyDead(client_p)))
+				continue;
+		}
 
-		if(!IsFloodDone(client_p) && ((client_p->localClient->firsttime + 30) < rb_current_time()))
+		if(IsClient(client_p) && !IsFloodDone(client_p)
+		   && ((LocalFirstTime(client_p) + 30) < rb_current_time()))
 			flood_endgrace(client_p);
 	}
-
-	RB_DLINK_FOREACH_SAFE(ptr, next, unknown_list.head)
-	{
-		struct Client *client_p = ptr->data;
-
-		if(client_p->localClient == NULL)
-			continue;
-
-		client_p->localClient->sent_parsed--;
-
-		if(client_p->localClient->sent_parsed < 0)
-			client_p->localClient->sent_parsed = 0;
-
-		if(--client_p->localClient->actually_read < 0)
-			client_p->localClient->actually_read = 0;
-
-		parse_client_queued(client_p);
-	}
 }
 
 
@@ -226,7 +219,6 @@ void
 read_packet(rb_fde_t * F, void *data)
 {
 	struct Client *client_p = data;
-	struct LocalUser *lclient_p = client_p->localClient;
 	char readBuf[READBUF_SIZE];
 	int length = 0;
 	int lbuf_len;
@@ -262,8 +254,8 @@ read_packet(rb_fde_t * F, void *data)
 			return;
 		}
 
-		if(client_p->localClient->lasttime < rb_current_time())
-			client_p->localClient->lasttime = rb_current_time();
+		if(LocalLastTime(client_p) < rb_current_time())
+			LocalLastTime(client_p) = rb_current_time();
 		client_p->flags &= ~FLAGS_PINGSENT;
 
 		/*
@@ -276,7 +268,7 @@ read_packet(rb_fde_t * F, void *data)
 
 		lbuf_len = rb_linebuf_parse(client_p->localClient->buf_recvq, readBuf, length, binary);
 
-		lclient_p->actually_read += lbuf_len;
+		LocalActuallyRead(client_p) += lbuf_len;
 
 		if(IsAnyDead(client_p))
 			return;
@@ -354,10 +346,10 @@ flood_endgrace(struct Client *client_p)
 {
 	SetFloodDone(client_p);
 	/* Drop their flood limit back down */
-	client_p->localClient->allow_read = MAX_FLOOD;
+	LocalAllowRead(client_p) = MAX_FLOOD;
 
 	/* sent_parsed could be way over MAX_FLOOD but under MAX_FLOOD_BURST,
 	 * so reset it.
 	 */
-	client_p->localClient->sent_parsed = 0;
+	LocalSentParsed(client_p) = 0;
 }
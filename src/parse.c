@@ -48,167 +48,230 @@
 static void cancel_clients(struct Client *, struct Client *);
 static void remove_unknown(struct Client *, char *, char *);
 
-static void do_numeric(char[], struct Client *, struct Client *, int, char **);
+static void do_numeric(char[], struct Client *, struct Client *, int, const char **);
 
 static int handle_command(struct Message *, struct Client *, struct Client *, int, const char **);
+static struct Message *find_command(const char *, size_t);
 
-/* parse()
+/*
+ * A line is split once, in place, by tokenize_line(): every boundary is
+ * found by the one scan from left to right, the trailing parameter is
+ * never scanned at all, and nothing is copied.  The tokens before it are
+ * short, so they are walked inline rather than paying for a strchr()
+ * call each.  The parameters are split exactly as rb_string_to_array()
+ * would, including its handling of the MAXPARA'th parameter.
+ */
+struct line_tokens
+{
+	char *sender;		/* prefix without the ':', or NULL */
+	char *cmd;		/* command or numeric, NULL if the line is empty */
+	size_t cmdlen;
+	char *args;		/* what follows the command, or NULL */
+	int numeric;
+	int parc;		/* parameters in parv, counting parv[0] */
+};
+
+/* tokenize_line()
  *
- * given a raw buffer, parses it and generates parv, parc and sender
+ * inputs	- line to split, its end, parameter array, tokens to fill in
+ * outputs	-
+ * side effects - the line is cut up with '\0's, trailing \r\n removed,
+ *		  parv[1] onwards point into it and parv[parc] is NULL
  */
-void
-parse(struct Client *client_p, char *pbuffer, char *bufend)
+static void
+tokenize_line(char *line, char *end, const char **parv, struct line_tokens *tok)
 {
-	struct Client *from = client_p;
-	char *para[MAXPARA + 2];
-	char *sender;
-
-	char *ch;
+	char *p = line;
 	char *s;
-	char *end;
-	int i = 1;
-	char *numeric = NULL;
-	struct Message *mptr;
+	int n = 0;
 
-	s_assert(MyConnect(client_p));
-	if(IsAnyDead(client_p))
-		return;
+	if(end > line && end[-1] == '\n')
+		*--end = '\0';
+	if(end > line && end[-1] == '\r')
+		*--end = '\0';
 
-	for(ch = pbuffer; *ch == ' '; ch++)	/* skip spaces */
-		/* null statement */ ;
+	tok->sender = NULL;
+	tok->cmd = NULL;
+	tok->args = NULL;
+	tok->numeric = 0;
+	parv[1] = NULL;
+	tok->parc = 1;
 
-	if(from->name != NULL)
-		para[0] = LOCAL_COPY(from->name);
-	else
-		para[0] = NULL;
+	while(*p == ' ')
+		p++;
 
-	if(*ch == ':')
+	if(*p == ':')
 	{
-		ch++;
+		tok->sender = ++p;
 
-		/* point sender to the sender param */
-		sender = ch;
+		for(s = p; *s != ' ' && *s != '\0'; s++)
+			;
 
-		if((s = strchr(ch, ' ')))
+		if(*s == ' ')
 		{
 			*s = '\0';
-			s++;
-			ch = s;
+			p = s + 1;
 		}
 
-		if(*sender && IsServer(client_p))
-		{
-			from = find_any_client(sender);
-
-			/* didnt find any matching client, issue a kill */
-			if(from == NULL)
-			{
-				ServerStats.is_unpf++;
-				remove_unknown(client_p, sender, pbuffer);
-				return;
-			}
+		while(*p == ' ')
+			p++;
+	}
 
-			para[0] = LOCAL_COPY(from->name);
+	if(*p == '\0')
+		return;
 
-			/* fake direction, hmm. */
-			if(from->from != client_p)
-			{
-				ServerStats.is_wrdi++;
-				cancel_clients(client_p, from);
-				return;
-			}
-		}
-		while(*ch == ' ')
-			ch++;
-	}
+	tok->cmd = p;
 
-	if(*ch == '\0')
+	/* EOB is 3 chars long but is not a numeric */
+	if(IsDigit(p[0]) && IsDigit(p[1]) && IsDigit(p[2]) && p[3] == ' ')
 	{
-		ServerStats.is_empt++;
-		return;
+		tok->numeric = 1;
+		tok->cmdlen = 3;
+		p[3] = '\0';
+		p += 4;
 	}
+	else
+	{
+		for(s = p; *s != ' ' && *s != '\0'; s++)
+			;
 
-	/* at this point there must be some sort of command parameter */
+		tok->cmdlen = s - p;
 
-	/*
-	 * Extract the command code from the packet.  Point s to the end
-	 * of the command code and calculate the length using pointer
-	 * arithmetic.	Note: only need length for numerics and *all*
-	 * numerics must have parameters and thus a space after the command
-	 * code. -avalon
-	 */
+		if(*s == '\0')
+			return;
 
-	/* EOB is 3 chars long but is not a numeric */
+		*s = '\0';
+		p = s + 1;
+	}
 
-	if(*(ch + 3) == ' ' &&	/* ok, lets see if its a possible numeric.. */
-	   IsDigit(*ch) && IsDigit(*(ch + 1)) && IsDigit(*(ch + 2)))
+	tok->args = p;
+
+	while(*p == ' ')
+		p++;
+
+	while(*p != '\0')
 	{
-		mptr = NULL;
-		numeric = ch;
-		ServerStats.is_num++;
-		s = ch + 3;	/* I know this is ' ' from above if */
-		*s++ = '\0';	/* blow away the ' ', and point s to next part */
+		if(*p == ':')
+		{
+			parv[++n] = p + 1;
+			break;
+		}
+
+		parv[++n] = p;
+
+		for(s = p; *s != ' ' && *s != '\0'; s++)
+			;
+
+		if(*s == '\0')
+			break;
+
+		*s++ = '\0';
+		p = s;
+
+		while(*p == ' ')
+			p++;
+
+		/* the last one takes the rest of the line, from just after
+		 * the space, as rb_string_to_array() does
+		 */
+		if(*p != '\0' && n == MAXPARA - 1)
+		{
+			if(*s == ':')
+				s++;
+			parv[++n] = s;
+			break;
+		}
 	}
-	else
-	{
-		int ii = 0;
 
-		if((s = strchr(ch, ' ')))
-			*s++ = '\0';
+	parv[n + 1] = NULL;
+	tok->parc = n + 1;
+}
+
+/* parse()
+ *
+ * given a raw buffer, parses it and generates parv, parc and sender
+ */
+void
+parse(struct Client *client_p, char *pbuffer, char *bufend)
+{
+	struct Client *from = client_p;
+	const char *para[MAXPARA + 2];
+	struct line_tokens tok;
+	char *end;
+	struct Message *mptr;
+
+	s_assert(MyConnect(client_p));
+	if(IsAnyDead(client_p))
+		return;
+
+	tokenize_line(pbuffer, bufend, para, &tok);
 
-		mptr = hash_find_data(HASH_COMMAND, ch);
+	if(tok.sender != NULL && *tok.sender && IsServer(client_p))
+	{
+		from = find_any_client(tok.sender);
 
-		/* no command or its encap only, error */
-		if(mptr == NULL || mptr->cmd == NULL)
+		/* didnt find any matching client, issue a kill */
+		if(from == NULL)
 		{
-			/*
-			 * Note: Give error message *only* to recognized
-			 * persons. It's a nightmare situation to have
-			 * two programs sending "Unknown command"'s or
-			 * equivalent to each other at full blast....
-			 * If it has got to person state, it at least
-			 * seems to be well behaving. Perhaps this message
-			 * should never be generated, though...	 --msa
-			 * Hm, when is the buffer empty -- if a command
-			 * code has been found ?? -Armin
-			 */
-			if(pbuffer[0] != '\0')
-			{
-				if(IsClient(from))
-					sendto_one_numeric(from, s_RPL(ERR_UNKNOWNCOMMAND), ch);
-			}
-			ServerStats.is_unco++;
+			ServerStats.is_unpf++;
+			remove_unknown(client_p, tok.sender, pbuffer);
 			return;
 		}
 
-		ii = bufend - ((s) ? s : ch);
-		mptr->bytes += ii;
+		/* fake direction, hmm. */
+		if(from->from != client_p)
+		{
+			ServerStats.is_wrdi++;
+			cancel_clients(client_p, from);
+			return;
+		}
 	}
 
-	end = bufend - 1;
+	para[0] = from->name;
 
-	/* XXX this should be done before parse() is called */
-	if(*end == '\n')
-		*end-- = '\0';
-	if(*end == '\r')
-		*end = '\0';
+	if(tok.cmd == NULL)
+	{
+		ServerStats.is_empt++;
+		return;
+	}
 
+	if(tok.numeric)
+	{
+		ServerStats.is_num++;
+		do_numeric(tok.cmd, client_p, from, tok.parc, para);
+		return;
+	}
 
-	/* ugh. so rb_string_to_array isn't brain damaged like the original one
-	 * however..so accomdate the old behavior, pass &para[1] 
-	 * and add + 1 to i...the rest of this mess can e fixed 
-	 */
-	if(s != NULL)
-		i = rb_string_to_array(s, &para[1], MAXPARA) + 1; 
+	mptr = find_command(tok.cmd, tok.cmdlen);
 
-	if(mptr == NULL)
+	/* no command or its encap only, error */
+	if(mptr == NULL || mptr->cmd == NULL)
 	{
-		do_numeric(numeric, client_p, from, i, para);
+		/*
+		 * Note: Give error message *only* to recognized
+		 * persons. It's a nightmare situation to have
+		 * two programs sending "Unknown command"'s or
+		 * equivalent to each other at full blast....
+		 * If it has got to person state, it at least
+		 * seems to be well behaving. Perhaps this message
+		 * should never be generated, though...	 --msa
+		 * Hm, when is the buffer empty -- if a command
+		 * code has been found ?? -Armin
+		 */
+		if(pbuffer[0] != '\0')
+		{
+			if(IsClient(from))
+				sendto_one_numeric(from, s_RPL(ERR_UNKNOWNCOMMAND), tok.cmd);
+		}
+		ServerStats.is_unco++;
 		return;
 	}
 
-	if(handle_command(mptr, client_p, from, i,	/* XXX discards const!!! */
-			  (const char **)(uintptr_t) para) < -1)
+	mptr->bytes += bufend - (tok.args != NULL ? tok.args : tok.cmd);
+
+	end = bufend - 1;
+
+	if(handle_command(mptr, client_p, from, tok.parc, para) < -1)
 	{
 		char *p;
 		for(p = pbuffer; p <= end; p += 8)
@@ -313,7 +376,7 @@ handle_encap(struct Client *client_p, struct Client *source_p, const char *comma
 
 	parv[0] = source_p->name;
 
-	mptr = hash_find_data(HASH_COMMAND, command);
+	mptr = find_command(command, strlen(command));
 
 	if(mptr == NULL || mptr->cmd == NULL)
 		return;
@@ -327,6 +390,268 @@ handle_encap(struct Client *client_p, struct Client *source_p, const char *comma
 	(*handler) (client_p, source_p, parc, parv);
 }
 
+/*
+ * HASH_COMMAND remains the list of loaded commands, but parse() looks
+ * commands up in a minimal perfect hash compiled from it each time a
+ * command is added or removed.  A name is packed, upper cased a word at
+ * a time, into a fixed size key, so a lookup is two hashes of the key and
+ * a single compare against the one slot the name can live in.  Commands
+ * longer than CMD_KEYLEN are left out of the table and found in
+ * HASH_COMMAND.
+ *
+ * The table is built hash-and-displace style: the names are spread over
+ * cmd_nbuckets buckets by cmd_hash(key, 0), and each bucket, largest
+ * first, is given the first seed that lands all of its names in slots
+ * that are still free.
+ */
+#define CMD_KEYLEN	16
+#define CMD_MAXSEED	(1 << 20)
+
+struct cmd_key
+{
+	uint64_t word[2];
+	uint64_t len;
+};
+
+struct cmd_slot
+{
+	struct cmd_key key;
+	struct Message *msg;
+};
+
+static struct cmd_slot *cmd_table;
+static uint32_t *cmd_seeds;
+static unsigned int cmd_count;
+static unsigned int cmd_nbuckets;
+
+static inline uint64_t
+cmd_load32(const unsigned char *s)
+{
+	uint32_t w;
+	memcpy(&w, s, sizeof(w));
+	return w;
+}
+
+/* cmd_pack()
+ *
+ * inputs	- command name and its length, key to fill in
+ * outputs	- 1 if the name fits in a key, 0 if it is too long
+ * side effects - key is filled in from the upper cased name
+ *
+ * Names of 8 bytes or more are taken as their first and last eight bytes,
+ * shorter ones likewise from overlapping four byte loads or single bytes,
+ * so no byte past the end of the name is read.  Together with the length
+ * that identifies the name exactly.
+ */
+static inline int
+cmd_pack(const char *name, size_t len, struct cmd_key *key)
+{
+	const unsigned char *s = (const unsigned char *)name;
+	uint64_t lo, hi = 0;
+
+	if(len > CMD_KEYLEN)
+		return 0;
+
+	if(len >= 8)
+	{
+		lo = irc_load_word(s);
+		hi = irc_load_word(s + len - 8);
+	}
+	else if(len >= 4)
+		lo = cmd_load32(s) | (cmd_load32(s + len - 4) << 32);
+	else if(len > 0)
+		lo = s[0] | (s[len / 2] << 8) | (s[len - 1] << 16);
+	else
+		lo = 0;
+
+	key->word[0] = irc_toupper_word(lo);
+	key->word[1] = irc_toupper_word(hi);
+	key->len = len;
+	return 1;
+}
+
+static inline uint32_t
+cmd_hash(const struct cmd_key *key, uint32_t seed)
+{
+	uint64_t h;
+
+	h = (key->word[0] ^ seed ^ (key->len << 32)) * 0x9E3779B97F4A7C15ULL;
+	h = (h ^ (h >> 29) ^ key->word[1]) * 0xBF58476D1CE4E5B9ULL;
+	return (uint32_t)(h >> 32);
+}
+
+/* maps a hash onto 0..n-1 without a division */
+static inline unsigned int
+cmd_reduce(uint32_t h, unsigned int n)
+{
+	return (unsigned int)(((uint64_t)h * n) >> 32);
+}
+
+/* find_command()
+ *
+ * inputs	- command name, as sent, and its length
+ * outputs	- its struct Message, or NULL if there is no such command
+ * side effects -
+ */
+static struct Message *
+find_command(const char *name, size_t len)
+{
+	struct cmd_key key;
+	struct cmd_slot *slot;
+	uint32_t seed;
+
+	if(cmd_count == 0 || !cmd_pack(name, len, &key))
+		return hash_find_data(HASH_COMMAND, name);
+
+	seed = cmd_seeds[cmd_hash(&key, 0) & (cmd_nbuckets - 1)];
+	slot = &cmd_table[cmd_reduce(cmd_hash(&key, seed), cmd_count)];
+
+	if(((slot->key.word[0] ^ key.word[0]) | (slot->key.word[1] ^ key.word[1]) |
+	    (slot->key.len ^ key.len)) != 0)
+		return NULL;
+
+	return slot->msg;
+}
+
+struct cmd_build
+{
+	struct cmd_slot *keys;
+	unsigned int count;
+};
+
+static void
+cmd_collect_cb(void *data, void *walk_data)
+{
+	struct Message *msg = data;
+	struct cmd_build *build = walk_data;
+
+	if(cmd_pack(msg->cmd, strlen(msg->cmd), &build->keys[build->count].key))
+		build->keys[build->count++].msg = msg;
+}
+
+/* build_command_table()
+ *
+ * inputs	-
+ * outputs	-
+ * side effects - the perfect hash is rebuilt from HASH_COMMAND.  If no
+ *		  seed can be found for some bucket the table is left
+ *		  empty and find_command() uses HASH_COMMAND instead.
+ */
+static void
+build_command_table(void)
+{
+	struct cmd_build build;
+	unsigned int *bucket, *order, *size;
+	unsigned char *used;
+	size_t memusage, entries;
+	unsigned int i, j, k, b;
+
+	rb_free(cmd_table);
+	rb_free(cmd_seeds);
+	cmd_table = NULL;
+	cmd_seeds = NULL;
+	cmd_count = 0;
+
+	hash_get_memusage(HASH_COMMAND, &entries, &memusage);
+	if(entries == 0)
+		return;
+
+	build.keys = rb_malloc(sizeof(struct cmd_slot) * entries);
+	build.count = 0;
+	hash_walkall(HASH_COMMAND, cmd_collect_cb, &build);
+
+	if(build.count == 0)
+	{
+		rb_free(build.keys);
+		return;
+	}
+
+	for(cmd_nbuckets = 1; cmd_nbuckets * 2 < build.count; cmd_nbuckets <<= 1)
+		;
+
+	bucket = rb_malloc(sizeof(unsigned int) * build.count);
+	size = rb_malloc(sizeof(unsigned int) * cmd_nbuckets);
+	order = rb_malloc(sizeof(unsigned int) * cmd_nbuckets);
+	used = rb_malloc(build.count);
+	cmd_seeds = rb_malloc(sizeof(uint32_t) * cmd_nbuckets);
+	cmd_table = rb_malloc(sizeof(struct cmd_slot) * build.count);
+
+	for(i = 0; i < build.count; i++)
+	{
+		bucket[i] = cmd_hash(&build.keys[i].key, 0) & (cmd_nbuckets - 1);
+		size[bucket[i]]++;
+	}
+
+	/* largest buckets first, while there is the most room */
+	for(i = 0; i < cmd_nbuckets; i++)
+	{
+		for(j = i; j > 0 && size[order[j - 1]] < size[i]; j--)
+			order[j] = order[j - 1];
+		order[j] = i;
+	}
+
+	for(i = 0; i < cmd_nbuckets && size[order[i]] > 0; i++)
+	{
+		uint32_t seed;
+
+		b = order[i];
+
+		for(seed = 1; seed < CMD_MAXSEED; seed++)
+		{
+			/* try the seed, backing out on the first clash */
+			for(j = 0; j < build.count; j++)
+			{
+				if(bucket[j] != b)
+					continue;
+
+				k = cmd_reduce(cmd_hash(&build.keys[j].key, seed), build.count);
+				if(used[k])
+					break;
+				used[k] = 1;
+			}
+
+			if(j == build.count)
+				break;
+
+			while(j-- > 0)
+			{
+				if(bucket[j] == b)
+					used[cmd_reduce(cmd_hash(&build.keys[j].key, seed), build.count)] = 0;
+			}
+		}
+
+		if(seed == CMD_MAXSEED)
+			break;
+
+		cmd_seeds[b] = seed;
+	}
+
+	if(i < cmd_nbuckets && size[order[i]] > 0)
+	{
+		ilog(L_MAIN, "Unable to build the command table, using the command hash");
+		rb_free(cmd_table);
+		rb_free(cmd_seeds);
+		cmd_table = NULL;
+		cmd_seeds = NULL;
+	}
+	else
+	{
+		cmd_count = build.count;
+
+		for(i = 0; i < build.count; i++)
+		{
+			k = cmd_reduce(cmd_hash(&build.keys[i].key, cmd_seeds[bucket[i]]), cmd_count);
+			cmd_table[k] = build.keys[i];
+		}
+	}
+
+	rb_free(build.keys);
+	rb_free(bucket);
+	rb_free(size);
+	rb_free(order);
+	rb_free(used);
+}
+
 /* mod_add_cmd
  *
  * inputs	- command name
@@ -347,6 +672,7 @@ mod_add_cmd(struct Message *msg)
 		return;
 	
 	hash_add(HASH_COMMAND, msg->cmd, msg);
+	build_command_table();
 	msg->count = 0;
 	msg->rcount = 0;
 	msg->bytes = 0;
@@ -366,8 +692,10 @@ mod_del_cmd(struct Message *msg)
 	hnode = hash_find(HASH_COMMAND, msg->cmd);
 
 	if(hnode != NULL)
+	{
 		hash_del_hnode(HASH_COMMAND, hnode);
-	return;
+		build_command_table();
+	}
 }
 
 /* cancel_clients()
@@ -444,7 +772,7 @@ remove_unknown(struct Client *client_p, char *lsender, char *lbuffer)
  *	a ping pong error message...
  */
 static void
-do_numeric(char numeric[], struct Client *client_p, struct Client *source_p, int parc, char *parv[])
+do_numeric(char numeric[], struct Client *client_p, struct Client *source_p, int parc, const char *parv[])
 {
 	struct Client *target_p;
 	struct Channel *chptr;
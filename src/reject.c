@@ -35,21 +35,26 @@
 #include <parse.h>
 #include <hostmask.h>
 #include <match.h>
+#include <hash.h>
 
 static rb_patricia_tree_t *global_tree;
-static rb_patricia_tree_t *reject_tree;
 static rb_patricia_tree_t *dline_tree;
 static rb_patricia_tree_t *eline_tree;
 static rb_dlink_list delay_exit_list;
 static rb_dlink_list reject_list;
 static rb_dlink_list throttle_list;
-static rb_patricia_tree_t *throttle_tree;
 static void throttle_expires(void *unused);
 
-
+/*
+ * The reject and throttle caches are HASH_REJECT and HASH_THROTTLE, keyed
+ * by the raw address.  reject_list and throttle_list hold the same entries
+ * most recently seen first, so expiry only ever looks at the tail, and
+ * when a cache is full the tail is what gets dropped.
+ */
 typedef struct _reject_data
 {
 	rb_dlink_node rnode;
+	hash_node *hnode;
 	time_t time;
 	unsigned int count;
 } reject_t;
@@ -65,6 +70,7 @@ typedef struct _delay_data
 typedef struct _throttle
 {
 	rb_dlink_node node;
+	hash_node *hnode;
 	time_t last;
 	int count;
 } throttle_t;
@@ -159,32 +165,55 @@ delay_exit(void *unused)
 	}
 }
 
+/* ip_key()
+ *
+ * inputs	- address, where to store the key length
+ * outputs	- the raw address bytes to use as a cache key
+ * side effects -
+ */
+static const void *
+ip_key(struct sockaddr *addr, size_t *len)
+{
+#ifdef RB_IPV6
+	if(GET_SS_FAMILY(addr) == AF_INET6)
+	{
+		*len = sizeof(struct in6_addr);
+		return &((struct sockaddr_in6 *)addr)->sin6_addr;
+	}
+#endif
+	*len = sizeof(struct in_addr);
+	return &((struct sockaddr_in *)addr)->sin_addr;
+}
+
+static void
+del_reject(reject_t *rdata)
+{
+	hash_del_hnode(HASH_REJECT, rdata->hnode);
+	rb_dlinkDelete(&rdata->rnode, &reject_list);
+	rb_free(rdata);
+}
+
 static void
 reject_expires(void *unused)
 {
-	rb_dlink_node *ptr, *next;
+	reject_t *rdata;
 
-	RB_DLINK_FOREACH_SAFE(ptr, next, reject_list.head)
+	while(reject_list.tail != NULL)
 	{
-		rb_patricia_node_t *pnode = ptr->data;
-		reject_t *rdata = pnode->data;
+		rdata = reject_list.tail->data;
 
 		if(rdata->time + ConfigFileEntry.reject_duration > rb_current_time())
-			continue;
+			break;
 
-		rb_dlinkDelete(ptr, &reject_list);
-		rb_free(rdata);
-		rb_patricia_remove(reject_tree, pnode);
+		del_reject(rdata);
 	}
 }
 
 void
 init_reject(void)
 {
-	reject_tree = rb_new_patricia(PATRICIA_BITS);
 	dline_tree = rb_new_patricia(PATRICIA_BITS);
 	eline_tree = rb_new_patricia(PATRICIA_BITS);
-	throttle_tree = rb_new_patricia(PATRICIA_BITS);
 	global_tree = rb_new_patricia(PATRICIA_BITS);
 
 	rb_event_add("delay_exit", delay_exit, NULL, 2);
@@ -196,29 +225,29 @@ init_reject(void)
 void
 add_reject(struct Client *client_p)
 {
-	rb_patricia_node_t *pnode;
 	reject_t *rdata;
+	const void *key;
+	size_t keylen;
 
 	/* Reject is disabled */
 	if(ConfigFileEntry.reject_after_count == 0 || ConfigFileEntry.reject_duration == 0)
 		return;
 
-	if((pnode = rb_match_ip(reject_tree, (struct sockaddr *)&client_p->localClient->ip)) != NULL)
+	key = ip_key((struct sockaddr *)&client_p->localClient->ip, &keylen);
+	if((rdata = hash_find_data_len(HASH_REJECT, key, keylen)) != NULL)
 	{
-		rdata = pnode->data;
 		rdata->time = rb_current_time();
 		rdata->count++;
+		rb_dlinkMoveNode(&rdata->rnode, &reject_list, &reject_list);
 	}
 	else
 	{
-		int bitlen = 32;
-#ifdef RB_IPV6
-		if(GET_SS_FAMILY(&client_p->localClient->ip) == AF_INET6)
-			bitlen = 128;
-#endif
-		pnode = rb_make_and_lookup_ip(reject_tree, (struct sockaddr *)&client_p->localClient->ip, bitlen);
-		pnode->data = rdata = rb_malloc(sizeof(reject_t));
-		rb_dlinkAddTail(pnode, &rdata->rnode, &reject_list);
+		if(rb_dlink_list_length(&reject_list) >= REJECT_CACHE_MAX)
+			del_reject(reject_list.tail->data);
+
+		rdata = rb_malloc(sizeof(reject_t));
+		rdata->hnode = hash_add_len(HASH_REJECT, key, keylen, rdata);
+		rb_dlinkAdd(rdata, &rdata->rnode, &reject_list);
 		rdata->time = rb_current_time();
 		rdata->count = 1;
 	}
@@ -228,18 +257,20 @@ add_reject(struct Client *client_p)
 int
 check_reject(rb_fde_t * F, struct sockaddr *addr)
 {
-	rb_patricia_node_t *pnode;
 	reject_t *rdata;
+	const void *key;
+	size_t keylen;
+
 	/* Reject is disabled */
 	if(ConfigFileEntry.reject_after_count == 0 || ConfigFileEntry.reject_duration == 0)
 		return 0;
 
-	pnode = rb_match_ip(reject_tree, addr);
-	if(pnode != NULL)
+	key = ip_key(addr, &keylen);
+	rdata = hash_find_data_len(HASH_REJECT, key, keylen);
+	if(rdata != NULL)
 	{
-		rdata = pnode->data;
-
 		rdata->time = rb_current_time();
+		rb_dlinkMoveNode(&rdata->rnode, &reject_list, &reject_list);
 		if(rdata->count > (unsigned long)ConfigFileEntry.reject_after_count)
 		{
 			add_delay_exit(F, "Closing Link: (*** Banned (cache))");
@@ -254,33 +285,29 @@ check_reject(rb_fde_t * F, struct sockaddr *addr)
 void
 flush_reject(void)
 {
-	rb_dlink_node *ptr, *next;
-
-	RB_DLINK_FOREACH_SAFE(ptr, next, reject_list.head)
-	{
-		rb_patricia_node_t *pnode = ptr->data;
-		reject_t *rdata = pnode->data;
-		rb_dlinkDelete(ptr, &reject_list);
-		rb_free(rdata);
-		rb_patricia_remove(reject_tree, pnode);
-	}
+	while(reject_list.head != NULL)
+		del_reject(reject_list.head->data);
 }
 
 int
 remove_reject(const char *ip)
 {
-	rb_patricia_node_t *pnode;
+	struct rb_sockaddr_storage addr;
+	reject_t *rdata;
+	const void *key;
+	size_t keylen;
 
 	/* Reject is disabled */
 	if(ConfigFileEntry.reject_after_count == 0 || ConfigFileEntry.reject_duration == 0)
 		return -1;
 
-	if((pnode = rb_match_string(reject_tree, ip)) != NULL)
+	if(!rb_inet_pton_sock(ip, (struct sockaddr *)&addr))
+		return 0;
+
+	key = ip_key((struct sockaddr *)&addr, &keylen);
+	if((rdata = hash_find_data_len(HASH_REJECT, key, keylen)) != NULL)
 	{
-		reject_t *rdata = pnode->data;
-		rb_dlinkDelete(&rdata->rnode, &reject_list);
-		rb_free(rdata);
-		rb_patricia_remove(reject_tree, pnode);
+		del_reject(rdata);
 		return 1;
 	}
 	return 0;
@@ -455,8 +482,7 @@ throttle_size(void)
 
 	RB_DLINK_FOREACH(ptr, throttle_list.head)
 	{
-		rb_patricia_node_t *pnode = ptr->data;
-		throttle_t *t = pnode->data;
+		throttle_t *t = ptr->data;
 		if(t->count > ConfigFileEntry.throttle_count)
 			count++;
 	}
@@ -464,16 +490,25 @@ throttle_size(void)
 	return count;
 }
 
+static void
+del_throttle(throttle_t *t)
+{
+	hash_del_hnode(HASH_THROTTLE, t->hnode);
+	rb_dlinkDelete(&t->node, &throttle_list);
+	rb_free(t);
+}
+
 int
 throttle_add(struct sockaddr *addr)
 {
 	throttle_t *t;
-	rb_patricia_node_t *pnode;
+	const void *key;
+	size_t keylen;
 	char sockhost[HOSTIPLEN + 1];
-	if((pnode = rb_match_ip(throttle_tree, addr)) != NULL)
-	{
-		t = pnode->data;
 
+	key = ip_key(addr, &keylen);
+	if((t = hash_find_data_len(HASH_THROTTLE, key, keylen)) != NULL)
+	{
 		if(t->count > ConfigFileEntry.throttle_count)
 		{
 			if(t->count == ConfigFileEntry.throttle_count + 1)
@@ -488,20 +523,18 @@ throttle_add(struct sockaddr *addr)
 		/* Stop penalizing them after they've been throttled */
 		t->last = rb_current_time();
 		t->count++;
+		rb_dlinkMoveNode(&t->node, &throttle_list, &throttle_list);
 	}
 	else
 	{
-		int bitlen = 32;
-#ifdef RB_IPV6
-		if(GET_SS_FAMILY(addr) == AF_INET6)
-			bitlen = 128;
-#endif
+		if(rb_dlink_list_length(&throttle_list) >= THROTTLE_CACHE_MAX)
+			del_throttle(throttle_list.tail->data);
+
 		t = rb_malloc(sizeof(throttle_t));
 		t->last = rb_current_time();
 		t->count = 1;
-		pnode = rb_make_and_lookup_ip(throttle_tree, addr, bitlen);
-		pnode->data = t;
-		rb_dlinkAdd(pnode, &t->node, &throttle_list);
+		t->hnode = hash_add_len(HASH_THROTTLE, key, keylen, t);
+		rb_dlinkAdd(t, &t->node, &throttle_list);
 	}
 	return 0;
 }
@@ -509,19 +542,16 @@ throttle_add(struct sockaddr *addr)
 static void
 throttle_expires(void *unused)
 {
-	rb_dlink_node *ptr, *next;
+	throttle_t *t;
 
-	RB_DLINK_FOREACH_SAFE(ptr, next, throttle_list.head)
+	while(throttle_list.tail != NULL)
 	{
-		rb_patricia_node_t *pnode = ptr->data;
-		throttle_t *t = pnode->data;
+		t = throttle_list.tail->data;
 
 		if(t->last + ConfigFileEntry.throttle_duration > rb_current_time())
-			continue;
+			break;
 
-		rb_dlinkDelete(ptr, &throttle_list);
-		rb_free(t);
-		rb_patricia_remove(throttle_tree, pnode);
+		del_throttle(t);
 	}
 }
 
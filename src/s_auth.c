@@ -205,7 +205,7 @@ release_auth_client(struct AuthRequest *auth)
 	 * us. This is what read_packet() does.
 	 *     -- adrian
 	 */
-	client->localClient->allow_read = MAX_FLOOD;
+	LocalAllowRead(client) = MAX_FLOOD;
 	rb_dlinkAddTail(client, &client->node, &global_client_list);
 	read_packet(client->localClient->F, client);
 }
@@ -226,7 +226,7 @@ auth_dns_callback(const char *res, int status, int aftype, void *data)
 
 	if(status == 1 && strlen(res) < HOSTLEN)
 	{
-		rb_strlcpy(auth->client->host, res, sizeof(auth->client->host));
+		set_client_host(auth->client, res);
 		sendheader(auth->client, REPORT_FIN_DNS);
 	}
 	else
@@ -489,7 +489,7 @@ timeout_auth_queries_event(void *notused)
 			        sendheader(auth->client, REPORT_FIN_RBL);
 			}
 
-			auth->client->localClient->lasttime = rb_current_time();
+			LocalLastTime(auth->client) = rb_current_time();
 			release_auth_client(auth);
 		}
 	}
@@ -503,6 +503,7 @@ read_auth(rb_fde_t * F, void *data)
 	struct AuthRequest *auth = data;
 	char *s = NULL, *t;
 	char buf[AUTH_BUFSIZ + 1];
+	char username[USERLEN + 1];
 	int len, count;
 
 	len = rb_read(auth->authF, buf, AUTH_BUFSIZ);
@@ -518,7 +519,7 @@ read_auth(rb_fde_t * F, void *data)
 		buf[len] = '\0';
 		if((s = get_valid_ident(buf)))
 		{
-			t = auth->client->username;
+			t = username;
 			while(*s == '~' || *s == '^')
 				s++;
 			for(count = USERLEN; *s && count; s++)
@@ -532,6 +533,7 @@ read_auth(rb_fde_t * F, void *data)
 				}
 			}
 			*t = '\0';
+			set_client_username(auth->client, username);
 		}
 	}
 
@@ -542,7 +544,7 @@ read_auth(rb_fde_t * F, void *data)
 	if(s == NULL)
 	{
 		++ServerStats.is_abad;
-		rb_strlcpy(auth->client->username, "unknown", sizeof(auth->client->username));
+		set_client_username(auth->client, "unknown");
 		sendheader(auth->client, REPORT_FAIL_ID);
 	}
 	else
@@ -146,6 +146,8 @@ free_conf(struct ConfItem *aconf)
 	rb_free(aconf->user);
 	rb_free(aconf->host);
 	rb_free(aconf->certfp);
+	free_compiled_mask(aconf->host_mask);
+	free_compiled_mask(aconf->user_mask);
 
 	if(IsConfBan(aconf))
 		operhash_delete(aconf->info.oper);
@@ -355,12 +357,12 @@ verify_access(struct Client *client_p, const char *username)
 				char *host = p + 1;
 				*p = '\0';
 
-				rb_strlcpy(client_p->username, aconf->info.name, sizeof(client_p->username));
-				rb_strlcpy(client_p->host, host, sizeof(client_p->host));
+				set_client_username(client_p, aconf->info.name);
+				set_client_host(client_p, host);
 				*p = '@';
 			}
 			else
-				rb_strlcpy(client_p->host, aconf->info.name, sizeof(client_p->host));
+				set_client_host(client_p, aconf->info.name);
 		}
 		return (attach_iline(client_p, aconf));
 	}
@@ -620,6 +622,25 @@ attach_conf(struct Client *client_p, struct ConfItem *aconf)
 	return (0);
 }
 
+/*
+ * conf_lap_usec
+ *
+ * inputs	- timeval the current phase started at
+ * outputs	- microseconds spent since then
+ * side effects - start is moved on to now, ready for the next phase
+ */
+unsigned long
+conf_lap_usec(struct timeval *start)
+{
+	struct timeval now;
+	long usec;
+
+	rb_gettimeofday(&now, NULL);
+	usec = (now.tv_sec - start->tv_sec) * 1000000L + (now.tv_usec - start->tv_usec);
+	*start = now;
+	return usec > 0 ? (unsigned long)usec : 0;
+}
+
 /*
  * rehash
  *
@@ -631,6 +652,8 @@ void
 rehash(int sig)
 {
 	const char *filename;
+	struct timeval lap;
+	unsigned long parse_usec, check_usec, clear_usec, load_usec;
 	int r;
 	int old_global_ipv4_cidr = ConfigFileEntry.global_cidr_ipv4_bitlen;
 	int old_global_ipv6_cidr = ConfigFileEntry.global_cidr_ipv6_bitlen;
@@ -643,7 +666,9 @@ rehash(int sig)
 
 	filename = ConfigFileEntry.configfile;
 
+	rb_gettimeofday(&lap, NULL);
 	r = read_config_file(filename);
+	parse_usec = conf_lap_usec(&lap);
 
 	if(r > 0)
 	{
@@ -653,6 +678,7 @@ rehash(int sig)
 	}
 
 	r = check_valid_entries();
+	check_usec = conf_lap_usec(&lap);
 
 	if(r > 0)
 	{
@@ -664,12 +690,22 @@ rehash(int sig)
 	}
 
 	clear_out_old_conf();
+	clear_usec = conf_lap_usec(&lap);
 	load_conf_settings();
+	load_usec = conf_lap_usec(&lap);
+
+	ilog(L_MAIN, "Rehash of %s took %lu us (parse %lu, check %lu, clear %lu, load %lu)",
+	     filename, parse_usec + check_usec + clear_usec + load_usec,
+	     parse_usec, check_usec, clear_usec, load_usec);
+	sendto_realops_flags(UMODE_DEBUG, L_ALL,
+			     "Rehash of %s took %lu us (parse %lu, check %lu, clear %lu, load %lu)",
+			     filename, parse_usec + check_usec + clear_usec + load_usec,
+			     parse_usec, check_usec, clear_usec, load_usec);
 
 	if(ServerInfo.description != NULL)
-		rb_strlcpy(me.info, ServerInfo.description, sizeof(me.info));
+		set_client_info(&me, ServerInfo.description);
 	else
-		rb_strlcpy(me.info, "unknown", sizeof(me.info));
+		set_client_info(&me, "unknown");
 
 	if(ServerInfo.bandb_path == NULL)
 		ServerInfo.bandb_path = rb_strdup(DBPATH);
@@ -787,6 +823,9 @@ set_default_conf(void)
 	ConfigFileEntry.fname_klinelog = NULL;
 	ConfigFileEntry.fname_operspylog = NULL;
 	ConfigFileEntry.fname_ioerrorlog = NULL;
+	ConfigFileEntry.log_threaded = YES;
+	ConfigFileEntry.log_buffer_lines = 4096;
+	ConfigFileEntry.log_overflow_block = NO;
 	ConfigFileEntry.motd_path = rb_strdup(MPATH);
 	ConfigFileEntry.oper_motd_path = rb_strdup(OPATH);
 	ConfigFileEntry.glines = NO;
@@ -1174,8 +1213,8 @@ clear_out_old_conf(void)
 		MaxUsers(cltmp) = -1;
 	}
 
-	remove_exempts();
-	clear_out_address_conf();
+	/* auth{} and exempt{} are only cleared if they changed */
+	clear_changed_confs();
 	clear_s_newconf();
 
 	/* clean out module paths */
@@ -41,38 +41,384 @@
 #include <match.h>
 #include <ircd.h>
 
-static FILE *log_main;
-static FILE *log_user;
-static FILE *log_fuser;
-static FILE *log_oper;
-static FILE *log_foper;
-static FILE *log_server;
-static FILE *log_kill;
-static FILE *log_gline;
-static FILE *log_kline;
-static FILE *log_operspy;
-static FILE *log_ioerror;
+#ifdef USE_THREADED_LOG
+#include <pthread.h>
+#include <signal.h>
+#include <sys/uio.h>
+#endif
+
+/* with the writer thread running, fd and error are shared with it and
+ * only ever touched through these
+ */
+#ifdef USE_THREADED_LOG
+#define log_load(x)	__atomic_load_n(&(x), __ATOMIC_SEQ_CST)
+#define log_store(x, v)	__atomic_store_n(&(x), (v), __ATOMIC_SEQ_CST)
+#else
+#define log_load(x)	(x)
+#define log_store(x, v)	((x) = (v))
+#endif
 
 struct log_struct
 {
 	char **name;
-	FILE **logfile;
+	int fd;
+	int error;		/* errno of a failed write, set by the writer */
 };
 
 static struct log_struct log_table[LAST_LOGFILE] = {
-	{NULL, &log_main},
-	{&ConfigFileEntry.fname_userlog, &log_user},
-	{&ConfigFileEntry.fname_fuserlog, &log_fuser},
-	{&ConfigFileEntry.fname_operlog, &log_oper},
-	{&ConfigFileEntry.fname_foperlog, &log_foper},
-	{&ConfigFileEntry.fname_serverlog, &log_server},
-	{&ConfigFileEntry.fname_killlog, &log_kill},
-	{&ConfigFileEntry.fname_klinelog, &log_kline},
-	{&ConfigFileEntry.fname_glinelog, &log_gline},
-	{&ConfigFileEntry.fname_operspylog, &log_operspy},
-	{&ConfigFileEntry.fname_ioerrorlog, &log_ioerror}
+	{NULL, -1, 0},
+	{&ConfigFileEntry.fname_userlog, -1, 0},
+	{&ConfigFileEntry.fname_fuserlog, -1, 0},
+	{&ConfigFileEntry.fname_operlog, -1, 0},
+	{&ConfigFileEntry.fname_foperlog, -1, 0},
+	{&ConfigFileEntry.fname_serverlog, -1, 0},
+	{&ConfigFileEntry.fname_killlog, -1, 0},
+	{&ConfigFileEntry.fname_klinelog, -1, 0},
+	{&ConfigFileEntry.fname_glinelog, -1, 0},
+	{&ConfigFileEntry.fname_operspylog, -1, 0},
+	{&ConfigFileEntry.fname_ioerrorlog, -1, 0}
+};
+
+static unsigned long log_dropped;	/* lines lost to a full buffer, ever */
+static unsigned long log_dropped_unreported;
+
+#ifdef USE_THREADED_LOG
+/*
+ * The threaded log writer.
+ *
+ * ilog() formats each line straight into a slot of a preallocated ring,
+ * and a single writer thread drains the ring with writev(), so a slow
+ * disk only ever stalls the writer and never the event loop.  There is
+ * exactly one producer (the main thread) and one consumer (the writer),
+ * so the ring indices are handed across with plain atomic loads and
+ * stores; the mutex and condition variables are only used to put either
+ * side to sleep when there is nothing for it to do.
+ *
+ * The indices are free running and masked on use, the ring size is
+ * always a power of two.
+ */
+#define LOG_RING_MIN	64
+#define LOG_RING_MAX	65536
+#define LOG_IOV_MAX	64
+
+struct log_line
+{
+	ilogfile dest;
+	unsigned int len;
+	char buf[IRCD_BUFSIZE];
 };
 
+static struct log_line *log_ring;
+static unsigned int log_ring_size;
+static unsigned int log_ring_head;	/* next slot to fill, only moved by ilog() */
+static unsigned int log_ring_tail;	/* next slot to write, only moved by the writer */
+static unsigned long log_written;
+
+static int log_writer_idle;
+static int log_writer_quit;
+static int log_producer_waiting;
+static bool log_writer_running;
+static bool log_flush_registered;
+
+static pthread_t log_writer_thread;
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_wakeup = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t log_space = PTHREAD_COND_INITIALIZER;
+
+static void
+log_writev(ilogfile dest, struct iovec *iov, int cnt)
+{
+	struct log_struct *log = &log_table[dest];
+	ssize_t len;
+	int fd, error;
+
+	if((fd = log_load(log->fd)) < 0)
+		return;
+
+	while(cnt > 0)
+	{
+		len = writev(fd, iov, cnt);
+		if(len < 0)
+		{
+			if(errno == EINTR)
+				continue;
+
+			/* the main thread never closes an fd while we are
+			 * running, as it could be reused under us, so close
+			 * it here and leave check_logfiles() to tell opers
+			 */
+			error = errno;
+			log_store(log->fd, -1);
+			close(fd);
+			log_store(log->error, error);
+			return;
+		}
+
+		/* short write, skip past what made it out and go again */
+		while(cnt > 0 && (size_t)len >= iov->iov_len)
+		{
+			len -= iov->iov_len;
+			iov++;
+			cnt--;
+		}
+		if(cnt > 0)
+		{
+			iov->iov_base = (char *)iov->iov_base + len;
+			iov->iov_len -= len;
+		}
+	}
+}
+
+static void *
+log_writer(void *unused)
+{
+	struct iovec iov[LOG_IOV_MAX];
+	struct log_line *line;
+	unsigned int mask = log_ring_size - 1;
+	unsigned int head, tail;
+	ilogfile dest;
+	int cnt;
+
+	tail = log_ring_tail;
+
+	for(;;)
+	{
+		head = log_load(log_ring_head);
+
+		if(head == tail)
+		{
+			pthread_mutex_lock(&log_lock);
+			log_store(log_writer_idle, 1);
+
+			/* anyone waiting for the ring to drain can go now */
+			pthread_cond_broadcast(&log_space);
+
+			while(tail == log_load(log_ring_head) && !log_writer_quit)
+				pthread_cond_wait(&log_wakeup, &log_lock);
+
+			log_store(log_writer_idle, 0);
+
+			if(log_writer_quit && tail == log_load(log_ring_head))
+			{
+				pthread_mutex_unlock(&log_lock);
+				return NULL;
+			}
+			pthread_mutex_unlock(&log_lock);
+			continue;
+		}
+
+		/* batch up runs of lines headed for the same file */
+		while(tail != head)
+		{
+			dest = log_ring[tail & mask].dest;
+
+			for(cnt = 0; cnt < LOG_IOV_MAX && tail + cnt != head; cnt++)
+			{
+				line = &log_ring[(tail + cnt) & mask];
+				if(line->dest != dest)
+					break;
+
+				iov[cnt].iov_base = line->buf;
+				iov[cnt].iov_len = line->len;
+			}
+
+			log_writev(dest, iov, cnt);
+
+			tail += cnt;
+			log_store(log_written, log_written + cnt);
+			log_store(log_ring_tail, tail);
+		}
+
+		if(log_load(log_producer_waiting))
+		{
+			pthread_mutex_lock(&log_lock);
+			pthread_cond_broadcast(&log_space);
+			pthread_mutex_unlock(&log_lock);
+		}
+	}
+}
+
+/* log_wait()
+ *
+ * inputs	- whether to wait for the ring to empty completely
+ * outputs	-
+ * side effects - blocks the main thread until the writer has made room
+ */
+static void
+log_wait(bool drain)
+{
+	pthread_mutex_lock(&log_lock);
+	log_store(log_producer_waiting, 1);
+
+	for(;;)
+	{
+		unsigned int used = log_ring_head - log_load(log_ring_tail);
+
+		if(drain ? used == 0 : used < log_ring_size)
+			break;
+
+		pthread_cond_wait(&log_space, &log_lock);
+	}
+
+	log_store(log_producer_waiting, 0);
+	pthread_mutex_unlock(&log_lock);
+}
+
+static void
+start_log_writer(void)
+{
+	unsigned int size = LOG_RING_MIN;
+	sigset_t sigs, oldsigs;
+
+	if(log_writer_running || !ConfigFileEntry.log_threaded)
+		return;
+
+	while(size < (unsigned int)ConfigFileEntry.log_buffer_lines && size < LOG_RING_MAX)
+		size <<= 1;
+
+	log_ring = rb_malloc(sizeof(struct log_line) * size);
+	log_ring_size = size;
+	log_ring_head = log_ring_tail = 0;
+	log_writer_idle = log_writer_quit = log_producer_waiting = 0;
+
+	/* signals are for the event loop, keep the writer out of the way */
+	sigfillset(&sigs);
+	pthread_sigmask(SIG_SETMASK, &sigs, &oldsigs);
+
+	if(pthread_create(&log_writer_thread, NULL, log_writer, NULL) != 0)
+	{
+		pthread_sigmask(SIG_SETMASK, &oldsigs, NULL);
+		rb_free(log_ring);
+		log_ring = NULL;
+		ilog(L_MAIN, "Unable to start log writer thread, logging synchronously");
+		return;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &oldsigs, NULL);
+	log_writer_running = true;
+
+	/* so whatever is queued still makes it out on exit() */
+	if(!log_flush_registered)
+	{
+		atexit(flush_logfiles);
+		log_flush_registered = true;
+	}
+}
+
+static void
+stop_log_writer(void)
+{
+	if(!log_writer_running)
+		return;
+
+	pthread_mutex_lock(&log_lock);
+	log_writer_quit = 1;
+	pthread_cond_signal(&log_wakeup);
+	pthread_mutex_unlock(&log_lock);
+
+	/* the writer empties the ring before it goes */
+	pthread_join(log_writer_thread, NULL);
+
+	log_writer_running = false;
+	rb_free(log_ring);
+	log_ring = NULL;
+	log_ring_size = 0;
+}
+
+/* log_enqueue()
+ *
+ * inputs	- log to write to, preformatted line
+ * outputs	- true if the line was handed to the writer
+ * side effects - line is copied into the ring, or counted as dropped
+ */
+static bool
+log_enqueue(ilogfile dest, const char *buf, size_t len)
+{
+	struct log_line *line;
+
+	if(!log_writer_running)
+		return false;
+
+	if(log_ring_head - log_load(log_ring_tail) >= log_ring_size)
+	{
+		if(!ConfigFileEntry.log_overflow_block)
+		{
+			log_dropped++;
+			log_dropped_unreported++;
+			return true;
+		}
+		log_wait(false);
+	}
+
+	line = &log_ring[log_ring_head & (log_ring_size - 1)];
+	line->dest = dest;
+	line->len = len;
+	memcpy(line->buf, buf, len);
+
+	log_store(log_ring_head, log_ring_head + 1);
+
+	if(log_load(log_writer_idle))
+	{
+		pthread_mutex_lock(&log_lock);
+		pthread_cond_signal(&log_wakeup);
+		pthread_mutex_unlock(&log_lock);
+	}
+	return true;
+}
+#endif /* USE_THREADED_LOG */
+
+/* only called with the writer thread stopped, or from ilog() when it
+ * isn't running
+ */
+static void
+close_log(ilogfile dest)
+{
+	if(log_table[dest].fd >= 0)
+		close(log_table[dest].fd);
+	log_store(log_table[dest].fd, -1);
+	log_store(log_table[dest].error, 0);
+}
+
+static int
+open_log(const char *filename)
+{
+	return open(filename, O_WRONLY | O_APPEND | O_CREAT, 0666);
+}
+
+/* check_logfiles()
+ *
+ * Runs from the event loop to tell opers about writes that failed in the
+ * writer thread, and about lines dropped because the buffer was full.
+ * The writer has already closed the file by the time error is set.
+ */
+static void
+check_logfiles(void *unused)
+{
+	unsigned long dropped;
+	int i, error;
+
+	for(i = 0; i < LAST_LOGFILE; i++)
+	{
+		error = log_load(log_table[i].error);
+		if(error == 0)
+			continue;
+
+		log_store(log_table[i].error, 0);
+		sendto_realops_flags(UMODE_ALL, L_ALL, "Closing logfile: %s (%s)",
+				     log_table[i].name != NULL ? *log_table[i].name : "main",
+				     strerror(error));
+	}
+
+	if(log_dropped_unreported > 0)
+	{
+		dropped = log_dropped_unreported;
+		log_dropped_unreported = 0;
+
+		sendto_realops_flags(UMODE_ALL, L_ALL,
+				     "Log buffer overflowed, %lu line(s) dropped", dropped);
+		ilog(L_MAIN, "Log buffer overflowed, %lu line(s) dropped", dropped);
+	}
+}
 
 static void
 verify_logfile_access(const char *filename)
@@ -122,10 +468,11 @@ void
 init_main_logfile(const char *filename)
 {
 	verify_logfile_access(filename);
-	if(log_main == NULL)
+	if(log_table[L_MAIN].fd < 0)
 	{
-		log_main = fopen(filename, "a");
+		log_table[L_MAIN].fd = open_log(filename);
 	}
+	rb_event_addish("check_logfiles", check_logfiles, NULL, 5);
 }
 
 void
@@ -135,7 +482,7 @@ open_logfiles(const char *filename)
 
 	close_logfiles();
 
-	log_main = fopen(filename, "a");
+	log_table[L_MAIN].fd = open_log(filename);
 
 	/* log_main is handled above, so just do the rest */
 	for(i = 1; i < LAST_LOGFILE; i++)
@@ -144,9 +491,29 @@ open_logfiles(const char *filename)
 		if(!EmptyString(*log_table[i].name))
 		{
 			verify_logfile_access(*log_table[i].name);
-			*log_table[i].logfile = fopen(*log_table[i].name, "a");
+			log_table[i].fd = open_log(*log_table[i].name);
 		}
 	}
+
+#ifdef USE_THREADED_LOG
+	start_log_writer();
+#endif
+}
+
+/* flush_logfiles()
+ *
+ * inputs	-
+ * outputs	-
+ * side effects - the writer thread writes out everything queued and
+ *		  stops, later lines are written directly.  for paths
+ *		  about to abort(), exit() runs it via atexit()
+ */
+void
+flush_logfiles(void)
+{
+#ifdef USE_THREADED_LOG
+	stop_log_writer();
+#endif
 }
 
 void
@@ -154,35 +521,32 @@ close_logfiles(void)
 {
 	int i;
 
-	if(log_main != NULL)
-		fclose(log_main);
+#ifdef USE_THREADED_LOG
+	/* flush whatever is still queued before the files go away */
+	stop_log_writer();
+#endif
 
-	/* log_main is handled above, so just do the rest */
-	for(i = 1; i < LAST_LOGFILE; i++)
-	{
-		if(*log_table[i].logfile != NULL)
-		{
-			fclose(*log_table[i].logfile);
-			*log_table[i].logfile = NULL;
-		}
-	}
+	for(i = 0; i < LAST_LOGFILE; i++)
+		close_log(i);
 }
 
 void
 ilog(ilogfile dest, const char *format, ...)
 {
-	FILE *logfile = *log_table[dest].logfile;
+	struct log_struct *log = &log_table[dest];
 	char buf[IRCD_BUFSIZE];
 	char buf2[IRCD_BUFSIZE];
 	va_list args;
+	size_t len;
 
 	va_start(args, format);
 	vsnprintf(buf, sizeof(buf), format, args);
 	va_end(args);
 
 	snprintf(buf2, sizeof(buf2), "%s %s\n", smalldate(rb_current_time()), buf);
+	len = strlen(buf2);
 #ifndef _WIN32
-	if(logfile == NULL || server_state_foreground)
+	if(log_load(log->fd) < 0 || server_state_foreground)
 	{
 #endif
 		fputs(buf2, stderr);
@@ -191,19 +555,47 @@ ilog(ilogfile dest, const char *format, ...)
 	}
 #endif
 
-	if(logfile == NULL)
+	if(log_load(log->fd) < 0)
+		return;
+
+#ifdef USE_THREADED_LOG
+	if(log_enqueue(dest, buf2, len))
 		return;
+#endif
 
-	if(fputs(buf2, logfile) < 0)
+	if(write(log->fd, buf2, len) < 0)
 	{
 		sendto_realops_flags(UMODE_ALL, L_ALL, "Closing logfile: %s (%s)",
-				     *log_table[dest].name, strerror(errno));
-		fclose(logfile);
-		*log_table[dest].logfile = NULL;
+				     log->name != NULL ? *log->name : "main", strerror(errno));
+		close_log(dest);
 		return;
 	}
+}
 
-	fflush(logfile);
+/* log_buffer_usage()
+ *
+ * inputs	- pointers to counters
+ * outputs	-
+ * side effects - reports how the log buffer is doing, for stats
+ */
+void
+log_buffer_usage(size_t *queued, size_t *size, size_t *mem, unsigned long *written,
+		 unsigned long *dropped)
+{
+#ifdef USE_THREADED_LOG
+	if(log_writer_running)
+	{
+		*queued = log_ring_head - log_load(log_ring_tail);
+		*size = log_ring_size;
+		*mem = log_ring_size * sizeof(struct log_line);
+		*written = log_load(log_written);
+		*dropped = log_dropped;
+		return;
+	}
+#endif
+	*queued = *size = *mem = 0;
+	*written = 0;
+	*dropped = log_dropped;
 }
 
 void
@@ -67,6 +67,41 @@ rb_dlink_list tgchange_list;
 rb_patricia_tree_t *tgchange_tree;
 
 
+/*
+ * xlines and nick resvs are indexed so a lookup doesn't have to try every
+ * mask.  Masks without wildcards go in a hash keyed by the whole mask.
+ * Masks that start (or end) with literal characters go in a hash keyed by
+ * up to MASK_INDEX_KEYLEN of them, and are found by looking up each
+ * length of the names head (or tail) that some key has.  Only what's left
+ * is tried one by one.  Every candidate still goes through
+ * match_compiled(), and the newest match wins, as it did when the lists
+ * were walked from the head.
+ */
+#define MASK_INDEX_KEYLEN 4
+
+struct mask_entry
+{
+	rb_dlink_node node;	/* on the index's wild list */
+	struct ConfItem *aconf;
+	hash_f *hf;		/* hash holding it, NULL if on the wild list */
+	hash_node *hnode;
+	unsigned long serial;
+};
+
+struct mask_index
+{
+	hash_f *exact;
+	hash_f *prefix;
+	hash_f *suffix;
+	unsigned int prefix_lens;	/* bit n is set if a prefix key is n long */
+	unsigned int suffix_lens;
+	rb_dlink_list wild;
+};
+
+static struct mask_index xline_index;
+static struct mask_index nick_resv_index;
+static unsigned long mask_serial;
+
 static void expire_temp_rxlines(void *unused);
 static void expire_nd_entries(void *unused);
 static void expire_glines(void *unused);
@@ -75,6 +110,12 @@ void
 init_s_newconf(void)
 {
 	tgchange_tree = rb_new_patricia(PATRICIA_BITS);
+	xline_index.exact = hash_create("X-line", CMP_IRCCMP, R_MIN_BITS, 0);
+	xline_index.prefix = hash_create("X-line prefix", CMP_IRCCMP, R_MIN_BITS, 0);
+	xline_index.suffix = hash_create("X-line suffix", CMP_IRCCMP, R_MIN_BITS, 0);
+	nick_resv_index.exact = hash_create("Nick RESV", CMP_IRCCMP, R_MIN_BITS, 0);
+	nick_resv_index.prefix = hash_create("Nick RESV prefix", CMP_IRCCMP, R_MIN_BITS, 0);
+	nick_resv_index.suffix = hash_create("Nick RESV suffix", CMP_IRCCMP, R_MIN_BITS, 0);
 	rb_event_addish("expire_nd_entries", expire_nd_entries, NULL, 30);
 	rb_event_addish("expire_temp_rxlines", expire_temp_rxlines, NULL, 60);
 	rb_event_addish("expire_glines", expire_glines, NULL, CLEANUP_GLINES_TIME);
@@ -138,8 +179,8 @@ clear_s_newconf_bans(void)
 		if(aconf->flags & CONF_FLAGS_TEMPORARY)
 			continue;
 
+		del_xline_conf(ptr);
 		free_conf(aconf);
-		rb_dlinkDestroy(ptr, &xline_conf_list);
 	}
 
 	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, resv_nick_list.head)
@@ -150,8 +191,8 @@ clear_s_newconf_bans(void)
 		if(aconf->flags & CONF_FLAGS_TEMPORARY)
 			continue;
 
+		del_nick_resv(ptr);
 		free_conf(aconf);
-		rb_dlinkDestroy(ptr, &resv_nick_list);
 	}
 
 	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, resv_channel_perm_list.head)
@@ -529,24 +570,191 @@ set_server_conf_autoconn(struct Client *source_p, char *name, int newval)
 		sendto_one_notice(source_p, ":Can't find %s", name);
 }
 
-struct ConfItem *
-find_xline(const char *gecos, int counter)
+/* mask_index_add()
+ *
+ * inputs	- index, conf whose host is the mask
+ * outputs	-
+ * side effects - conf is added to the index, its host_mask compiled
+ */
+static void
+mask_index_add(struct mask_index *mi, struct ConfItem *aconf)
+{
+	struct mask_entry *entry;
+	const char *prefix = NULL, *suffix = NULL;
+	size_t plen, slen;
+
+	if(aconf->host_mask == NULL)
+		aconf->host_mask = compile_mask(aconf->host, MASK_ESC);
+
+	entry = rb_malloc(sizeof(struct mask_entry));
+	entry->aconf = aconf;
+	entry->serial = ++mask_serial;
+	aconf->mask_entry = entry;
+
+	plen = IRCD_MIN(compiled_mask_prefix(aconf->host_mask, &prefix), MASK_INDEX_KEYLEN);
+	slen = compiled_mask_suffix(aconf->host_mask, &suffix);
+	if(slen > MASK_INDEX_KEYLEN)
+	{
+		/* keep the tail end of it */
+		suffix += slen - MASK_INDEX_KEYLEN;
+		slen = MASK_INDEX_KEYLEN;
+	}
+
+	if(compiled_mask_literal(aconf->host_mask))
+	{
+		entry->hf = mi->exact;
+		entry->hnode = hash_add_len(mi->exact, aconf->host, strlen(aconf->host), entry);
+	}
+	else if(plen > 0 && plen >= slen)
+	{
+		entry->hf = mi->prefix;
+		entry->hnode = hash_add_len(mi->prefix, prefix, plen, entry);
+		mi->prefix_lens |= 1U << plen;
+	}
+	else if(slen > 0)
+	{
+		entry->hf = mi->suffix;
+		entry->hnode = hash_add_len(mi->suffix, suffix, slen, entry);
+		mi->suffix_lens |= 1U << slen;
+	}
+	else
+		rb_dlinkAdd(entry, &entry->node, &mi->wild);
+}
+
+/* mask_index_del()
+ *
+ * inputs	- index, conf previously added to it
+ * outputs	-
+ * side effects - conf is taken out of the index
+ */
+static void
+mask_index_del(struct mask_index *mi, struct ConfItem *aconf)
 {
+	struct mask_entry *entry = aconf->mask_entry;
+
+	if(entry == NULL)
+		return;
+
+	if(entry->hf != NULL)
+		hash_del_hnode(entry->hf, entry->hnode);
+	else
+		rb_dlinkDelete(&entry->node, &mi->wild);
+
+	aconf->mask_entry = NULL;
+	rb_free(entry);
+}
+
+/* mask_index_try()
+ *
+ * inputs	- chain of entries sharing a key, name, best match so far
+ * outputs	- the newest entry in the chain, or best, that matches name
+ * side effects -
+ */
+static struct mask_entry *
+mask_index_try(hash_node *hnode, const char *name, struct mask_entry *best)
+{
+	for(; hnode != NULL; hnode = hnode->next)
+	{
+		struct mask_entry *entry = hnode->data;
+
+		if(best != NULL && entry->serial < best->serial)
+			continue;
+
+		if(match_compiled(entry->aconf->host_mask, name))
+			best = entry;
+	}
+
+	return best;
+}
+
+/* mask_index_find()
+ *
+ * inputs	- index, name
+ * outputs	- newest conf whose mask matches name, or NULL
+ * side effects -
+ */
+static struct ConfItem *
+mask_index_find(struct mask_index *mi, const char *name)
+{
+	struct mask_entry *best;
 	rb_dlink_node *ptr;
+	size_t len = strlen(name);
+	size_t i;
 
-	RB_DLINK_FOREACH(ptr, xline_conf_list.head)
+	best = mask_index_try(hash_find_len(mi->exact, name, len), name, NULL);
+
+	for(i = 1; i <= MASK_INDEX_KEYLEN && i <= len; i++)
 	{
-		struct ConfItem *aconf = ptr->data;
+		if(mi->prefix_lens & (1U << i))
+			best = mask_index_try(hash_find_len(mi->prefix, name, i), name, best);
 
-		if(match_esc(aconf->host, gecos))
-		{
-			if(counter)
-				aconf->port++;
-			return aconf;
-		}
+		if(mi->suffix_lens & (1U << i))
+			best = mask_index_try(hash_find_len(mi->suffix, name + len - i, i), name, best);
 	}
 
-	return NULL;
+	RB_DLINK_FOREACH(ptr, mi->wild.head)
+	{
+		struct mask_entry *entry = ptr->data;
+
+		if(best != NULL && entry->serial < best->serial)
+			continue;
+
+		if(match_compiled(entry->aconf->host_mask, name))
+			best = entry;
+	}
+
+	return best != NULL ? best->aconf : NULL;
+}
+
+void
+add_xline_conf(struct ConfItem *aconf)
+{
+	rb_dlinkAddAlloc(aconf, &xline_conf_list);
+	mask_index_add(&xline_index, aconf);
+}
+
+/* del_xline_conf()
+ *
+ * inputs	- node on xline_conf_list
+ * outputs	-
+ * side effects - the xline is unlinked, but not freed
+ */
+void
+del_xline_conf(rb_dlink_node *ptr)
+{
+	mask_index_del(&xline_index, ptr->data);
+	rb_dlinkDestroy(ptr, &xline_conf_list);
+}
+
+void
+add_nick_resv(struct ConfItem *aconf)
+{
+	rb_dlinkAddAlloc(aconf, &resv_nick_list);
+	mask_index_add(&nick_resv_index, aconf);
+}
+
+/* del_nick_resv()
+ *
+ * inputs	- node on resv_nick_list
+ * outputs	-
+ * side effects - the resv is unlinked, but not freed
+ */
+void
+del_nick_resv(rb_dlink_node *ptr)
+{
+	mask_index_del(&nick_resv_index, ptr->data);
+	rb_dlinkDestroy(ptr, &resv_nick_list);
+}
+
+struct ConfItem *
+find_xline(const char *gecos, int counter)
+{
+	struct ConfItem *aconf;
+
+	if((aconf = mask_index_find(&xline_index, gecos)) != NULL && counter)
+		aconf->port++;
+
+	return aconf;
 }
 
 struct ConfItem *
@@ -568,20 +776,12 @@ find_xline_mask(const char *gecos)
 struct ConfItem *
 find_nick_resv(const char *name)
 {
-	rb_dlink_node *ptr;
-
-	RB_DLINK_FOREACH(ptr, resv_nick_list.head)
-	{
-		struct ConfItem *aconf = ptr->data;
+	struct ConfItem *aconf;
 
-		if(match_esc(aconf->host, name))
-		{
-			aconf->port++;
-			return aconf;
-		}
-	}
+	if((aconf = mask_index_find(&nick_resv_index, name)) != NULL)
+		aconf->port++;
 
-	return NULL;
+	return aconf;
 }
 
 struct ConfItem *
@@ -722,8 +922,8 @@ expire_temp_rxlines(void *unused)
 		{
 			if(ConfigFileEntry.tkline_expire_notices)
 				sendto_realops_flags(UMODE_ALL, L_ALL, "Temporary RESV for [%s] expired", aconf->host);
+			del_nick_resv(ptr);
 			free_conf(aconf);
-			rb_dlinkDestroy(ptr, &resv_nick_list);
 		}
 	}
 
@@ -736,8 +936,8 @@ expire_temp_rxlines(void *unused)
 			if(ConfigFileEntry.tkline_expire_notices)
 				sendto_realops_flags(UMODE_ALL, L_ALL,
 						     "Temporary X-line for [%s] expired", aconf->host);
+			del_xline_conf(ptr);
 			free_conf(aconf);
-			rb_dlinkDestroy(ptr, &xline_conf_list);
 		}
 	}
 }
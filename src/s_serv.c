@@ -449,8 +449,8 @@ serv_connect(struct server_conf *server_p, struct Client *by)
 
 	/* Copy in the server, hostname, fd */
 	client_p->name = scache_add(server_p->name);
-	rb_strlcpy(client_p->host, server_p->host, sizeof(client_p->host));
-	rb_strlcpy(client_p->sockhost, buf, sizeof(client_p->sockhost));
+	set_client_host(client_p, server_p->host);
+	set_client_sockhost(client_p, buf);
 	client_p->localClient->F = F;
 
 	/* shove the port number into the sockaddr */
@@ -249,6 +249,8 @@ register_local_user(struct Client *client_p, struct Client *source_p, const char
 	char tmpstr2[IRCD_BUFSIZE];
 	char ipaddr[HOSTIPLEN];
 	char myusername[USERLEN + 1];
+	char newusername[USERLEN + 1];
+	char hostbuf[HOSTLEN + 1];
 	int status;
 
 	s_assert(NULL != source_p);
@@ -282,7 +284,7 @@ register_local_user(struct Client *client_p, struct Client *source_p, const char
 
 	client_p->localClient->last = rb_current_time();
 	/* Straight up the maximum rate of flooding... */
-	source_p->localClient->allow_read = MAX_FLOOD_BURST;
+	LocalAllowRead(source_p) = MAX_FLOOD_BURST;
 
 	/* XXX - fixme. we shouldnt have to build a users buffer twice.. */
 	if(!IsGotId(source_p) && (strchr(username, '[') != NULL))
@@ -310,12 +312,13 @@ register_local_user(struct Client *client_p, struct Client *source_p, const char
 	{
 		sendto_one_notice(source_p, ":*** Notice -- You have an invalid hostname");
 
-		rb_strlcpy(source_p->host, source_p->sockhost, sizeof(source_p->host));
+		rb_strlcpy(hostbuf, source_p->sockhost, sizeof(hostbuf));
 
 #ifdef RB_IPV6
 		if(ConfigFileEntry.dot_in_ip6_addr == 1 && (GET_SS_FAMILY(&source_p->localClient->ip) == AF_INET6))
-			rb_strlcat(source_p->host, ".", sizeof(source_p->host));
+			rb_strlcat(hostbuf, ".", sizeof(hostbuf));
 #endif
+		set_client_host(source_p, hostbuf);
 	}
 
 
@@ -354,16 +357,17 @@ register_local_user(struct Client *client_p, struct Client *source_p, const char
 			p = username;
 
 			if(!IsNoTilde(aconf))
-				source_p->username[i++] = '~';
+				newusername[i++] = '~';
 
 			while(*p && i < USERLEN)
 			{
 				if(*p != '[')
-					source_p->username[i++] = *p;
+					newusername[i++] = *p;
 				p++;
 			}
 
-			source_p->username[i] = '\0';
+			newusername[i] = '\0';
+			set_client_username(source_p, newusername);
 		}
 	}
 
@@ -518,9 +522,9 @@ register_local_user(struct Client *client_p, struct Client *source_p, const char
 	/* Increment our total user count here */
 	if(++Count.total > Count.max_tot)
 		Count.max_tot = Count.total;
-	source_p->localClient->allow_read = MAX_FLOOD_BURST;
+	LocalAllowRead(source_p) = MAX_FLOOD_BURST;
 
-	source_p->localClient->firsttime = rb_current_time();
+	LocalFirstTime(source_p) = rb_current_time();
 
 	Count.totalrestartcount++;
 
@@ -853,6 +857,8 @@ user_mode(struct Client *client_p, struct Client *source_p, int parc, const char
 		++Count.invisi;
 	if((setflags & UMODE_INVISIBLE) && !IsInvisible(source_p))
 		--Count.invisi;
+	if((setflags ^ source_p->umodes) & UMODE_INVISIBLE)
+		invalidate_names_cache_user(source_p);
 	/*
 	 * compare new flags with old flags and send string which
 	 * will cause servers to update correctly.
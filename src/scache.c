@@ -1,6 +1,6 @@
 /*
  *  ircd-ratbox: A slightly useful ircd.
- *  scache.c: Server names cache.
+ *  scache.c: Server names and shared string caches.
  *
  *  Copyright (C) 1990 Jarkko Oikarinen and University of Oulu, Co Center
  *  Copyright (C) 1996-2002 Hybrid Development Team
@@ -31,6 +31,9 @@
 #include <send.h>
 #include <hash.h>
 #include <scache.h>
+#include <struct.h>
+#include <client.h>
+#include <s_log.h>
 
 /*
  * this code intentionally leaks a little bit of memory, unless you're on a network
@@ -68,3 +71,90 @@ count_scache(size_t *number, size_t *mem)
 	hash_get_memusage(HASH_SCACHE, number, mem);
 	(*mem) += scache_allocated;
 }
+
+/*
+ * interned strings
+ *
+ * Usernames, hosts and realnames repeat a lot across a network (cloaks,
+ * bouncers, webchat gateways), so clients point at a single shared
+ * copy of each rather than carrying their own.  Unlike the server name
+ * cache these are refcounted and go away when the last user lets go.
+ * The string itself is the key of its hash node, with the refcount
+ * kept in the node's data.
+ */
+
+/* intern_add()
+ *
+ * inputs	- string, maximum length to keep of it
+ * outputs	- shared copy of the string, truncated to maxlen
+ * side effects - the copy's refcount is raised, release it with
+ *		  intern_del()
+ */
+const char *
+intern_add(const char *str, size_t maxlen)
+{
+	char buf[IRCD_BUFSIZE];
+	hash_node *hnode;
+	size_t len;
+
+	if(str == NULL)
+		str = "";
+
+	if(strlen(str) > maxlen)
+	{
+		rb_strlcpy(buf, str, IRCD_MIN(maxlen + 1, sizeof(buf)));
+		str = buf;
+	}
+
+	/* hash_find() and hash_add() refuse empty strings, which are
+	 * interned like any other
+	 */
+	len = strlen(str) + 1;
+	if((hnode = hash_find_len(HASH_INTERN, str, len)) != NULL)
+	{
+		hnode->data = (void *)((uintptr_t)hnode->data + 1);
+		return hnode->key;
+	}
+
+	hnode = hash_add_len(HASH_INTERN, str, len, (void *)1);
+	return hnode->key;
+}
+
+/* intern_del()
+ *
+ * inputs	- string returned by intern_add()
+ * outputs	-
+ * side effects - refcount dropped, and the string freed with the last
+ */
+void
+intern_del(const char *str)
+{
+	hash_node *hnode;
+
+	if(str == NULL)
+		return;
+
+	hnode = hash_find_len(HASH_INTERN, str, strlen(str) + 1);
+	s_assert(hnode != NULL && hnode->key == str);
+	if(hnode == NULL)
+		return;
+
+	if((uintptr_t)hnode->data > 1)
+		hnode->data = (void *)((uintptr_t)hnode->data - 1);
+	else
+		hash_del_hnode(HASH_INTERN, hnode);
+}
+
+static void
+count_intern_refs(void *data, void *refs)
+{
+	*(size_t *)refs += (uintptr_t)data;
+}
+
+void
+count_intern(size_t *number, size_t *refs, size_t *mem)
+{
+	hash_get_memusage(HASH_INTERN, number, mem);
+	*refs = 0;
+	hash_walkall(HASH_INTERN, count_intern_refs, refs);
+}
@@ -95,8 +95,8 @@ send_linebuf(struct Client *to, rb_buf_head_t * linebuf)
 	 ** because it counts messages even if queued, but bytes
 	 ** only really sent. Queued bytes get updated in SendQueued.
 	 */
-	to->localClient->sendM += 1;
-	me.localClient->sendM += 1;
+	to->localClient->sendM += rb_linebuf_numlines(linebuf);
+	me.localClient->sendM += rb_linebuf_numlines(linebuf);
 
 	if(rb_linebuf_len(to->localClient->buf_sendq) > 0)
 		send_queued(to);
@@ -240,6 +240,27 @@ sendto_one_buffer(struct Client *target_p, const char *buffer)
 	rb_linebuf_donebuf(&linebuf);
 }
 
+/* sendto_one_linebuf()
+ *
+ * inputs	- client to send to, linebuf of already formatted lines
+ * outputs	- client has every line in linebuf put into its queue
+ * side effects - the caller still owns linebuf and must rb_linebuf_donebuf() it
+ */
+void
+sendto_one_linebuf(struct Client *target_p, rb_buf_head_t * linebuf)
+{
+	if(IsFake(target_p))
+		return;
+
+	if(target_p->from != NULL)
+		target_p = target_p->from;
+
+	if(IsIOError(target_p))
+		return;
+
+	send_linebuf(target_p, linebuf);
+}
+
 /* sendto_one()
  *
  * inputs	- client to send to, va_args
@@ -422,6 +443,77 @@ sendto_one_numeric(struct Client *target_p, int numeric, const char *pattern, ..
 	rb_linebuf_donebuf(&linebuf);
 }
 
+/*
+ * Directly linked servers grouped by their exact capab set.  There are
+ * only ever a handful of distinct sets, so sendto_server() tests caps and
+ * nocaps once per group rather than once per link.
+ */
+struct serv_capgroup
+{
+	uint32_t caps;
+	rb_dlink_list servers;
+	rb_dlink_node node;
+};
+
+static rb_dlink_list serv_capgroups;
+
+/* add_serv_capgroup()
+ *
+ * inputs	- server that has just been linked
+ * outputs	-
+ * side effects - server is added to the group for its capabs, which is
+ *		  created if this is the first server with that set
+ */
+void
+add_serv_capgroup(struct Client *server_p)
+{
+	struct serv_capgroup *group = NULL;
+	rb_dlink_node *ptr;
+
+	RB_DLINK_FOREACH(ptr, serv_capgroups.head)
+	{
+		group = ptr->data;
+
+		if(group->caps == server_p->localClient->caps)
+			break;
+	}
+
+	if(ptr == NULL)
+	{
+		group = rb_malloc(sizeof(struct serv_capgroup));
+		group->caps = server_p->localClient->caps;
+		rb_dlinkAdd(group, &group->node, &serv_capgroups);
+	}
+
+	rb_dlinkAdd(server_p, &server_p->localClient->capnode, &group->servers);
+	server_p->localClient->capgroup = group;
+}
+
+/* del_serv_capgroup()
+ *
+ * inputs	- server that is being exited
+ * outputs	-
+ * side effects - server is removed from its capab group, the group is
+ *		  freed once empty
+ */
+void
+del_serv_capgroup(struct Client *server_p)
+{
+	struct serv_capgroup *group = server_p->localClient->capgroup;
+
+	if(group == NULL)
+		return;
+
+	rb_dlinkDelete(&server_p->localClient->capnode, &group->servers);
+	server_p->localClient->capgroup = NULL;
+
+	if(rb_dlink_list_length(&group->servers) == 0)
+	{
+		rb_dlinkDelete(&group->node, &serv_capgroups);
+		rb_free(group);
+	}
+}
+
 /*
  * sendto_server
  * 
@@ -438,15 +530,20 @@ sendto_one_numeric(struct Client *target_p, int numeric, const char *pattern, ..
  * This function was written in an attempt to merge together the other
  * billion sendto_*serv*() functions, which sprung up with capabs, uids etc
  * -davidt
+ *
+ * The line is identical for every server, so it is formatted once, and
+ * only when some capab group actually has a server to send it to.
  */
 void
 sendto_server(struct Client *one, struct Channel *chptr, unsigned long caps,
 	      unsigned long nocaps, const char *format, ...)
 {
 	va_list args;
+	rb_dlink_node *gptr;
 	rb_dlink_node *ptr;
 	rb_dlink_node *next_ptr;
 	rb_buf_head_t linebuf;
+	int formatted = 0;
 	
 	/* noone to send to.. */
 	if(rb_dlink_list_length(&serv_list) == 0)
@@ -455,35 +552,37 @@ sendto_server(struct Client *one, struct Channel *chptr, unsigned long caps,
 	if(chptr != NULL && *chptr->chname != '#')
 		return;
 
-	rb_linebuf_newbuf(&linebuf);
-	va_start(args, format);
-	rb_linebuf_putmsg(&linebuf, format, &args, NULL);
-	va_end(args);
-
-	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, serv_list.head)
+	RB_DLINK_FOREACH(gptr, serv_capgroups.head)
 	{
-		struct Client *target_p = ptr->data;
-		
-		if(IsFake(target_p))
-		        continue;
+		struct serv_capgroup *group = gptr->data;
 
-		/* check against 'one' */
-		if(one != NULL && (target_p == one->from))
+		/* check we have required capabs, and none of the forbidden ones */
+		if((group->caps & caps) != caps || (group->caps & nocaps) != 0)
 			continue;
 
-		/* check we have required capabs */
-		if(!IsCapable(target_p, caps))
-			continue;
+		RB_DLINK_FOREACH_SAFE(ptr, next_ptr, group->servers.head)
+		{
+			struct Client *target_p = ptr->data;
 
-		/* check we don't have any forbidden capabs */
-		if(!NotCapable(target_p, nocaps))
-			continue;
+			/* check against 'one' */
+			if(one != NULL && (target_p == one->from))
+				continue;
 
-		send_linebuf(target_p, &linebuf);
-	}
+			if(!formatted)
+			{
+				rb_linebuf_newbuf(&linebuf);
+				va_start(args, format);
+				rb_linebuf_putmsg(&linebuf, format, &args, NULL);
+				va_end(args);
+				formatted = 1;
+			}
 
-	rb_linebuf_donebuf(&linebuf);
+			send_linebuf(target_p, &linebuf);
+		}
+	}
 
+	if(formatted)
+		rb_linebuf_donebuf(&linebuf);
 }
 
 /* sendto_channel_flags()
@@ -614,6 +713,119 @@ sendto_channel_local(int type, struct Channel *chptr, const char *pattern, ...)
 	rb_linebuf_donebuf(&linebuf);
 }
 
+/* cork_channel_local()
+ *
+ * inputs	- channel
+ * outputs	-
+ * side effects - local members are corked, so whatever the channel sends
+ *		  them until uncork_channel_local() goes out in one write
+ */
+void
+cork_channel_local(struct Channel *chptr)
+{
+	rb_dlink_node *ptr;
+
+	RB_DLINK_FOREACH(ptr, chptr->locmembers.head)
+	{
+		struct membership *msptr = ptr->data;
+
+		SetCork(msptr->client_p);
+	}
+}
+
+/* uncork_channel_local()
+ *
+ * inputs	- channel corked with cork_channel_local()
+ * outputs	-
+ * side effects - local members are uncorked and their sendqs flushed
+ */
+void
+uncork_channel_local(struct Channel *chptr)
+{
+	rb_dlink_node *ptr;
+
+	RB_DLINK_FOREACH(ptr, chptr->locmembers.head)
+	{
+		struct membership *msptr = ptr->data;
+
+		ClearCork(msptr->client_p);
+		send_pop_queue(msptr->client_p);
+	}
+}
+
+/*
+ * Recipient sets collect the local clients a message goes to, once each,
+ * when they are found through several channels.  Membership is a bit per
+ * local_sweep slot, and local channel memberships carry their client's
+ * slot, so walking a channel never has to touch the members' LocalUser.
+ * Slots don't move until a client is freed, which never happens while a
+ * set is in use.
+ */
+static struct
+{
+	unsigned long *seen;
+	struct Client **list;
+	unsigned int count;
+	unsigned int size;
+} recipients;
+
+#define RECIPIENT_BITS	(sizeof(unsigned long) * 8)
+
+static void
+recipients_begin(void)
+{
+	if(recipients.size < local_sweep.size)
+	{
+		unsigned int words = (local_sweep.size + RECIPIENT_BITS - 1) / RECIPIENT_BITS;
+
+		rb_free(recipients.seen);
+		recipients.seen = rb_malloc(words * sizeof(unsigned long));
+		recipients.list = rb_realloc(recipients.list, local_sweep.size * sizeof(struct Client *));
+		recipients.size = local_sweep.size;
+	}
+	recipients.count = 0;
+}
+
+static inline void
+recipients_add(struct Client *target_p, unsigned int slot)
+{
+	unsigned long bit = 1UL << (slot % RECIPIENT_BITS);
+
+	if(recipients.seen[slot / RECIPIENT_BITS] & bit)
+		return;
+	recipients.seen[slot / RECIPIENT_BITS] |= bit;
+	recipients.list[recipients.count++] = target_p;
+}
+
+/* clears the bits of everyone collected, ready for the next set */
+static void
+recipients_end(void)
+{
+	unsigned int i;
+
+	for(i = 0; i < recipients.count; i++)
+		recipients.seen[LocalSlot(recipients.list[i]) / RECIPIENT_BITS] = 0;
+	recipients.count = 0;
+}
+
+/* adds the local members of every channel user is on */
+static void
+recipients_add_common(struct Client *user)
+{
+	rb_dlink_node *ptr, *uptr;
+
+	RB_DLINK_FOREACH(ptr, user->user->channel.head)
+	{
+		struct membership *mscptr = ptr->data;
+
+		RB_DLINK_FOREACH(uptr, mscptr->chptr->locmembers.head)
+		{
+			struct membership *msptr = uptr->data;
+			recipients_add(msptr->client_p, msptr->slot);
+		}
+	}
+}
+
 /*
  * sendto_common_channels_local()
  *
@@ -628,47 +840,107 @@ void
 sendto_common_channels_local(struct Client *user, const char *pattern, ...)
 {
 	va_list args;
-	rb_dlink_node *ptr;
-	rb_dlink_node *next_ptr;
 	rb_buf_head_t linebuf;
+	unsigned int i;
 
 	rb_linebuf_newbuf(&linebuf);
 	va_start(args, pattern);
 	rb_linebuf_putmsg(&linebuf, pattern, &args, NULL);
 	va_end(args);
 
-	current_serial++;
+	recipients_begin();
+	recipients_add_common(user);
+
+	/* this can happen when the user isnt in any channels, but we still
+	 * need to send them the data, ie a nick change
+	 */
+	if(MyConnect(user))
+		recipients_add(user, LocalSlot(user));
 
-	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, user->user->channel.head)
+	for(i = 0; i < recipients.count; i++)
 	{
-		struct membership *mscptr = ptr->data;
-		struct Channel *chptr = mscptr->chptr;
-		rb_dlink_node *uptr;
-		rb_dlink_node *next_uptr;
+		struct Client *target_p = recipients.list[i];
+
+		if(IsFake(target_p) || IsIOError(target_p))
+			continue;
+
+		send_linebuf(target_p, &linebuf);
+	}
+	recipients_end();
+
+	rb_linebuf_donebuf(&linebuf);
+}
+
+/* QUITs for this many users are queued before the recipients are flushed */
+#define QUIT_SLICE	256
+
+/* sendto_common_channels_quits()
+ *
+ * inputs	- exiting remote users, number of them, quit comment
+ * outputs	-
+ * side effects - each user's QUIT is sent to the local users sharing a
+ *		  channel with them.  Recipients are corked for a slice of
+ *		  users at a time and flushed at the end of it, so a netsplit
+ *		  costs a write per recipient per slice rather than per QUIT.
+ */
+void
+sendto_common_channels_quits(struct Client **users, size_t count, const char *comment)
+{
+	static struct Client **corked;
+	static size_t corked_size;
+	size_t ncorked = 0;
+	rb_buf_head_t linebuf;
+	unsigned int k;
+	size_t i, j;
+
+	for(i = 0; i < count; i++)
+	{
+		struct Client *user = users[i];
 
-		RB_DLINK_FOREACH_SAFE(uptr, next_uptr, chptr->locmembers.head)
+		if(user->user->channel.head != NULL)
 		{
-			struct membership *msptr = uptr->data;
-			struct Client *target_p = msptr->client_p;
-			
-			if(IsFake(target_p))
-			        continue;
+			rb_linebuf_newbuf(&linebuf);
+			rb_linebuf_putmsg(&linebuf, NULL, NULL, ":%s!%s@%s QUIT :%s",
+					  user->name, user->username, user->host, comment);
 
-			if(IsIOError(target_p) || target_p->localClient->serial == current_serial)
-				continue;
+			recipients_begin();
+			recipients_add_common(user);
+
+			for(k = 0; k < recipients.count; k++)
+			{
+				struct Client *target_p = recipients.list[k];
+
+				if(IsFake(target_p) || IsIOError(target_p))
+					continue;
+
+				if(!IsCork(target_p))
+				{
+					if(ncorked == corked_size)
+					{
+						corked_size = corked_size ? corked_size * 2 : 1024;
+						corked = rb_realloc(corked, sizeof(struct Client *) * corked_size);
+					}
+					SetCork(target_p);
+					corked[ncorked++] = target_p;
+				}
+
+				send_linebuf(target_p, &linebuf);
+			}
+			recipients_end();
 
-			target_p->localClient->serial = current_serial;
-			send_linebuf(target_p->from ? target_p->from : target_p, &linebuf);
+			rb_linebuf_donebuf(&linebuf);
 		}
-	}
 
-	/* this can happen when the user isnt in any channels, but we still
-	 * need to send them the data, ie a nick change
-	 */
-	if(MyConnect(user) && (user->localClient->serial != current_serial))
-		send_linebuf(user->from ? user->from : user, &linebuf);
+		if((i + 1) % QUIT_SLICE != 0 && i + 1 < count)
+			continue;
 
-	rb_linebuf_donebuf(&linebuf);
+		for(j = 0; j < ncorked; j++)
+		{
+			ClearCork(corked[j]);
+			send_pop_queue(corked[j]);
+		}
+		ncorked = 0;
+	}
 }
 
 /* sendto_match_butone()
@@ -815,39 +1087,6 @@ sendto_match_servs(struct Client *source_p, const char *mask, int cap, int nocap
 	rb_linebuf_donebuf(&rb_linebuf_name);
 }
 
-/* sendto_monitor()
- *
- * inputs	- monitor nick to send to, format, va_args
- * outputs	- message to local users monitoring the given nick
- * side effects -
- */
-void
-sendto_monitor(struct monitor *monptr, const char *pattern, ...)
-{
-	va_list args;
-	rb_buf_head_t linebuf;
-	rb_dlink_node *ptr;
-	rb_dlink_node *next_ptr;
-
-	rb_linebuf_newbuf(&linebuf);
-
-	va_start(args, pattern);
-	rb_linebuf_putmsg(&linebuf, pattern, &args, NULL);
-	va_end(args);
-
-	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, monptr->users.head)
-	{
-		struct Client *target_p = ptr->data;
-
-		if(IsIOError(target_p))
-			continue;
-
-		send_linebuf(target_p, &linebuf);
-	}
-
-	rb_linebuf_donebuf(&linebuf);
-}
-
 /* sendto_anywhere()
  *
  * inputs	- target, source, va_args
@@ -502,20 +502,23 @@ create_fake_client(const char *name, const char *username, const char *host,
 	make_user(fake_p);
 	
 	fake_p->localClient = rb_malloc(sizeof(struct LocalUser));
+	add_local_sweep(fake_p);
 	
 	fake_p->from = fake_p;
 	
 	rb_strlcpy(fake_p->user->name, name, sizeof(fake_p->user->name));
-	rb_strlcpy(fake_p->username, username, sizeof(fake_p->username));
-	rb_strlcpy(fake_p->host, host, sizeof(fake_p->host));
-	rb_strlcpy(fake_p->info, gecos, sizeof(fake_p->info));
+	init_client_strings(fake_p);
+	set_client_username(fake_p, username);
+	set_client_host(fake_p, host);
+	set_client_info(fake_p, gecos);
 	
 	fake_p->name = fake_p->user->name;
+	who_index_add(fake_p);
 	fake_p->hopcount = 0;
 	fake_p->flags |= FLAGS_IP_SPOOFING|FLAGS_FAKE;
 	fake_p->tsinfo = 1;
 	fake_p->localClient->F = NULL;
-	fake_p->localClient->firsttime = fake_p->localClient->last = rb_current_time();
+	LocalFirstTime(fake_p) = fake_p->localClient->last = rb_current_time();
 	
 	fake_p->umodes = UMODE_INVISIBLE;
 	
@@ -554,7 +557,10 @@ destroy_fake_client(struct Client *fake_p)
 	hash_del(HASH_CLIENT, fake_p->name, fake_p);
 	
 	rb_dlinkDelete(&fake_p->node, &global_client_list);
+	who_index_del(fake_p);
 	free_user(fake_p->user, fake_p);
+	free_client_strings(fake_p);
+	del_local_sweep(fake_p);
 	rb_free(fake_p->localClient);
 	rb_free(fake_p);
 }
@@ -572,13 +578,15 @@ create_fake_server(const char *name, const char *gecos, int persist)
 	make_server(fake_p);
 	
 	fake_p->localClient = rb_malloc(sizeof(struct LocalUser));
+	add_local_sweep(fake_p);
 	
 	fake_p->from = fake_p;
 	//fake_p->serv->up = me.name;
 	fake_p->servptr = &me;
 	
 	fake_p->name = scache_add(name);
-	rb_strlcpy(fake_p->info, gecos, sizeof(fake_p->info));
+	init_client_strings(fake_p);
+	set_client_info(fake_p, gecos);
 	
 	fake_p->hopcount = 1;
 	fake_p->flags = FLAGS_FAKE;
@@ -616,6 +624,8 @@ destroy_fake_server(struct Client *fake_p, int send_squit)
 	rb_dlinkFindDestroy(fake_p, &global_serv_list);
 	
 	rb_free(fake_p->serv);
+	free_client_strings(fake_p);
+	del_local_sweep(fake_p);
 	rb_free(fake_p->localClient);
 	rb_free(fake_p);
 }
@@ -38,100 +38,173 @@
 #include <client.h>
 #include <send.h>
 #include <s_log.h>
+#include <scache.h>
 
-struct whowas_top
-{
-	char *name;
-	rb_dlink_list wwlist;
-	hash_node *hnode;
-};
+/*
+ * The history is a ring of fixed size records allocated in one go by
+ * whowas_set_size(), oldest first from whowas_start.  Adding to a full
+ * ring just reuses the oldest record, so there is nothing to trim and
+ * the memory used never changes.  The strings are interned, so a record
+ * mostly points at copies its client was already sharing.
+ *
+ * Nicks are found through an open addressed table, kept at least twice
+ * the size of the ring, holding the ring position + 1 of the newest
+ * record for each nick.  The records of a nick are chained through
+ * their older/newer ring positions from there.
+ */
+#define WHOWAS_NONE	UINT32_MAX
+#define WHOWAS_INDEX_MIN	16
 
+static whowas_t *whowas_ring;
+static uint32_t whowas_size;
+static uint32_t whowas_start;
+static uint32_t whowas_count;
 
-/* whowas hash size */
-#define WHOWAS_MAX_BITS 17 /* 128kb */ 
+static uint32_t *whowas_index;
+static uint32_t whowas_index_mask;
 
-static hash_f *whowas_hash;
-static rb_dlink_list *whowas_list;
-static unsigned int whowas_list_length = NICKNAMEHISTORYLENGTH;
+static uint32_t *
+whowas_index_find(const char *name, uint32_t hashv)
+{
+	uint32_t i;
+
+	for(i = hashv & whowas_index_mask;; i = (i + 1) & whowas_index_mask)
+	{
+		whowas_t *who;
 
+		if(whowas_index[i] == 0)
+			return &whowas_index[i];
 
-static void whowas_trim(void *unused);
+		who = &whowas_ring[whowas_index[i] - 1];
+		if(who->hashv == hashv && !irccmp(who->name, name))
+			return &whowas_index[i];
+	}
+}
 
+/* closes the gap left by a removed slot by shifting back any entries
+ * further along that would no longer be found past it
+ */
 static void
-whowas_free_wtop(struct whowas_top *wtop)
+whowas_index_remove(uint32_t *slot)
 {
-	if(rb_dlink_list_length(&wtop->wwlist) == 0)
+	uint32_t i = slot - whowas_index;
+	uint32_t j, home;
+
+	for(j = (i + 1) & whowas_index_mask; whowas_index[j] != 0; j = (j + 1) & whowas_index_mask)
 	{
-		hash_del_hnode(whowas_hash, wtop->hnode);
-		rb_free(wtop->name);
-		rb_free(wtop);
+		home = whowas_ring[whowas_index[j] - 1].hashv & whowas_index_mask;
+		if(((j - home) & whowas_index_mask) >= ((j - i) & whowas_index_mask))
+		{
+			whowas_index[i] = whowas_index[j];
+			i = j;
+		}
 	}
+	whowas_index[i] = 0;
 }
 
-static struct whowas_top *
-whowas_get_top(const char *name)
+/* makes who the newest record for its nick */
+static void
+whowas_link(whowas_t *who)
 {
-	hash_node *hnode;
-	struct whowas_top *wtop;
+	uint32_t pos = who - whowas_ring;
+	uint32_t *slot;
 
-	hnode = hash_find(whowas_hash, name);
-	if(hnode != NULL)
+	slot = whowas_index_find(who->name, who->hashv);
+	who->newer = WHOWAS_NONE;
+	if(*slot != 0)
 	{
-		return (struct whowas_top *) hnode->data;
+		who->older = *slot - 1;
+		whowas_ring[who->older].newer = pos;
 	}
-	wtop = rb_malloc(sizeof(struct whowas_top));
-	wtop->name = rb_strdup(name);
-	hnode = hash_add(whowas_hash, name, wtop);
-	wtop->hnode = hnode;
-	return wtop;
+	else
+		who->older = WHOWAS_NONE;
+	*slot = pos + 1;
+}
+
+/* drops the oldest record in the ring, which is also the oldest for
+ * its nick
+ */
+static void
+whowas_expire(void)
+{
+	whowas_t *who = &whowas_ring[whowas_start];
+
+	if(who->online != NULL)
+		rb_dlinkDelete(&who->cnode, &who->online->whowas_clist);
+
+	if(who->newer != WHOWAS_NONE)
+		whowas_ring[who->newer].older = WHOWAS_NONE;
+	else
+		whowas_index_remove(whowas_index_find(who->name, who->hashv));
+
+	intern_del(who->username);
+	intern_del(who->hostname);
+	intern_del(who->realname);
+	intern_del(who->sockhost);
+
+	if(++whowas_start == whowas_size)
+		whowas_start = 0;
+	whowas_count--;
+}
+
+whowas_t *
+whowas_get_first(const char *name)
+{
+	uint32_t *slot;
+
+	slot = whowas_index_find(name, hash_irccase(name));
+	if(*slot == 0)
+		return NULL;
+	return &whowas_ring[*slot - 1];
 }
 
-rb_dlink_list *
-whowas_get_list(const char *name)
+whowas_t *
+whowas_get_next(whowas_t *who)
 {
-	struct whowas_top *wtop;
-	wtop = hash_find_data(whowas_hash, name);
-	if(wtop == NULL)
+	if(who->older == WHOWAS_NONE)
 		return NULL;
-	return &wtop->wwlist;
+	return &whowas_ring[who->older];
 }
 
 void
 whowas_add_history(struct Client *client_p, bool online)
 {
-	struct whowas_top *wtop;
 	whowas_t *who;
+	uint32_t pos;
 	s_assert(NULL != client_p);
 
-	if(client_p == NULL)
+	if(client_p == NULL || whowas_size == 0)
 		return;
 
-	/* trim some of the entries if we're getting well over our history length */
-	if(rb_dlink_list_length(whowas_list) > whowas_list_length + 100)
-		whowas_trim(NULL);
+	if(whowas_count == whowas_size)
+		whowas_expire();
+
+	pos = whowas_start + whowas_count;
+	if(pos >= whowas_size)
+		pos -= whowas_size;
+	who = &whowas_ring[pos];
+	whowas_count++;
 
-	wtop = whowas_get_top(client_p->name);
-	who = rb_malloc(sizeof(whowas_t));
-	who->wtop = wtop;
 	who->logoff = rb_current_time();
 
 	rb_strlcpy(who->name, client_p->name, sizeof(who->name));
-	rb_strlcpy(who->username, client_p->username, sizeof(who->username));
-	rb_strlcpy(who->hostname, client_p->host, sizeof(who->hostname));
-	rb_strlcpy(who->realname, client_p->info, sizeof(who->realname));
+	who->hashv = hash_irccase(who->name);
+	who->username = intern_add(client_p->username, USERLEN);
+	who->hostname = intern_add(client_p->host, HOSTLEN);
+	who->realname = intern_add(client_p->info, REALLEN);
 
 	if(MyClient(client_p))
 	{
-		rb_strlcpy(who->sockhost, client_p->sockhost, sizeof(who->sockhost));
+		who->sockhost = intern_add(client_p->sockhost, HOSTIPLEN);
 		who->spoof = IsIPSpoof(client_p);
 	}
 	else
 	{
 		who->spoof = false;
 		if(EmptyString(client_p->sockhost) || !strcmp(client_p->sockhost, "0"))
-			who->sockhost[0] = '\0';
+			who->sockhost = intern_add("", 0);
 		else
-			rb_strlcpy(who->sockhost, client_p->sockhost, sizeof(who->sockhost));
+			who->sockhost = intern_add(client_p->sockhost, HOSTIPLEN);
 	}
 
 	/* this is safe do to with the servername cache */
@@ -145,8 +218,7 @@ whowas_add_history(struct Client *client_p, bool online)
 	else
 		who->online = NULL;
 
-	rb_dlinkAdd(who, &who->wnode, &wtop->wwlist);
-	rb_dlinkAdd(who, &who->whowas_node, whowas_list);
+	whowas_link(who);
 }
 
 
@@ -166,76 +238,82 @@ whowas_off_history(struct Client *client_p)
 struct Client *
 whowas_get_history(const char *nick, time_t timelimit)
 {
-	struct whowas_top *wtop;
-	rb_dlink_node *ptr;
-
-	wtop = hash_find_data(whowas_hash, nick);
-	if(wtop == NULL)
-		return NULL;
+	whowas_t *who, *found = NULL;
 
 	timelimit = rb_current_time() - timelimit;
 
-	RB_DLINK_FOREACH_PREV(ptr, wtop->wwlist.tail)
-	{
-		whowas_t *who = ptr->data;
-		if(who->logoff >= timelimit)
-		{
-			return who->online;
-		}
-	}
-	return NULL;;
+	/* the oldest record within the limit */
+	for(who = whowas_get_first(nick); who != NULL && who->logoff >= timelimit;
+	    who = whowas_get_next(who))
+		found = who;
+
+	if(found == NULL)
+		return NULL;
+	return found->online;
 }
 
-static void
-whowas_trim(void *unused)
+void
+whowas_init(void)
+{
+	whowas_set_size(NICKNAMEHISTORYLENGTH);
+}
+
+/* whowas_set_size()
+ *
+ * inputs	- number of records to keep
+ * outputs	-
+ * side effects - the ring and index are reallocated at the new size,
+ *		  keeping as many of the newest records as fit
+ */
+void
+whowas_set_size(int len)
 {
-	long over;
+	whowas_t *ring = NULL;
+	uint32_t size = len > 0 ? (uint32_t)len : 0;
+	uint32_t index_size = WHOWAS_INDEX_MIN;
+	uint32_t i;
 
-	if(rb_dlink_list_length(whowas_list) < whowas_list_length)
+	if(whowas_index != NULL && size == whowas_size)
 		return;
-	over = rb_dlink_list_length(whowas_list) - whowas_list_length;
 
-	/* remove whowas entries over the configured length */
-	for(long i = 0; i < over; i++)
+	while(whowas_count > size)
+		whowas_expire();
+
+	while(index_size < size * 2)
+		index_size <<= 1;
+
+	if(size > 0)
+		ring = rb_malloc(sizeof(whowas_t) * size);
+
+	for(i = 0; i < whowas_count; i++)
 	{
-		if(whowas_list->tail != NULL && whowas_list->tail->data != NULL)
+		whowas_t *old = &whowas_ring[(whowas_start + i) % whowas_size];
+		whowas_t *who = &ring[i];
+
+		*who = *old;
+		if(who->online != NULL)
 		{
-			whowas_t *twho = whowas_list->tail->data;
-			if(twho->online != NULL)
-				rb_dlinkDelete(&twho->cnode, &twho->online->whowas_clist);
-			rb_dlinkDelete(&twho->wnode, &twho->wtop->wwlist);
-			rb_dlinkDelete(&twho->whowas_node, whowas_list);
-			whowas_free_wtop(twho->wtop);
-			rb_free(twho);
+			rb_dlinkDelete(&old->cnode, &who->online->whowas_clist);
+			rb_dlinkAdd(who, &who->cnode, &who->online->whowas_clist);
 		}
 	}
-}
 
-void
-whowas_init(void)
-{
-	whowas_hash = hash_create("WHOWAS", CMP_IRCCMP, WHOWAS_MAX_BITS, 0);
-	whowas_list = rb_malloc(sizeof(rb_dlink_list));
-	if(whowas_list_length == 0)
-	{
-		whowas_list_length = NICKNAMEHISTORYLENGTH;
-	}
-	rb_event_add("whowas_trim", whowas_trim, NULL, 10);
-}
+	rb_free(whowas_ring);
+	rb_free(whowas_index);
+	whowas_ring = ring;
+	whowas_size = size;
+	whowas_start = 0;
+	whowas_index = rb_malloc(sizeof(uint32_t) * index_size);
+	whowas_index_mask = index_size - 1;
 
-void
-whowas_set_size(int len)
-{
-	whowas_list_length = len;
-	whowas_trim(NULL);
+	for(i = 0; i < whowas_count; i++)
+		whowas_link(&whowas_ring[i]);
 }
 
 void
 whowas_memory_usage(size_t * count, size_t * memused)
 {
-	size_t hcount;
-	hash_get_memusage(whowas_hash, &hcount, memused);
-	*count = rb_dlink_list_length(whowas_list);
-	*memused += *count * sizeof(whowas_t);
-	*memused += sizeof(struct whowas_top) * hcount;
+	*count = whowas_count;
+	*memused = sizeof(whowas_t) * whowas_size;
+	*memused += sizeof(uint32_t) * (whowas_index_mask + 1);
 }